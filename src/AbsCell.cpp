@@ -82,6 +82,12 @@ void AbsCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t AbsCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_innerCell, m_open, m_close);
+}
+
 
 void AbsCell::SetInner(MathCell *inner)
 {
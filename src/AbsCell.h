@@ -61,6 +61,8 @@ public:
   
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   void SetInner(MathCell *inner);
 
   virtual wxString GetToolTip(const wxPoint &point){
@@ -70,6 +70,12 @@ void AtCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t AtCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_baseCell, m_indexCell);
+}
+
 void AtCell::SetIndex(MathCell *index)
 {
   if (index == NULL)
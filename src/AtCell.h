@@ -34,6 +34,8 @@ public:
 
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   CellPointers *m_cellPointers;
 
   virtual wxString GetToolTip(const wxPoint &point){
@@ -29,9 +29,39 @@
 
 #include <wx/config.h>
 #include <wx/clipbrd.h>
+#include <wx/thread.h>
 
 #define BM_FULL_WIDTH 1000
 
+/*! A thread that compresses and saves an image
+
+  Compressing a big bitmap to a .png file can take a noticeable amount of time.
+  The thread is detached and deletes itself once it is finished.
+ */
+class BitmapSaveThread : public wxThread
+{
+public:
+  //! The image must not share its data with an image the main thread can access.
+  BitmapSaveThread(wxImage image, wxString file) : wxThread(wxTHREAD_DETACHED)
+  {
+    m_image = image;
+    m_file = file;
+  }
+
+protected:
+  virtual ExitCode Entry()
+  {
+    // wxLog collects the messages of other threads and shows them in the main thread.
+    if (!Bitmap::SaveImage(m_image, m_file))
+      wxLogError(_("Could not save the image to %s."), m_file.c_str());
+    return 0;
+  }
+
+private:
+  wxImage m_image;
+  wxString m_file;
+};
+
 Bitmap::Bitmap(Configuration **configuration, int scale)
 {
   m_configuration = configuration;
@@ -293,42 +323,67 @@ void Bitmap::Draw()
   MathCell::ClipToDrawRegion(true);
 }
 
-wxSize Bitmap::ToFile(wxString file)
+void Bitmap::SetBitmap(wxBitmap bitmap)
 {
-  // Assign an resolution to the bitmap.
-  wxImage img = m_bmp.ConvertToImage();
-  int resolution = img.GetOptionInt(wxIMAGE_OPTION_RESOLUTION);
-  if (resolution <= 0)
-    resolution = 75;
-  img.SetOption(wxIMAGE_OPTION_RESOLUTION, resolution * m_scale);
+  m_bmp = bitmap;
+  m_width = bitmap.GetWidth();
+  m_height = bitmap.GetHeight();
+}
 
-  bool success = false;
+bool Bitmap::SaveImage(wxImage image, wxString file)
+{
   if (file.Right(4) == wxT(".bmp"))
-    success = img.SaveFile(file, wxBITMAP_TYPE_BMP);
+    return image.SaveFile(file, wxBITMAP_TYPE_BMP);
   else if (file.Right(4) == wxT(".xpm"))
-    success = img.SaveFile(file, wxBITMAP_TYPE_XPM);
+    return image.SaveFile(file, wxBITMAP_TYPE_XPM);
   else if (file.Right(4) == wxT(".jpg"))
-    success = img.SaveFile(file, wxBITMAP_TYPE_JPEG);
+    return image.SaveFile(file, wxBITMAP_TYPE_JPEG);
   else
   {
     if (file.Right(4) != wxT(".png"))
       file = file + wxT(".png");
-    success = img.SaveFile(file, wxBITMAP_TYPE_PNG);
+    return image.SaveFile(file, wxBITMAP_TYPE_PNG);
   }
+}
 
+wxSize Bitmap::ToFile(wxString file, bool inBackground)
+{
   wxSize retval;
+  retval.x = -1;
+  retval.y = -1;
+  if (!m_bmp.IsOk())
+    return retval;
+
+  // Assign an resolution to the bitmap.
+  wxImage img = m_bmp.ConvertToImage();
+  int resolution = img.GetOptionInt(wxIMAGE_OPTION_RESOLUTION);
+  if (resolution <= 0)
+    resolution = 75;
+  img.SetOption(wxIMAGE_OPTION_RESOLUTION, resolution * m_scale);
+
+  bool success = false;
+  if (inBackground)
+  {
+    // wxImage is reference-counted without locking => hand the thread a
+    // copy of its own.
+    BitmapSaveThread *thread = new BitmapSaveThread(img.Copy(), file);
+    if (thread->Run() == wxTHREAD_NO_ERROR)
+      success = true;
+    else
+    {
+      delete thread;
+      success = SaveImage(img, file);
+    }
+  }
+  else
+    success = SaveImage(img, file);
+
   if (success)
   {
     retval.x = GetRealWidth();
     retval.y = GetRealHeight();
-    return retval;
   }
-  else
-  {
-    retval.x = -1;
-    retval.y = -1;
-    return retval;
-  };
+  return retval;
 }
 
 bool Bitmap::ToClipboard()
@@ -51,11 +51,31 @@ public:
    */
   bool SetData(MathCell *tree, long int maxSize = -1);
 
+  /*! Use a bitmap that has been rendered earlier instead of rendering a list of cells
+
+    \param bitmap The bitmap, rendered at the scale this object was created with
+   */
+  void SetBitmap(wxBitmap bitmap);
+
   /*! Exports this bitmap to a file
 
+    \param file The name of the file
+    \param inBackground true = Compress and write the file in a background thread
+                        so the GUI can continue immediately. The file doesn't exist
+                        yet when ToFile() returns; if it cannot be written this is
+                        reported using wxLogError().
+
     \return The size of the bitmap in millimeters. Sizes <0 indicate that the export has failed.
    */
-  wxSize ToFile(wxString file);
+  wxSize ToFile(wxString file, bool inBackground = false);
+
+  /*! Saves an image to a file
+
+    The file type is determined by the file name's extension; files without a
+    known extension are saved as .png.
+    Doesn't access the GUI which means it can be called from any thread.
+   */
+  static bool SaveImage(wxImage image, wxString file);
 
   //! Returns the bitmap representation of the list of cells that was passed to SetData()
   wxBitmap GetBitmap()
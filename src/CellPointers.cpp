@@ -43,6 +43,8 @@ CellPointers::CellPointers(wxScrolledCanvas *mathCtrl)
   m_selectionString = wxEmptyString;
   m_selectionStart = NULL;
   m_selectionEnd = NULL;
+  m_outputCacheSize = 0;
+  m_collapsedCellVisible = false;
 
 }
 
@@ -55,3 +57,13 @@ bool CellPointers::ErrorList::Contains(MathCell *cell)
   }
   return false;
 }
+
+bool CellPointers::InFlight(MathCell *cell)
+{
+  for(std::list<CommandInFlight>::iterator it = m_commandsInFlight.begin(); it != m_commandsInFlight.end();++it)
+  {
+    if(it->m_cell == cell)
+      return true;
+  }
+  return false;
+}
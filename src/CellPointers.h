@@ -63,6 +63,8 @@ public:
     ErrorList(){};
     //! Is the list of errors empty?
     bool Empty(){return m_errorList.empty();}
+    //! The number of GroupCells with errors in the list
+    size_t Size(){return m_errorList.size();}
     //! Remove one specific GroupCell from the list of errors
     void Remove(MathCell * cell){m_errorList.remove(cell);}
     //! Does the list of GroupCell with errors contain cell?
@@ -158,6 +160,47 @@ public:
   WX_DECLARE_VOIDPTR_HASH_MAP( int, SlideShowTimersList);
   SlideShowTimersList m_slideShowTimers;
 
+  /*! The GroupCells that keep a bitmap of their output
+
+    The least recently drawn GroupCell comes first. See GroupCell::Draw().
+   */
+  std::list<MathCell *> m_outputCaches;
+  //! How many bytes the bitmaps of the GroupCells in m_outputCaches occupy
+  size_t m_outputCacheSize;
+
+  //! A command that has been sent to maxima, but whose prompt hasn't arrived, yet
+  struct CommandInFlight
+  {
+    CommandInFlight(MathCell *cell, long generation)
+    {
+      m_cell = cell;
+      m_generation = generation;
+    }
+    //! The GroupCell the command belongs to
+    MathCell *m_cell;
+    //! The EvaluationQueue::Generation() the command has been sent in
+    long m_generation;
+  };
+  /*! The commands from the evaluation queue maxima has received, but not finished
+
+    The first one is the one maxima is working on. Only maintained if
+    Configuration::PipelineDepth() allows sending commands ahead of time.
+    Maxima will still send the output of these cells => MathCtrl::CanDeleteRegion()
+    refuses to delete them.
+   */
+  std::list<CommandInFlight> m_commandsInFlight;
+  //! Has maxima received a command from this GroupCell that it hasn't finished, yet?
+  bool InFlight(MathCell *cell);
+
+  /*! The GroupCells a cell of which has changed its size while it was drawn
+
+    They and the cells below them need to be laid out again. See MatrCell::Draw().
+   */
+  std::list<MathCell *> m_recalculationRequests;
+
+  //! Has a CollapsedCell been drawn that can be expanded at once? See CollapsedCell::Draw().
+  bool m_collapsedCellVisible;
+
   wxScrolledCanvas *GetMathCtrl(){return m_mathCtrl;}
 
 private:
@@ -0,0 +1,249 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class CollapsedCell
+
+  CollapsedCell keeps output that is too long to be displayed at once in a compressed form.
+*/
+
+#include "CollapsedCell.h"
+#include "MathParser.h"
+
+#include <wx/mstream.h>
+#include <wx/zstream.h>
+
+//! The number of characters of text the preview shows of the beginning and the end of the output.
+#define COLLAPSED_PREVIEW_LENGTH 40
+
+CollapsedCell::CollapsedCell(MathCell *parent, Configuration **config, CellPointers *cellPointers) :
+        TextCell(parent, config, cellPointers)
+{
+  m_length = 0;
+  m_expandWhenVisible = false;
+  ForceBreakLine(true);
+  UpdatePreview();
+}
+
+size_t CollapsedCell::SizeInMemory()
+{
+  size_t size = TextCell::SizeInMemory() + (m_head.Length() + m_tail.Length()) * sizeof(wxChar);
+  for (size_t i = 0; i < m_chunks.size(); i++)
+    size += m_chunks[i].GetDataLen() + sizeof(long) + sizeof(int) +
+            m_chunkUserLabels[i].Length() * sizeof(wxChar);
+  return size;
+}
+
+MathCell *CollapsedCell::Copy()
+{
+  CollapsedCell *retval = new CollapsedCell(m_group, m_configuration, m_cellPointers);
+  CopyData(this, retval);
+  retval->m_chunks = m_chunks;
+  retval->m_chunkLengths = m_chunkLengths;
+  retval->m_chunkStyles = m_chunkStyles;
+  retval->m_chunkUserLabels = m_chunkUserLabels;
+  retval->m_length = m_length;
+  retval->m_expandWhenVisible = m_expandWhenVisible;
+  retval->m_head = m_head;
+  retval->m_tail = m_tail;
+  retval->m_forceBreakLine = m_forceBreakLine;
+  retval->m_bigSkip = m_bigSkip;
+  retval->UpdatePreview();
+  return retval;
+}
+
+void CollapsedCell::AppendXML(wxString xml, int style, wxString userLabel)
+{
+  wxString text = PlainText(xml);
+  if (m_chunks.empty())
+    m_head = text.Left(COLLAPSED_PREVIEW_LENGTH);
+  m_tail = text.Right(COLLAPSED_PREVIEW_LENGTH);
+
+  m_chunks.push_back(Compress(xml));
+  m_chunkLengths.push_back(xml.Length());
+  m_chunkStyles.push_back(style);
+  m_chunkUserLabels.push_back(userLabel);
+  m_length += xml.Length();
+  UpdatePreview();
+}
+
+bool CollapsedCell::ExpandWhenVisible()
+{
+  if (!m_expandWhenVisible)
+    return false;
+  long maxLength = (*m_configuration)->ShowLengthChars();
+  return (maxLength == 0) || (m_length < maxLength);
+}
+
+void CollapsedCell::Draw(wxPoint point, int fontsize)
+{
+  TextCell::Draw(point, fontsize);
+
+  // The cells of a bitmap or a printout are copies that are about to be deleted.
+  if ((!Printing()) && DrawThisCell(point) && ExpandWhenVisible())
+    m_cellPointers->m_collapsedCellVisible = true;
+}
+
+void CollapsedCell::UpdatePreview()
+{
+  SetValue(wxString::Format(_("<< %li characters of output collapsed: \"%s ... %s\" - double-click to expand >>"),
+                            m_length, m_head.c_str(), m_tail.c_str()));
+  // SetValue() has reset the tooltip.
+  SetToolTip(_("This output is too long to be displayed as a whole.\n"
+               "Double-click it in order to display the next part of it.\n"
+               "The maximum size of a expression wxMaxima displays at once "
+               "can be changed in the configuration dialogue."));
+}
+
+MathCell *CollapsedCell::Expand()
+{
+  long maxLength = (*m_configuration)->ShowLengthChars();
+  MathParser parser(m_configuration, m_cellPointers);
+  MathCell *retval = NULL;
+
+  // Parse at least one chunk - and as many more as fit into the maximum expression length.
+  long length = 0;
+  size_t chunk = 0;
+  while ((chunk < m_chunks.size()) &&
+         ((chunk == 0) || (maxLength == 0) || (length + m_chunkLengths[chunk] < maxLength)))
+  {
+    length += m_chunkLengths[chunk];
+    parser.SetUserLabel(m_chunkUserLabels[chunk]);
+    MathCell *cell = parser.ParseXML(Uncompress(m_chunks[chunk]), m_chunkStyles[chunk]);
+    if (cell != NULL)
+    {
+      cell->ForceBreakLine(true);
+      if (retval == NULL)
+        retval = cell;
+      else
+        retval->AppendCell(cell);
+    }
+    chunk++;
+  }
+
+  // Keep the rest of the output collapsed
+  if (chunk < m_chunks.size())
+  {
+    CollapsedCell *rest = new CollapsedCell(m_group, m_configuration, m_cellPointers);
+    rest->m_head = PlainText(Uncompress(m_chunks[chunk])).Left(COLLAPSED_PREVIEW_LENGTH);
+    rest->m_tail = m_tail;
+    for (; chunk < m_chunks.size(); chunk++)
+    {
+      rest->m_chunks.push_back(m_chunks[chunk]);
+      rest->m_chunkLengths.push_back(m_chunkLengths[chunk]);
+      rest->m_chunkStyles.push_back(m_chunkStyles[chunk]);
+      rest->m_chunkUserLabels.push_back(m_chunkUserLabels[chunk]);
+      rest->m_length += m_chunkLengths[chunk];
+    }
+    rest->UpdatePreview();
+    if (retval == NULL)
+      retval = rest;
+    else
+      retval->AppendCell(rest);
+  }
+
+  if (retval == NULL)
+  {
+    retval = new TextCell(m_group, m_configuration, m_cellPointers, wxT(" "));
+    retval->ForceBreakLine(true);
+  }
+  return retval;
+}
+
+wxString CollapsedCell::ToXML()
+{
+  wxString xml = wxT("<collapsed>");
+  for (size_t i = 0; i < m_chunks.size(); i++)
+  {
+    xml += wxT("<chunk");
+    if (m_chunkStyles[i] == MC_TYPE_ERROR)
+      xml += wxT(" type=\"error\"");
+    if (m_chunkStyles[i] == MC_TYPE_WARNING)
+      xml += wxT(" type=\"warning\"");
+    if (m_chunkStyles[i] == MC_TYPE_PROMPT)
+      xml += wxT(" type=\"prompt\"");
+    if (m_chunkUserLabels[i] != wxEmptyString)
+      xml += wxT(" userdefinedlabel=\"") + XMLescape(m_chunkUserLabels[i]) + wxT("\"");
+    xml += wxT(">") + XMLescape(Uncompress(m_chunks[i])) + wxT("</chunk>");
+  }
+  return xml + wxT("</collapsed>");
+}
+
+wxMemoryBuffer CollapsedCell::Compress(wxString xml)
+{
+  wxMemoryOutputStream memStream;
+  {
+    wxZlibOutputStream zlibStream(memStream);
+    wxCharBuffer utf8 = xml.utf8_str();
+    zlibStream.Write(utf8.data(), strlen(utf8.data()));
+  }
+
+  wxMemoryBuffer retval;
+  size_t length = memStream.GetSize();
+  memStream.CopyTo(retval.GetAppendBuf(length), length);
+  retval.UngetAppendBuf(length);
+  return retval;
+}
+
+wxString CollapsedCell::Uncompress(wxMemoryBuffer data)
+{
+  wxMemoryInputStream memStream(data.GetData(), data.GetDataLen());
+  wxZlibInputStream zlibStream(memStream);
+
+  wxMemoryBuffer utf8;
+  char *buf = (char *) malloc(8192);
+  while (!zlibStream.Eof())
+  {
+    zlibStream.Read(buf, 8192);
+    utf8.AppendData(buf, zlibStream.LastRead());
+  }
+  free(buf);
+  return wxString::FromUTF8((char *) utf8.GetData(), utf8.GetDataLen());
+}
+
+wxString CollapsedCell::PlainText(wxString xml)
+{
+  wxString text;
+  bool inTag = false;
+  bool lastWasSpace = true;
+  for (wxString::iterator it = xml.begin(); it != xml.end(); ++it)
+  {
+    if (*it == wxT('<'))
+      inTag = true;
+    else if (*it == wxT('>'))
+      inTag = false;
+    else if (!inTag)
+    {
+      bool isSpace = wxIsspace(*it);
+      if (!isSpace)
+        text += *it;
+      else if (!lastWasSpace)
+        text += wxT(' ');
+      lastWasSpace = isSpace;
+    }
+  }
+  text.Replace(wxT("&lt;"), wxT("<"));
+  text.Replace(wxT("&gt;"), wxT(">"));
+  text.Replace(wxT("&quot;"), wxT("\""));
+  text.Replace(wxT("&apos;"), wxT("'"));
+  text.Replace(wxT("&amp;"), wxT("&"));
+  text.Trim();
+  return text;
+}
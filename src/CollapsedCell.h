@@ -0,0 +1,134 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class CollapsedCell
+
+  CollapsedCell keeps output that is too long to be displayed at once in a compressed form.
+*/
+
+#ifndef COLLAPSEDCELL_H
+#define COLLAPSEDCELL_H
+
+#include "TextCell.h"
+#include <wx/buffer.h>
+#include <vector>
+
+/*! A cell that contains output that is too long to be displayed as a whole
+
+  Parsing and laying out huge results can take a long time and much memory. This
+  cell instead keeps the xml maxima has sent in a compressed form and only shows a 
+  preview of the beginning and the end of the output. The cells the output consists
+  of are only created if the user asks for them by double-clicking this cell.
+
+  The output is stored as a list of chunks each of which is a xml fragment
+  MathParser::ParseLine() accepts. Expand() only parses as many chunks as fit
+  into the configured maximum expression length at once.
+
+  In a file the chunks are saved as text, see ToXML(), so loading the file
+  doesn't parse them, either. If the whole output of a cell that has been
+  loaded from a file fits into the maximum expression length it is parsed
+  as soon as it becomes visible, see ExpandWhenVisible().
+ */
+class CollapsedCell : public TextCell
+{
+public:
+  CollapsedCell(MathCell *parent, Configuration **config, CellPointers *cellPointers);
+
+  size_t SizeInMemory();
+
+  MathCell *Copy();
+
+  /*! Adds a chunk of output
+
+    \param xml A xml fragment with a root element as it is passed to 
+                MathParser::ParseLine().
+    \param style The style MathParser::ParseLine() would have parsed the chunk with
+    \param userLabel The label for the output the user has defined, if any
+   */
+  void AppendXML(wxString xml, int style = MC_TYPE_DEFAULT, wxString userLabel = wxEmptyString);
+
+  /*! Parses the next part of the collapsed output
+
+    \return A list of cells that should replace this one. If not all of the output
+            fits into the maximum expression length the last element of this list
+            is a CollapsedCell holding the rest of the output.
+   */
+  MathCell *Expand();
+
+  //! The number of characters of xml this cell contains
+  long GetLength()
+  { return m_length; }
+
+  //! Lets ExpandWhenVisible() return true if the output fits into the maximum expression length
+  void SetExpandWhenVisible(bool expand)
+  { m_expandWhenVisible = expand; }
+
+  /*! Is this cell to be expanded as soon as it becomes visible?
+
+    True for cells that have been loaded from a file and that Expand() would
+    parse completely: They only have been collapsed because of the number of
+    output cells or a maximum expression length that has been raised since.
+   */
+  bool ExpandWhenVisible();
+
+  //! Requests the expansion of the cell if it is drawn and ExpandWhenVisible()
+  void Draw(wxPoint point, int fontsize);
+
+  /*! Saves the chunks as text inside a \<collapsed\> tag
+
+    The chunks are xml fragments of their own which would otherwise be nested
+    into the \<mth\> tag GroupCell::ToXML() wraps the output in.
+    MathParser::ParseCollapsedTag() reads them back without parsing them.
+   */
+  wxString ToXML();
+
+private:
+  //! Updates the text this cell displays
+  void UpdatePreview();
+
+  //! Compresses a chunk of xml
+  static wxMemoryBuffer Compress(wxString xml);
+
+  //! Uncompresses a chunk of xml
+  static wxString Uncompress(wxMemoryBuffer data);
+
+  //! Extracts the text from a chunk of xml
+  static wxString PlainText(wxString xml);
+
+  //! The compressed chunks of xml
+  std::vector<wxMemoryBuffer> m_chunks;
+  //! The lengths of the uncompressed chunks
+  std::vector<long> m_chunkLengths;
+  //! The style each chunk is to be parsed with
+  std::vector<int> m_chunkStyles;
+  //! The user-defined label of the output of each chunk
+  std::vector<wxString> m_chunkUserLabels;
+  //! The number of characters of xml all chunks contain
+  long m_length;
+  //! See SetExpandWhenVisible()
+  bool m_expandWhenVisible;
+  //! The beginning of the text of the first chunk
+  wxString m_head;
+  //! The end of the text of the last chunk
+  wxString m_tail;
+};
+
+#endif // COLLAPSEDCELL_H
@@ -0,0 +1,524 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class CommandPreprocessor
+
+  CommandPreprocessor checks a command and prepares it for being sent to maxima.
+*/
+
+#include "CommandPreprocessor.h"
+#include <wx/intl.h>
+#include <wx/tokenzr.h>
+#include <vector>
+
+CommandPreprocessor::CommandPreprocessor()
+{
+  m_errorIndex = 0;
+  m_findSymbols = false;
+  m_joinLines = false;
+}
+
+bool CommandPreprocessor::Error(wxString error, int index)
+{
+  m_error = error;
+  m_errorIndex = index;
+  return false;
+}
+
+bool CommandPreprocessor::Process(const wxString &command, bool lisp, bool findSymbols)
+{
+  m_error = wxEmptyString;
+  m_errorIndex = 0;
+  m_command = wxEmptyString;
+  m_command.Alloc(command.Length() + 1);
+  m_variables.Clear();
+  m_functions.Clear();
+  m_templates.Clear();
+  m_symbols.Clear();
+  m_symbol = wxEmptyString;
+  m_findSymbols = findSymbols;
+  m_joinLines = false;
+
+  if (command.EndsWith(wxT("\\")))
+    return Error(_("Cell ends in a backslash"), command.Length() - 1);
+
+  // The closing parenthesis we expect, the innermost one last
+  std::vector<wxChar> delimiters;
+  // The last character outside comments that wasn't whitespace
+  wxChar lastC = wxT(';');
+  // The position in m_command the current statement starts at
+  size_t statementStart = 0;
+  // Did the current statement contain anything but whitespace and comments, yet?
+  bool statementEmpty = true;
+  bool firstStatement = true;
+  // Does the current statement call to_lisp(), which makes maxima read lisp after it?
+  bool toLisp = false;
+
+  int index = 0;
+  wxString::const_iterator end = command.end();
+  for (wxString::const_iterator it = command.begin(); it != end; ++it, ++index)
+  {
+    wxChar c = *it;
+
+    // Characters that translate to a single other character are treated as that one.
+    const wxChar *translation = Translation(c);
+    if ((translation != NULL) && (translation[1] == wxT('\0')))
+    {
+      c = translation[0];
+      translation = NULL;
+    }
+
+    // In lisp a ";" starts a comment that lasts until the end of the line.
+    if (lisp && (c == wxT(';')))
+    {
+      EndSymbol();
+      wxString::const_iterator next = it;
+      ++next;
+      while ((next != end) && (*next != wxT('\n')))
+      {
+        it = next;
+        ++next;
+        ++index;
+      }
+      continue;
+    }
+
+    // Strings
+    if (c == wxT('\"'))
+    {
+      EndSymbol();
+      int start = index;
+      Append(c, it, end);
+      ++it;
+      ++index;
+      while ((it != end) && (*it != wxT('\"')))
+      {
+        if (*it == wxT('\\'))
+        {
+          Append(*it, it, end);
+          ++it;
+          ++index;
+          if (it == end)
+            break;
+        }
+        Append(*it, it, end);
+        ++it;
+        ++index;
+      }
+      if (it == end)
+        return Error(_("Unterminated string."), start);
+      Append(c, it, end);
+      lastC = c;
+      statementEmpty = false;
+      continue;
+    }
+
+    // Comments
+    if ((c == wxT('/')) && (!lisp))
+    {
+      wxString::const_iterator next = it;
+      ++next;
+      if ((next != end) && (*next == wxT('*')))
+      {
+        EndSymbol();
+        int start = index;
+        Append(c, it, end);
+        Append(*next, next, end);
+        it = next;
+        ++index;
+        wxChar last = wxT('\0');
+        bool closed = false;
+        for (++it, ++index; it != end; ++it, ++index)
+        {
+          Append(*it, it, end);
+          if ((last == wxT('*')) && (*it == wxT('/')))
+          {
+            closed = true;
+            break;
+          }
+          last = *it;
+        }
+        if (!closed)
+          return Error(_("Unterminated comment."), start);
+        continue;
+      }
+    }
+
+    // Escaped characters. The command doesn't end in a backslash => There is a next one.
+    if (c == wxT('\\'))
+    {
+      EndSymbol();
+      Append(c, it, end);
+      ++it;
+      ++index;
+      Append(*it, it, end);
+      lastC = c;
+      statementEmpty = false;
+      continue;
+    }
+
+    // The end of a statement
+    if ((!lisp) && ((c == wxT(';')) || (c == wxT('$'))))
+    {
+      EndSymbol();
+      if (!delimiters.empty())
+        return Error(_("Un-closed parenthesis on encountering ; or $"), index);
+
+      if (statementEmpty)
+      {
+        // Maxima would complain about an empty statement. If the command starts
+        // with one we leave it a single ";" or "$", though.
+        m_command.Truncate(statementStart);
+        if (firstStatement)
+          m_command += c;
+      }
+      else
+      {
+        m_command += c;
+        FindDefinition(statementStart);
+      }
+      statementStart = m_command.Length();
+      statementEmpty = true;
+      firstStatement = false;
+      lastC = c;
+      lisp = toLisp;
+      continue;
+    }
+
+    switch (c)
+    {
+      // Is this a :lisp or :lisp-quiet command?
+      case wxT(':'):
+        if (statementEmpty && (!lisp))
+        {
+          wxString word;
+          wxString::const_iterator next = it;
+          for (++next; (next != end) && (word.Length() < 4) && (wxIsalpha(*next)); ++next)
+            word += *next;
+          if (word == wxT("lisp"))
+          {
+            lisp = true;
+            // Maxima reads only one line of a :lisp command.
+            m_joinLines = firstStatement;
+          }
+        }
+        break;
+
+      // Is this a call to to_lisp()?
+      case wxT('t'):
+        if ((!lisp) && (m_command.IsEmpty() || !IsSymbolChar(m_command.Last())))
+        {
+          wxString word;
+          wxString::const_iterator next = it;
+          for (; (next != end) && (word.Length() < 8) && IsSymbolChar(*next); ++next)
+            word += *next;
+          if (word == wxT("to_lisp"))
+            toLisp = true;
+        }
+        break;
+
+      // Opening parenthesis
+      case wxT('('):
+        delimiters.push_back(wxT(')'));
+        break;
+      case wxT('['):
+        delimiters.push_back(wxT(']'));
+        break;
+      case wxT('{'):
+        delimiters.push_back(wxT('}'));
+        break;
+
+      // Closing parenthesis
+      case wxT(')'):
+      case wxT(']'):
+      case wxT('}'):
+        if (delimiters.empty() || (c != delimiters.back()))
+          return Error(_("Mismatched parenthesis"), index);
+        delimiters.pop_back();
+        if (lastC == wxT(','))
+          return Error(_("Comma directly followed by a closing parenthesis"), index);
+        break;
+    }
+
+    if (IsSymbolChar(c) && (translation == NULL))
+    {
+      if (m_findSymbols)
+        m_symbol += c;
+    }
+    else
+      EndSymbol();
+
+    Append(c, it, end);
+    if (!wxIsspace(c))
+    {
+      lastC = c;
+      statementEmpty = false;
+    }
+  }
+  EndSymbol();
+
+  if (!delimiters.empty())
+    return Error(_("Un-closed parenthesis"), index);
+
+  if ((!lisp) && (!statementEmpty))
+    FindDefinition(statementStart);
+  if (lisp)
+    FindLispDefinitions(statementStart);
+
+  m_command.Trim(true);
+  m_command += wxT("\n");
+
+  if ((!lisp) && (lastC != wxT(';')) && (lastC != wxT('$')))
+  {
+    // Cells ending in "(to-maxima)" (with optional spaces around the "to-maxima")
+    // don't require an ending, neither.
+    wxString text = command;
+    text.Trim(true);
+    bool toMaxima = false;
+    if (text.EndsWith(wxT(")")))
+    {
+      text.RemoveLast();
+      text.Trim(true);
+      toMaxima = text.EndsWith(wxT("to-maxima"));
+    }
+    if (!toMaxima)
+      return Error(_("No dollar ($) or semicolon (;) at the end of command"), index);
+  }
+  return true;
+}
+
+void CommandPreprocessor::EndSymbol()
+{
+  if (m_symbol.IsEmpty())
+    return;
+
+  // Numbers aren't symbols.
+  if ((!wxIsdigit(m_symbol[0])) && (m_symbols.Index(m_symbol) == wxNOT_FOUND))
+    m_symbols.Add(m_symbol);
+  m_symbol = wxEmptyString;
+}
+
+void CommandPreprocessor::FindDefinition(size_t start)
+{
+  const wxString &command = m_command;
+  size_t end = command.Length();
+  size_t i = start;
+
+  // Skip whitespace and comments
+  while (i < end)
+  {
+    if (wxIsspace(command[i]))
+      i++;
+    else if ((command[i] == wxT('/')) && (i + 1 < end) && (command[i + 1] == wxT('*')))
+    {
+      for (i += 2; (i + 1 < end) && !((command[i] == wxT('*')) && (command[i + 1] == wxT('/'))); i++);
+      i += 2;
+    }
+    else
+      break;
+  }
+
+  size_t nameStart = i;
+  while ((i < end) && IsSymbolChar(command[i]))
+    i++;
+  if (i <= nameStart)
+    return;
+  wxString name = command.Mid(nameStart, i - nameStart);
+
+  while ((i < end) && (command[i] == wxT(' ')))
+    i++;
+  if (i >= end)
+    return;
+
+  // name: value
+  if (command[i] == wxT(':'))
+  {
+    m_variables.Add(name);
+    return;
+  }
+
+  // name(args) := value
+  if (command[i] != wxT('('))
+    return;
+  size_t argsStart = ++i;
+  while ((i < end) &&
+         (IsSymbolChar(command[i]) || (command[i] == wxT(',')) || (command[i] == wxT('[')) ||
+          (command[i] == wxT(']')) || (command[i] == wxT(' '))))
+    i++;
+  if ((i >= end) || (command[i] != wxT(')')))
+    return;
+  wxString args = command.Mid(argsStart, i - argsStart);
+  for (i++; (i < end) && (command[i] == wxT(' ')); i++);
+  if ((i + 1 >= end) || (command[i] != wxT(':')) || (command[i + 1] != wxT('=')))
+    return;
+
+  m_functions.Add(name);
+
+  // Create a template from the input
+  wxString funTemplate = name + wxT("(");
+  wxStringTokenizer argTokens(args, wxT(","));
+  int count = 0;
+  while (argTokens.HasMoreTokens())
+  {
+    if (count > 0)
+      funTemplate << wxT(",");
+    wxString a = argTokens.GetNextToken().Trim().Trim(false);
+    if (a != wxEmptyString)
+    {
+      if (a[0] == '[')
+        funTemplate << wxT("[<") << a.SubString(1, a.Length() - 2) << wxT(">]");
+      else
+        funTemplate << wxT("<") << a << wxT(">");
+      count++;
+    }
+  }
+  funTemplate << wxT(")");
+  m_templates.Add(funTemplate);
+}
+
+void CommandPreprocessor::FindLispDefinitions(size_t start)
+{
+  const wxString &command = m_command;
+  size_t end = command.Length();
+
+  for (size_t i = start; i < end; i++)
+  {
+    if (command[i] != wxT('('))
+      continue;
+
+    // (operator $name ...
+    size_t j = i + 1;
+    while ((j < end) && wxIsspace(command[j]))
+      j++;
+    size_t operatorStart = j;
+    while ((j < end) && (wxIsalpha(command[j]) || (command[j] == wxT('-'))))
+      j++;
+    wxString op = command.Mid(operatorStart, j - operatorStart).Lower();
+    while ((j < end) && wxIsspace(command[j]))
+      j++;
+    if ((j >= end) || (command[j] != wxT('$')))
+      continue;
+    size_t nameStart = ++j;
+    while ((j < end) && IsSymbolChar(command[j]))
+      j++;
+    if (j <= nameStart)
+      continue;
+    // Lisp reads $FOO and $foo as maxima's foo.
+    wxString name = command.Mid(nameStart, j - nameStart).Lower();
+
+    if ((op == wxT("setf")) || (op == wxT("setq")) || (op == wxT("defvar")) ||
+        (op == wxT("defparameter")) || (op == wxT("defmvar")))
+      m_variables.Add(name);
+    else if ((op == wxT("defun")) || (op == wxT("defmfun")) || (op == wxT("defmspec")))
+      m_functions.Add(name);
+  }
+}
+
+void CommandPreprocessor::Append(wxChar c, wxString::const_iterator it, wxString::const_iterator end)
+{
+#if wxUSE_UNICODE
+  const wxChar *translation = Translation(c);
+  if (translation != NULL)
+  {
+    m_command += translation;
+    return;
+  }
+
+  // A pi that isn't part of a symbol name is %pi.
+  if (c == wxT('\x03C0'))
+  {
+    wxChar next = wxT('\0');
+    if ((++it) != end)
+    {
+      next = *it;
+      const wxChar *nextTranslation = Translation(next);
+      if (nextTranslation != NULL)
+        next = nextTranslation[0];
+    }
+    const wxString &command = m_command;
+    if (((command.IsEmpty()) || (!wxIsalnum(command.Last()))) && (!wxIsalnum(next)))
+    {
+      m_command += wxT("%pi");
+      return;
+    }
+  }
+#endif
+
+  if (m_joinLines && (c == wxT('\n')))
+    c = wxT(' ');
+  m_command += c;
+}
+
+const wxChar *CommandPreprocessor::Translation(wxChar c)
+{
+#if wxUSE_UNICODE
+  switch (c)
+  {
+    case wxT('\x00B2'):
+      return wxT("^2");
+    case wxT('\x00B3'):
+      return wxT("^3");
+    case wxT('\x00BD'):
+      return wxT("(1/2)");
+    case wxT('\x221A'):
+      return wxT("sqrt");
+    case wxT('\x221E'):
+      return wxT("inf");
+    case wxT('\x22C0'):
+      return wxT(" and ");
+    case wxT('\x22C1'):
+      return wxT(" or ");
+    case wxT('\x22BB'):
+      return wxT(" xor ");
+    case wxT('\x22BC'):
+      return wxT(" nand ");
+    case wxT('\x22BD'):
+      return wxT(" nor ");
+    case wxT('\x21D2'):
+      return wxT(" implies ");
+    case wxT('\x21D4'):
+      return wxT(" equiv ");
+    case wxT('\x00AC'):
+      return wxT(" not ");
+    case wxT('\x2260'):
+      return wxT(" # ");
+    case wxT('\x2264'):
+      return wxT(" <= ");
+    case wxT('\x2265'):
+      return wxT(" >= ");
+    case wxT('\x2212'):
+      return wxT("-"); // An unicode minus sign
+    case wxT('\xDCB6'):
+      return wxT(" "); // A non-breakable space
+  }
+#endif
+  return NULL;
+}
+
+wxString CommandPreprocessor::UnicodeToMaxima(const wxString &text)
+{
+  CommandPreprocessor preprocessor;
+  preprocessor.m_command.Alloc(text.Length());
+  wxString::const_iterator end = text.end();
+  for (wxString::const_iterator it = text.begin(); it != end; ++it)
+    preprocessor.Append(*it, it, end);
+  return preprocessor.m_command;
+}
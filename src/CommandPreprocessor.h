@@ -0,0 +1,136 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class CommandPreprocessor
+
+  CommandPreprocessor checks a command and prepares it for being sent to maxima.
+*/
+
+#ifndef COMMANDPREPROCESSOR_H
+#define COMMANDPREPROCESSOR_H
+
+#include <wx/string.h>
+#include <wx/arrstr.h>
+#include <wx/wxcrt.h>
+
+/*! Checks a command and prepares it for being sent to maxima in a single pass
+
+  Sending a command once meant to run over it once in order to check the
+  parenthesis, about twenty times in order to translate unicode characters,
+  once more for removing empty statements and twice per statement in order to
+  find definitions - which was noticeable for big cells or whole .mac files.
+  This class does all of that while reading the command only once:
+   - It checks that all parenthesis, strings and comments are closed and
+     that the command ends in a ";" or a "$".
+   - It translates the unicode characters maxima doesn't understand.
+   - It drops statements that contain nothing but whitespace and comments.
+   - It drops the comments of lisp code and joins :lisp commands into one line.
+   - It finds the variables and functions the command defines, in maxima
+     code as well as in lisp code, and, if asked to, the symbols it uses.
+ */
+class CommandPreprocessor
+{
+public:
+  CommandPreprocessor();
+
+  /*! Check and prepare a command
+
+    \param command The command to send to maxima
+    \param lisp true = maxima is in lisp mode
+    \param findSymbols true = Collect all symbols the command uses, see GetSymbols()
+    \return false, if the command contains an error, see GetError()
+   */
+  bool Process(const wxString &command, bool lisp = false, bool findSymbols = false);
+
+  //! A human-readable description of the error the command contains. Empty = no error.
+  wxString GetError()
+  { return m_error; }
+
+  //! The position of the error in the command
+  int GetErrorIndex()
+  { return m_errorIndex; }
+
+  //! The command in the form it is to be sent to maxima, including the final newline
+  wxString GetCommand()
+  { return m_command; }
+
+  //! The variables the command assigns values to
+  const wxArrayString &GetVariables()
+  { return m_variables; }
+
+  //! The functions the command defines
+  const wxArrayString &GetFunctions()
+  { return m_functions; }
+
+  //! Autocompletion templates like "f(<x>,[<y>])" for the functions the command defines
+  const wxArrayString &GetTemplates()
+  { return m_templates; }
+
+  //! All names outside strings and comments the command uses. Empty unless findSymbols was set.
+  const wxSortedArrayString &GetSymbols()
+  { return m_symbols; }
+
+  //! Translate the unicode characters maxima doesn't understand into maxima code
+  static wxString UnicodeToMaxima(const wxString &text);
+
+private:
+  //! Report an error at this position of the command
+  bool Error(wxString error, int index);
+  //! Append a character to m_command, translating it if maxima won't understand it
+  void Append(wxChar c, wxString::const_iterator next, wxString::const_iterator end);
+  //! Add the name the command has collected so far to m_symbols
+  void EndSymbol();
+  //! Search m_command[start...] for a variable or function definition
+  void FindDefinition(size_t start);
+  //! Search the lisp code in m_command[start...] for definitions of maxima variables and functions
+  void FindLispDefinitions(size_t start);
+  //! Is this character allowed in a maxima symbol name?
+  static bool IsSymbolChar(wxChar c)
+  { return wxIsalnum(c) || (c == wxT('_')) || (c == wxT('%')); }
+  /*! The maxima code for a unicode character
+
+    \return NULL, if maxima understands the character as it is.
+   */
+  static const wxChar *Translation(wxChar c);
+
+  //! The error the command contains
+  wxString m_error;
+  //! The position of m_error in the command
+  int m_errorIndex;
+  //! The command as it will be sent to maxima
+  wxString m_command;
+  //! The variables the command defines
+  wxArrayString m_variables;
+  //! The functions the command defines
+  wxArrayString m_functions;
+  //! Templates for the functions the command defines
+  wxArrayString m_templates;
+  //! The symbols the command uses
+  wxSortedArrayString m_symbols;
+  //! Do we collect the symbols the command uses?
+  bool m_findSymbols;
+  //! The symbol that is currently being read
+  wxString m_symbol;
+  //! Do we replace newlines by spaces? Maxima reads only one line of a :lisp command.
+  bool m_joinLines;
+};
+
+#endif // COMMANDPREPROCESSOR_H
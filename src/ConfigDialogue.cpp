@@ -227,6 +227,14 @@ void ConfigDialogue::SetProperties()
   m_openHCaret->SetToolTip("If this checkbox is set a new code cell is opened as soon as maxima requests data. If it isn't set a new code cell is opened in this case as soon as the user starts typing in code.");
   m_pollStdOut->SetToolTip(
           _("Once the local network link between maxima and wxMaxima has been established maxima has no reason to send any messages using the system's stdout stream so all this stream transport should be a greeting message; The lisp running maxima will send eventual error messages using the system's stderr stream instead. If this box is checked we will nonetheless watch maxima's stdout stream for messages."));
+  m_pipeTransport->SetToolTip(
+          _("Don't connect maxima to wxMaxima by a local network link but send commands to maxima's stdin stream and read its output from its stdout stream instead. Takes effect on the next start of maxima."));
+  m_pipelineDepth->SetToolTip(
+          _("Send up to this many commands from the evaluation queue to maxima before maxima has finished the current one. This saves a round-trip per command which speeds up evaluating many small cells. Commands that make maxima ask a question must not be evaluated this way: maxima would read the next command as the answer. If evaluation is to be aborted on errors commands are never sent ahead. 0 means: Always wait until maxima has finished the current command."));
+  m_sectionKernels->SetToolTip(
+          _("\"Evaluate Sections in Parallel\" evaluates everything in front of the first section using the normal maxima and distributes the sections to up to this many additional maxima processes. Each of these processes keeps the definitions of all sections it has evaluated but doesn't know about the ones of the other sections, so this only works for sections that don't depend on each other."));
+  m_warmStandby->SetToolTip(
+          _("Start a second maxima in the background that is ready to take over as soon as maxima is restarted. Makes restarting maxima nearly instantaneous at the cost of the memory the second maxima occupies. Only works if maxima is connected to wxMaxima by a local network link."));
   m_restartOnReEvaluation->SetToolTip(
           _("Maxima provides no \"forget all\" command that flushes all settings a maxima session could make. wxMaxima therefore normally defaults to starting a fresh maxima process every time the worksheet is to be re-evaluated. As this needs a little bit of time this switch allows to disable this behavior."));
   m_maximaProgram->SetToolTip(_("Enter the path to the Maxima executable."));
@@ -283,7 +291,15 @@ void ConfigDialogue::SetProperties()
   m_defaultPort->SetToolTip(_("The default port used for communication between Maxima and wxMaxima."));
   m_undoLimit->SetToolTip(
           _("Save only this number of actions in the undo buffer. 0 means: save an infinite number of actions."));
+  m_undoMemoryLimit->SetToolTip(
+          _("Discard the oldest actions in the undo buffer if it grows bigger than this number of megabytes. 0 means: no limit."));
+  m_undoKeepsOutput->SetToolTip(
+          _("Keep the output of deleted cells in the undo buffer. If unchecked undoing a deletion restores the input only, which keeps the memory footprint of the undo buffer low."));
   m_recentItems->SetToolTip(_("The number of recently opened files that is to be remembered."));
+  m_maxRedrawRate->SetToolTip(
+          _("While maxima is working the worksheet is redrawn at most this often per second. Output that arrives faster is displayed in one go with the next redraw."));
+  m_outputCacheLimit->SetToolTip(
+          _("Keep bitmaps of the output of code cells so they can be redrawn by just copying them to the screen. This is the memory these bitmaps may occupy; 0 means: don't keep any bitmaps."));
   m_incrementalSearch->SetToolTip(_("Start searching while the phrase to search for is still being typed."));
   m_notifyIfIdle->SetToolTip(_("Issue a notification if maxima finishes calculating while the wxMaxima window isn't in focus."));
 
@@ -303,6 +319,7 @@ void ConfigDialogue::SetProperties()
   // configuration data for this item.
   bool savePanes = true;
   bool fixedFontTC = true, usejsmath = true, keepPercent = true, abortOnError = true, pollStdOut = false;
+  bool pipeTransport = false, warmStandby = false;
   bool enterEvaluates = false, saveUntitled = true,
           AnimateLaTeX = true, TeXExponentsAfterSubscript = false,
           usePartialForDiff = false,
@@ -373,6 +390,8 @@ void ConfigDialogue::SetProperties()
   config->Read(wxT("keepPercent"), &keepPercent);
   config->Read(wxT("abortOnError"), &abortOnError);
   config->Read(wxT("pollStdOut"), &pollStdOut);
+  config->Read(wxT("pipeTransport"), &pipeTransport);
+  config->Read(wxT("warmStandby"), &warmStandby);
   unsigned int i = 0;
   for (i = 0; i < LANGUAGE_NUMBER; i++)
     if (langs[i] == lang)
@@ -431,6 +450,10 @@ void ConfigDialogue::SetProperties()
   m_autoWrap->SetSelection(val);
   m_labelWidth->SetValue(labelWidth);
   m_undoLimit->SetValue(undoLimit);
+  m_undoMemoryLimit->SetValue(configuration->UndoMemoryLimit());
+  m_maxRedrawRate->SetValue(configuration->MaxRedrawRate());
+  m_outputCacheLimit->SetValue(configuration->OutputCacheLimit());
+  m_undoKeepsOutput->SetValue(configuration->UndoKeepsOutput());
   m_recentItems->SetValue(recentItems);
   m_bitmapScale->SetValue(bitmapScale);
   m_fixReorderedIndices->SetValue(configuration->FixReorderedIndices());
@@ -441,6 +464,10 @@ void ConfigDialogue::SetProperties()
   m_keepPercentWithSpecials->SetValue(keepPercent);
   m_abortOnError->SetValue(abortOnError);
   m_pollStdOut->SetValue(pollStdOut);
+  m_pipeTransport->SetValue(pipeTransport);
+  m_warmStandby->SetValue(warmStandby);
+  m_pipelineDepth->SetValue(configuration->PipelineDepth());
+  m_sectionKernels->SetValue(configuration->SectionKernels());
   m_restartOnReEvaluation->SetValue(configuration->RestartOnReEvaluation());
   m_defaultFramerate->SetValue(defaultFramerate);
   m_defaultPlotWidth->SetValue(defaultPlotWidth);
@@ -716,8 +743,8 @@ wxPanel *ConfigDialogue::CreateOptionsPanel()
 {
   wxPanel *panel = new wxPanel(m_notebook, -1);
 
-  wxFlexGridSizer *grid_sizer = new wxFlexGridSizer(6, 2, 5, 5);
-  wxFlexGridSizer *vsizer = new wxFlexGridSizer(18, 1, 5, 5);
+  wxFlexGridSizer *grid_sizer = new wxFlexGridSizer(9, 2, 5, 5);
+  wxFlexGridSizer *vsizer = new wxFlexGridSizer(19, 1, 5, 5);
 
   wxStaticText *lang = new wxStaticText(panel, -1, _("Language:"));
   const wxString m_language_choices[] =
@@ -771,6 +798,12 @@ wxPanel *ConfigDialogue::CreateOptionsPanel()
   grid_sizer->Add(ul, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
   grid_sizer->Add(m_undoLimit, 0, wxALL, 5);
 
+  wxStaticText *um = new wxStaticText(panel, -1, _("Undo buffer size (MB, 0 for no limit):"));
+  m_undoMemoryLimit = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 0,
+                                     16384);
+  grid_sizer->Add(um, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  grid_sizer->Add(m_undoMemoryLimit, 0, wxALL, 5);
+
   wxStaticText *rf = new wxStaticText(panel, -1, _("Recent files list length:"));
   m_recentItems = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 5, 30);
   grid_sizer->Add(rf, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
@@ -781,6 +814,18 @@ wxPanel *ConfigDialogue::CreateOptionsPanel()
                                       200);
   grid_sizer->Add(df, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
   grid_sizer->Add(m_defaultFramerate, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+
+  wxStaticText *rr = new wxStaticText(panel, -1, _("Screen updates per second during evaluation:"));
+  m_maxRedrawRate = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 1,
+                                   120);
+  grid_sizer->Add(rr, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  grid_sizer->Add(m_maxRedrawRate, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+
+  wxStaticText *oc = new wxStaticText(panel, -1, _("Memory for pre-rendered output (MB, 0 for none):"));
+  m_outputCacheLimit = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 0,
+                                      4096);
+  grid_sizer->Add(oc, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  grid_sizer->Add(m_outputCacheLimit, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
   vsizer->Add(grid_sizer, 1, wxEXPAND, 5);
 
 
@@ -811,6 +856,9 @@ wxPanel *ConfigDialogue::CreateOptionsPanel()
   m_notifyIfIdle = new wxCheckBox(panel, -1, _("Warn if an inactive window is idle"));
   vsizer->Add(m_notifyIfIdle, 0, wxALL, 5);
 
+  m_undoKeepsOutput = new wxCheckBox(panel, -1, _("Keep the output of deleted cells in the undo buffer"));
+  vsizer->Add(m_undoKeepsOutput, 0, wxALL, 5);
+
   
   vsizer->AddGrowableRow(10);
   panel->SetSizer(vsizer);
@@ -825,7 +873,7 @@ wxPanel *ConfigDialogue::CreateMaximaPanel()
 
   wxFlexGridSizer *sizer = new wxFlexGridSizer(4, 2, 0, 0);
   wxFlexGridSizer *sizer2 = new wxFlexGridSizer(6, 2, 0, 0);
-  wxFlexGridSizer *vsizer = new wxFlexGridSizer(9, 1, 0, 0);
+  wxFlexGridSizer *vsizer = new wxFlexGridSizer(13, 1, 0, 0);
 
   m_mp = new wxStaticText(panel, -1, _("Maxima program:"));
   m_maximaProgram = new wxTextCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(250, -1), wxTE_RICH);
@@ -891,6 +939,28 @@ wxPanel *ConfigDialogue::CreateMaximaPanel()
   vsizer->Add(m_pollStdOut, 0, wxALL, 5);
   panel->SetSizerAndFit(vsizer);
 
+  m_pipeTransport = new wxCheckBox(panel, -1, _("Talk to maxima via stdin and stdout instead of the network"));
+  vsizer->Add(m_pipeTransport, 0, wxALL, 5);
+
+  m_warmStandby = new wxCheckBox(panel, -1, _("Keep a second maxima ready for restarts"));
+  vsizer->Add(m_warmStandby, 0, wxALL, 5);
+
+  wxBoxSizer *pipelineSizer = new wxBoxSizer(wxHORIZONTAL);
+  wxStaticText *pd = new wxStaticText(panel, -1, _("Commands to send ahead while maxima is busy:"));
+  m_pipelineDepth = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 0,
+                                   64);
+  pipelineSizer->Add(pd, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  pipelineSizer->Add(m_pipelineDepth, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  vsizer->Add(pipelineSizer, 0, wxALL, 0);
+
+  wxBoxSizer *sectionKernelsSizer = new wxBoxSizer(wxHORIZONTAL);
+  wxStaticText *sk = new wxStaticText(panel, -1, _("Maxima processes for evaluating sections in parallel:"));
+  m_sectionKernels = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 1,
+                                    64);
+  sectionKernelsSizer->Add(sk, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  sectionKernelsSizer->Add(m_sectionKernels, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  vsizer->Add(sectionKernelsSizer, 0, wxALL, 0);
+
   m_restartOnReEvaluation = new wxCheckBox(panel, -1, _("Start a new maxima for each re-evaluation"));
   vsizer->Add(m_restartOnReEvaluation, 0, wxALL, 5);
   panel->SetSizerAndFit(vsizer);
@@ -1060,6 +1130,10 @@ void ConfigDialogue::WriteSettings()
   Configuration *configuration = m_configuration;
   config->Write(wxT("abortOnError"), m_abortOnError->GetValue());
   config->Write(wxT("pollStdOut"), m_pollStdOut->GetValue());
+  config->Write(wxT("pipeTransport"), m_pipeTransport->GetValue());
+  config->Write(wxT("warmStandby"), m_warmStandby->GetValue());
+  configuration->PipelineDepth(m_pipelineDepth->GetValue());
+  configuration->SectionKernels(m_sectionKernels->GetValue());
   configuration->RestartOnReEvaluation(m_restartOnReEvaluation->GetValue());
   if (
           (configuration->MaximaFound()) ||
@@ -1084,6 +1158,10 @@ void ConfigDialogue::WriteSettings()
   configuration->SetAutoWrap(m_autoWrap->GetSelection());
   config->Write(wxT("labelWidth"), m_labelWidth->GetValue());
   config->Write(wxT("undoLimit"), m_undoLimit->GetValue());
+  configuration->UndoMemoryLimit(m_undoMemoryLimit->GetValue());
+  configuration->MaxRedrawRate(m_maxRedrawRate->GetValue());
+  configuration->OutputCacheLimit(m_outputCacheLimit->GetValue());
+  configuration->UndoKeepsOutput(m_undoKeepsOutput->GetValue());
   config->Write(wxT("recentItems"), m_recentItems->GetValue());
   config->Write(wxT("bitmapScale"), m_bitmapScale->GetValue());
   configuration->FixReorderedIndices(m_fixReorderedIndices->GetValue());
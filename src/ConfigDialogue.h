@@ -220,6 +220,11 @@ protected:
   wxCheckBox *m_saveSize;
   wxCheckBox *m_abortOnError;
   wxCheckBox *m_pollStdOut;
+  //! Talk to maxima via its stdin and stdout instead of a network socket?
+  wxCheckBox *m_pipeTransport;
+  wxCheckBox *m_warmStandby;
+  wxSpinCtrl *m_pipelineDepth;
+  wxSpinCtrl *m_sectionKernels;
   wxCheckBox *m_restartOnReEvaluation;
   wxCheckBox *m_wrapLatexMath;
   wxCheckBox *m_savePanes;
@@ -252,6 +257,10 @@ protected:
   wxChoice *m_autoWrap;
   wxSpinCtrl *m_labelWidth;
   wxSpinCtrl *m_undoLimit;
+  wxSpinCtrl *m_undoMemoryLimit;
+  wxSpinCtrl *m_maxRedrawRate;
+  wxSpinCtrl *m_outputCacheLimit;
+  wxCheckBox *m_undoKeepsOutput;
   wxSpinCtrl *m_recentItems;
   wxSpinCtrl *m_bitmapScale;
   wxCheckBox *m_fixReorderedIndices;
@@ -32,6 +32,7 @@
 Configuration::Configuration(wxDC &dc, bool isTopLevel) : m_dc(&dc) 
 {
   m_antialiassingDC = m_dc;
+  m_ppi = dc.GetPPI();
   m_parenthesisDrawMode = unknown;
   m_mathJaxURL = wxT("https://cdnjs.cloudflare.com/ajax/libs/mathjax/2.7.0/MathJax.js?config=TeX-AMS_HTML");
   m_scale = 1.0;
@@ -40,7 +41,9 @@ Configuration::Configuration(wxDC &dc, bool isTopLevel) : m_dc(&dc)
   m_bottom = -1;
   m_changeAsterisk = true;
   m_forceUpdate = false;
+  m_lazyLayout = isTopLevel;
   m_outdated = false;
+  m_styleVersion = 0;
   m_printer = false;
   m_TeXFonts = false;
   m_printer = false;
@@ -114,6 +117,26 @@ void Configuration::ReadConfig()
   config->Read(wxT("copyRTF"), &m_copyRTF);
   config->Read(wxT("copySVG"), &m_copySVG );
 
+  m_undoMemoryLimit = 256;
+  config->Read(wxT("undoMemoryLimit"), &m_undoMemoryLimit);
+  m_undoKeepsOutput = true;
+  config->Read(wxT("undoKeepsOutput"), &m_undoKeepsOutput);
+  m_maxRedrawRate = 30;
+  config->Read(wxT("maxRedrawRate"), &m_maxRedrawRate);
+  if(m_maxRedrawRate < 1)
+    m_maxRedrawRate = 1;
+  m_outputCacheLimit = 64;
+  config->Read(wxT("outputCacheLimit"), &m_outputCacheLimit);
+  m_pipelineDepth = 0;
+  config->Read(wxT("pipelineDepth"), &m_pipelineDepth);
+  if(m_pipelineDepth < 0)
+    m_pipelineDepth = 0;
+  // Leave one core to the maxima that evaluates everything else.
+  m_sectionKernels = wxThread::GetCPUCount() - 1;
+  config->Read(wxT("sectionKernels"), &m_sectionKernels);
+  if(m_sectionKernels < 1)
+    m_sectionKernels = 1;
+
   config->Read(wxT("maxima"), &m_maximaLocation);
   // Fix wrong" maxima=1" paraneter in ~/.wxMaxima if upgrading from 0.7.0a
   if (m_maximaLocation.IsSameAs(wxT("1")))
@@ -309,6 +332,17 @@ Configuration::~Configuration()
 {
 }
 
+void Configuration::SetContext(wxDC &dc)
+{
+  m_dc = &dc;
+  wxSize ppi = dc.GetPPI();
+  if (ppi != m_ppi)
+  {
+    m_ppi = ppi;
+    m_textExtents.Clear();
+  }
+}
+
 bool Configuration::CharsExistInFont(wxFont font, wxString char1,wxString char2, wxString char3)
 {
   // Letters with width or height = 0 don't exist in the current font
@@ -373,8 +407,13 @@ wxString Configuration::GetFontName(int type)
 void Configuration::ReadStyle()
 {
   m_parenthesisDrawMode = unknown;
+  m_styleVersion++;
   wxConfigBase *config = wxConfig::Get();
 
+  wxString bgColStr = wxT("white");
+  config->Read(wxT("Style/Background/color"), &bgColStr);
+  m_defaultBackgroundColor = wxColour(bgColStr);
+
 
   #ifdef __WXMSW__
   wxFont font;
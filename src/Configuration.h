@@ -28,6 +28,7 @@
 #include "TextStyle.h"
 #include "Dirstructure.h"
 #include "Setup.h"
+#include "TextExtentCache.h"
 
 
 #define MC_CELL_SKIP 0
@@ -115,8 +116,7 @@ public:
   Configuration(wxDC &dc, bool isTopLevel = false);
 
   //! Set the drawing context that is currently active
-  void SetContext(wxDC &dc)
-  { m_dc = &dc; }
+  void SetContext(wxDC &dc);
 
   void SetAntialiassingDC(wxDC &antialiassingDC)
     {m_antialiassingDC = &antialiassingDC;}
@@ -182,6 +182,14 @@ public:
   wxDC &GetDC()
   { return *m_dc; }
 
+  /*! Determine the size of a text in the font the drawing context currently uses
+
+    Only asks the drawing context if this text hasn't been measured in this
+    font before.
+   */
+  void GetTextExtent(const wxString &text, wxCoord *width, wxCoord *height)
+  { m_textExtents.GetTextExtent(*m_dc, text, width, height); }
+
   //! Get a drawing context suitable for size calculations
   wxDC &GetAntialiassingDC()
     {
@@ -231,6 +239,16 @@ public:
     return m_forceUpdate;
   }
 
+  /*! May cells lay out the parts of themselves that aren't visible only once they are drawn?
+
+    Only true for the worksheet on the screen: Printouts and exported images need
+    to know their full size in advance.
+   */
+  bool LazyLayout()
+  {
+    return m_lazyLayout;
+  }
+
   wxFontEncoding GetFontEncoding()
   {
     return m_fontEncoding;
@@ -370,6 +388,22 @@ public:
   void Outdated(bool outdated)
   { m_outdated = outdated; }
 
+  //! Are we currently drawing output that is outdated?
+  bool Outdated()
+  { return m_outdated; }
+
+  /*! A number that changes every time the styles are read from the config
+
+    Allows cached renderings to find out if they have been drawn using 
+    outdated styles.
+   */
+  long StyleVersion()
+  { return m_styleVersion; }
+
+  //! The background colour of the worksheet
+  wxColour DefaultBackgroundColor()
+  { return m_defaultBackgroundColor; }
+
   bool CheckTeXFonts()
   { return m_TeXFonts; }
 
@@ -573,6 +607,101 @@ public:
     }
   int ShowLength(){return m_showLength;}
 
+  /*! The maximum length [in characters of xml] of an expression that is displayed at once
+
+    Longer expressions are displayed collapsed. 0 means: No limit.
+   */
+  long ShowLengthChars()
+    {
+      switch (m_showLength)
+      {
+      case 0:
+        return 50000;
+      case 1:
+        return 500000;
+      case 2:
+        return 5000000;
+      case 3:
+        return 0;
+      default:
+        return 50000;
+      }
+    }
+
+  /*! The memory budget for the undo buffer [in megabytes]
+
+    If the undo buffer grows larger than this the oldest undo actions are
+    discarded. 0 means: No limit.
+   */
+  long UndoMemoryLimit(){return m_undoMemoryLimit;}
+  void UndoMemoryLimit(long limit)
+    {
+      wxConfig::Get()->Write(wxT("undoMemoryLimit"), m_undoMemoryLimit = limit);
+    }
+
+  /*! Keep the output of deleted cells in the undo buffer?
+
+    The output of a code cell can always be regenerated by evaluating the
+    cell again. Dropping it keeps the undo buffer small.
+   */
+  bool UndoKeepsOutput(){return m_undoKeepsOutput;}
+  void UndoKeepsOutput(bool keep)
+    {
+      wxConfig::Get()->Write(wxT("undoKeepsOutput"), m_undoKeepsOutput = keep);
+    }
+
+  /*! The maximum number of times per second the worksheet is redrawn while maxima is working
+
+    Output that arrives faster than this is collected and displayed in one go
+    with the next redraw.
+   */
+  long MaxRedrawRate(){return m_maxRedrawRate;}
+  void MaxRedrawRate(long rate)
+    {
+      if(rate < 1)
+        rate = 1;
+      wxConfig::Get()->Write(wxT("maxRedrawRate"), m_maxRedrawRate = rate);
+    }
+
+  /*! The memory budget for the bitmaps of the output of GroupCells [in megabytes]
+
+    GroupCell::Draw() keeps a bitmap of the output of code cells in order to be
+    able to redraw them by just copying the bitmap. If the bitmaps grow larger 
+    than this the least recently used ones are discarded. 0 means: Don't keep
+    any bitmaps.
+   */
+  long OutputCacheLimit(){return m_outputCacheLimit;}
+  void OutputCacheLimit(long limit)
+    {
+      wxConfig::Get()->Write(wxT("outputCacheLimit"), m_outputCacheLimit = limit);
+    }
+
+  /*! How many commands from the evaluation queue may be sent to maxima ahead of time
+
+    Normally the next command is sent to maxima only after maxima has sent the
+    prompt that tells that it has finished the current one. Sending commands
+    ahead saves a round-trip per command. 0 means: Wait for each prompt.
+   */
+  long PipelineDepth(){return m_pipelineDepth;}
+  void PipelineDepth(long depth)
+    {
+      if(depth < 0)
+        depth = 0;
+      wxConfig::Get()->Write(wxT("pipelineDepth"), m_pipelineDepth = depth);
+    }
+
+  /*! How many additional maxima processes may evaluate sections in parallel
+
+    See wxMaxima::EvaluateSectionsInParallel().
+   */
+  long SectionKernels(){return m_sectionKernels;}
+  void SectionKernels(long kernels)
+    {
+      if(kernels < 1)
+        kernels = 1;
+      wxConfig::Get()->Write(wxT("sectionKernels"), m_sectionKernels = kernels);
+    }
+
   //! Sets the default toolTip for new cells
   void SetDefaultMathCellToolTip(wxString defaultToolTip){m_defaultToolTip = defaultToolTip;}
   //! Gets the default toolTip for new cells
@@ -644,12 +773,16 @@ private:
   double m_scale;
   double m_zoomFactor;
   wxDC *m_dc;
+  //! The resolution of m_dc: The measured text sizes are only valid for this resolution
+  wxSize m_ppi;
+  TextExtentCache m_textExtents;
   wxDC *m_antialiassingDC;
   int m_top, m_bottom;
   wxString m_fontName;
   int m_defaultFontSize, m_mathFontSize;
   wxString m_mathFontName;
   bool m_forceUpdate;
+  bool m_lazyLayout;
   bool m_outdated;
   wxString m_defaultToolTip;
   bool m_TeXFonts;
@@ -672,6 +805,14 @@ private:
   int m_showLength;
   bool m_copyRTF;
   bool m_copySVG;
+  long m_undoMemoryLimit;
+  bool m_undoKeepsOutput;
+  long m_maxRedrawRate;
+  long m_outputCacheLimit;
+  long m_pipelineDepth;
+  long m_sectionKernels;
+  long m_styleVersion;
+  wxColour m_defaultBackgroundColor;
 };
 
 #endif // CONFIGURATION_H
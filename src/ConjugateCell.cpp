@@ -82,6 +82,12 @@ void ConjugateCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t ConjugateCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_innerCell, m_open, m_close);
+}
+
 void ConjugateCell::SetInner(MathCell *inner)
 {
   if (inner == NULL)
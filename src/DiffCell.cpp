@@ -72,6 +72,12 @@ void DiffCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t DiffCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_baseCell, m_diffCell);
+}
+
 void DiffCell::SetDiff(MathCell *diff)
 {
   if (diff == NULL)
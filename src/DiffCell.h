@@ -34,6 +34,8 @@ public:
   
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   virtual wxString GetToolTip(const wxPoint &point){
     if(ContainsPoint(point))
       {
@@ -82,6 +82,10 @@ public:
   wxString AutocompleteFile()
   { return DataDir() + wxT("/autocomplete.txt"); }
 
+  //! The directory the compiled versions of wxmathml.lisp are cached in
+  wxString LispCacheDir()
+  { return wxStandardPaths::Get().GetUserDataDir() + wxT("/lispcache"); }
+
   //! The directory art is stored relative to
   wxString ArtDir();
 
@@ -239,6 +239,14 @@ void EditorCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t EditorCell::SizeInMemory()
+{
+  size_t size = MathCell::SizeInMemory() + m_text.Length() * sizeof(wxChar);
+  for (size_t i = 0; i < m_textHistory.GetCount(); i++)
+    size += m_textHistory[i].Length() * sizeof(wxChar);
+  return size;
+}
+
 wxString EditorCell::ToTeX()
 {
   wxString text = m_text;
@@ -420,13 +428,12 @@ void EditorCell::RecalculateWidths(int fontsize)
   {
     ResetData();
     m_fontSize_Last = Scale_Px(fontsize,scale);
-    wxDC &dc = configuration->GetDC();
     double scale = configuration->GetScale();
     SetFont();
 
     // Measure the text hight using characters that might extend below or above the region
     // ordinary characters move in.
-    dc.GetTextExtent(wxT("äXÄgy"), &charWidth, &m_charHeight);
+    configuration->GetTextExtent(wxT("äXÄgy"), &charWidth, &m_charHeight);
 
     // We want a little bit of vertical space between two text lines (and between two labels).
     m_charHeight += 2 * Scale_Px(MC_TEXT_PADDING, scale);
@@ -449,7 +456,7 @@ void EditorCell::RecalculateWidths(int fontsize)
       }
       else
       {
-        dc.GetTextExtent(textSnippet->GetText(), &tokenwidth, &tokenheight);
+        configuration->GetTextExtent(textSnippet->GetText(), &tokenwidth, &tokenheight);
         linewidth += tokenwidth;
         width = MAX(width, linewidth);
       }
@@ -3523,7 +3530,7 @@ void EditorCell::HandleSoftLineBreaks_Code(StyledText *&lastSpace, int &lineWidt
   //  Does the line extend too much to the right to fit on the screen /
   //   // to be easy to read?
   Configuration *configuration = (*m_configuration);
-  configuration->GetDC().GetTextExtent(token, &width, &height);
+  configuration->GetTextExtent(token, &width, &height);
   lineWidth += width;
 
   // Normally the cell begins at the x position m_currentPoint.x - but sometimes
@@ -3537,7 +3544,7 @@ void EditorCell::HandleSoftLineBreaks_Code(StyledText *&lastSpace, int &lineWidt
           (lastSpace != NULL) && (lastSpace->GetText() != "\r"))
   {
     int charWidth;
-    configuration->GetDC().GetTextExtent(wxT(" "), &charWidth, &height);
+    configuration->GetTextExtent(wxT(" "), &charWidth, &height);
     indentationPixels = charWidth * GetIndentDepth(m_text, lastSpacePos);
     lineWidth = width + indentationPixels;
     lastSpace->SetText("\r");
@@ -3658,7 +3665,7 @@ void EditorCell::StyleTextCode()
         m_styledText.push_back(StyledText(token));
         spaceIsIndentation = true;
         int charWidth, height;
-        configuration->GetDC().GetTextExtent(wxT(" "), &charWidth, &height);
+        configuration->GetTextExtent(wxT(" "), &charWidth, &height);
         indentationPixels = charWidth * GetIndentDepth(m_text, pos);
         continue;
       }
@@ -190,6 +190,8 @@ public:
    */
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   /*! Expand all tabulators.
 
     \param input The string the tabulators should be expanded in
@@ -27,6 +27,7 @@
 */
 
 #include "EvaluationQueue.h"
+#include <iterator>
 
 bool EvaluationQueue::Empty()
 {
@@ -36,11 +37,13 @@ bool EvaluationQueue::Empty()
 EvaluationQueue::EvaluationQueue()
 {
   m_size = 0;
+  m_generation = 0;
   m_workingGroupChanged = false;
 }
 
 void EvaluationQueue::Clear()
 {
+  m_generation++;
   while (!Empty())
     RemoveFirst();
   m_size = 0;
@@ -59,13 +62,16 @@ bool EvaluationQueue::IsInQueue(GroupCell *gr)
 
 void EvaluationQueue::Remove(GroupCell *gr)
 {
-  bool removeFirst = (gr == m_queue.front());
+  bool removeFirst = (!m_queue.empty()) && (gr == m_queue.front());
   m_queue.remove(gr);
   if(removeFirst)
   {
     m_commands.clear();
     if(!m_queue.empty())
-      AddTokens(gr);
+    {
+      AddTokens(GetCell());
+      m_workingGroupChanged = true;
+    }
   }
   m_size = m_queue.size();
 }
@@ -134,12 +140,19 @@ void EvaluationQueue::AddTokens(GroupCell *cell)
 {
   if(cell == NULL)
     return;
-  
-  wxString commandString = cell->GetEditable()->GetValue();
-  size_t index = 0;
 
   m_knownAnswers = cell->m_knownAnswers;
 
+  std::list<EvaluationQueue::command> tokens = Tokenize(cell);
+  m_commands.splice(m_commands.end(), tokens);
+}
+
+std::list<EvaluationQueue::command> EvaluationQueue::Tokenize(GroupCell *cell)
+{
+  std::list<EvaluationQueue::command> commands;
+  wxString commandString = cell->GetEditable()->GetValue();
+  size_t index = 0;
+
   wxString token;
 
   while (index < commandString.Length())
@@ -232,7 +245,7 @@ void EvaluationQueue::AddTokens(GroupCell *cell)
       token.Trim(false);
       token.Trim(true);
       if (token.Length() > 1)
-        m_commands.push_back(command(token, index));
+        commands.push_back(command(token, index));
       token = wxEmptyString;
     }
   }
@@ -242,7 +255,42 @@ void EvaluationQueue::AddTokens(GroupCell *cell)
   token.Trim(false);
   token.Trim(true);
   if (token.Length() > 1)
-    m_commands.push_back(command(token, index));
+    commands.push_back(command(token, index));
+  return commands;
+}
+
+bool EvaluationQueue::GetCommandAhead(size_t n, GroupCell *&cell, wxString &cmd)
+{
+  if (m_queue.empty())
+    return false;
+
+  // The commands of the current cell have already been split up.
+  std::list<GroupCell *>::iterator group = m_queue.begin();
+  if (n < m_commands.size())
+  {
+    std::list<EvaluationQueue::command>::iterator it = m_commands.begin();
+    std::advance(it, n);
+    cell = *group;
+    cmd = it->GetString();
+    return true;
+  }
+  n -= m_commands.size();
+
+  // The commands of the cells behind it haven't.
+  for (++group; group != m_queue.end(); ++group)
+  {
+    std::list<EvaluationQueue::command> commands = Tokenize(*group);
+    if (n < commands.size())
+    {
+      std::list<EvaluationQueue::command>::iterator it = commands.begin();
+      std::advance(it, n);
+      cell = *group;
+      cmd = it->GetString();
+      return true;
+    }
+    n -= commands.size();
+  }
+  return false;
 }
 
 GroupCell *EvaluationQueue::GetCell()
@@ -67,6 +67,12 @@ private:
   //! Adds all commands in commandString as separate tokens to the queue.
   void AddTokens(GroupCell *cell);
 
+  //! Splits the contents of a cell into commands
+  std::list<EvaluationQueue::command> Tokenize(GroupCell *cell);
+
+  //! Is incremented every time the queue is cleared, see Generation().
+  long m_generation;
+
   //! A list of answers provided by the user
   std::list<wxString> m_knownAnswers;
 
@@ -152,6 +158,24 @@ public:
       return wxEmptyString;
   }
 
+  /*! Looks up a command that is still waiting behind the current one
+
+    \param n The number of the command: 0 is the current command, 1 the one
+              after it...
+    \param cell Is set to the cell the command belongs to
+    \param cmd Is set to the command
+    \return false, if the queue contains less commands.
+   */
+  bool GetCommandAhead(size_t n, GroupCell *&cell, wxString &cmd);
+
+  /*! A number that changes every time the queue is cleared
+
+    Allows to find out if a command that was sent to maxima ahead of time
+    still is part of the queue.
+   */
+  long Generation()
+  { return m_generation; }
+
   //! Get the size of the queue [in cells]
   int Size()
   {
@@ -89,6 +89,12 @@ void ExptCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t ExptCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_baseCell, m_powCell, m_exp, m_open, m_close);
+}
+
 void ExptCell::SetPower(MathCell *power)
 {
   if (power == NULL)
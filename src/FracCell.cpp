@@ -106,6 +106,12 @@ void FracCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t FracCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_open1, m_open2, m_close1, m_close2, m_num, m_denom, m_divide);
+}
+
 void FracCell::SetNum(MathCell *num)
 {
   if (num == NULL)
@@ -142,14 +148,14 @@ void FracCell::RecalculateWidths(int fontsize)
   {
     m_protrusion = 0;
     int height;
-    dc.GetTextExtent(wxT("/"), &m_expDivideWidth, &height);
+    configuration->GetTextExtent(wxT("/"), &m_expDivideWidth, &height);
     m_width = m_num->GetFullWidth(scale) + m_denom->GetFullWidth(scale) + m_expDivideWidth;
   }
   else
   {
     int dummy;
 
-    dc.GetTextExtent(wxT("X"), &m_protrusion, &dummy);
+    configuration->GetTextExtent(wxT("X"), &m_protrusion, &dummy);
     m_protrusion /= 3;
     
     // We want half a space's widh of blank space to separate us from the
@@ -71,6 +71,12 @@ void FunCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t FunCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_nameCell, m_argCell);
+}
+
 void FunCell::SetName(MathCell *name)
 {
   if (name == NULL)
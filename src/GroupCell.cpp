@@ -30,6 +30,7 @@
 
 #include <wx/config.h>
 #include <wx/clipbrd.h>
+#include <wx/dcgraph.h>
 #include "MarkDown.h"
 #include "GroupCell.h"
 #include "SlideShowCell.h"
@@ -62,8 +63,13 @@ GroupCell::GroupCell(Configuration **config, int groupType, CellPointers *cellPo
   m_type = MC_TYPE_GROUP;
   m_hide = false;
   m_groupType = groupType;
+  m_evaluationSession = -1;
   m_lastInOutput = NULL;
   m_appendedCells = NULL;
+  m_outputCacheZoom = -1;
+  m_outputCacheStyleVersion = -1;
+  m_outputCacheOutdated = false;
+  m_outputLaidOutLazily = false;
 
   // set up cell depending on groupType, so we have a working cell
   if (groupType != GC_TYPE_PAGEBREAK)
@@ -317,6 +323,7 @@ GroupCell::~GroupCell()
 
 void GroupCell::MarkAsDeleted()
 {
+  ClearOutputCache();
   if(this == m_cellPointers->m_selectionStart)
     m_cellPointers->m_selectionStart = NULL;
   if(this == m_cellPointers->m_selectionEnd)
@@ -341,6 +348,12 @@ void GroupCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t GroupCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_inputLabel, m_output, m_hiddenTree);
+}
+
 wxString GroupCell::TexEscapeOutputCell(wxString Input)
 {
   wxString retval(Input);
@@ -391,6 +404,7 @@ void GroupCell::SetOutput(MathCell *output)
     m_cellPointers->m_answerCell = NULL;
   
   wxDELETE(m_output);
+  ClearOutputCache();
 
   m_output = output;
   m_output->SetParent(this);
@@ -420,6 +434,7 @@ void GroupCell::RemoveOutput()
   }
 
   m_cellPointers->m_errorList.Remove(this);
+  ClearOutputCache();
   // Calculate the new cell height.
 
   ResetSize();
@@ -427,10 +442,48 @@ void GroupCell::RemoveOutput()
   m_hide = false;
 }
 
+void GroupCell::ReplaceOutputCell(MathCell *oldCell, MathCell *newCells)
+{
+  if ((oldCell == NULL) || (newCells == NULL))
+    return;
+
+  newCells->SetParentList(this);
+  MathCell *last = newCells;
+  while (last->m_next != NULL)
+    last = last->m_next;
+
+  MathCell *previous = oldCell->m_previous;
+  MathCell *next = oldCell->m_next;
+  newCells->m_previous = previous;
+  if (previous != NULL)
+    previous->m_next = newCells;
+  else
+    m_output = newCells;
+  last->m_next = next;
+  if (next != NULL)
+    next->m_previous = last;
+
+  if (m_lastInOutput == oldCell)
+    m_lastInOutput = last;
+  if (m_appendedCells == oldCell)
+    m_appendedCells = NULL;
+
+  // Delete only oldCell, not the rest of the list it was part of.
+  oldCell->m_previous = oldCell->m_next = NULL;
+  wxDELETE(oldCell);
+
+  // The order the cells are drawn in has changed.
+  m_output->UnbreakList();
+  ClearOutputCache();
+  ResetSize();
+  ResetData();
+}
+
 void GroupCell::AppendOutput(MathCell *cell)
 {
   wxASSERT_MSG(cell != NULL, _("Bug: Trying to append NULL to a group cell."));
   if (cell == NULL) return;
+  ClearOutputCache();
   cell->SetParentList(this);
   if (m_output == NULL)
   {
@@ -515,6 +568,7 @@ void GroupCell::RecalculateWidths(int fontsize)
     }
     else
     {
+      m_outputLaidOutLazily = false;
       MathCell *tmp = m_output;
       while (tmp != NULL)
       {
@@ -819,8 +873,6 @@ void GroupCell::Draw(wxPoint point, int fontsize)
 
       if (m_output != NULL && !m_hide)
       {
-        MathCell *tmp = m_output;
-        int drop = tmp->GetMaxDrop();
         if ((configuration->ShowCodeCells()) ||
             (m_groupType != GC_TYPE_CODE))
         {
@@ -830,55 +882,191 @@ void GroupCell::Draw(wxPoint point, int fontsize)
         m_outputRect.y = in.y - m_output->GetMaxCenter();
         m_outputRect.x = in.x;
 
-        while (tmp != NULL)
-        {
-
+        if (!DrawOutputFromCache(in))
+          DrawOutput(in);
+      }
+    }
+    configuration->Outdated(false); 
+    UnsetPen();
+  }
+}
 
-          if (tmp->BreakLineHere())
-          {
-            if (tmp->m_bigSkip)
-              in.y += MC_LINE_SKIP;
-          
-            if (tmp->m_previousToDraw != NULL &&
-                tmp->GetStyle() == TS_LABEL)
-              in.y += configuration->GetInterEquationSkip();
-          }
-        
-          tmp->m_currentPoint = in;
-        
-          if (!tmp->m_isBroken)
-          {
-            if (tmp->DrawThisCell(in))
-              tmp->Draw(in, MAX(tmp->IsMath() ? m_mathFontSize : m_fontSize, MC_MIN_SIZE));
-            if (tmp->m_nextToDraw != NULL)
-            {
-              if (tmp->m_nextToDraw->BreakLineHere())
-              {
-                in.x = configuration->GetIndent();
-                in.y += drop + tmp->m_nextToDraw->GetMaxCenter();
-                drop = tmp->m_nextToDraw->GetMaxDrop();
-              }
-              else
-                in.x += (tmp->GetWidth() + MC_CELL_SKIP);
-            }
+void GroupCell::DrawOutput(wxPoint in, bool draw)
+{
+  Configuration *configuration = (*m_configuration);
+  MathCell *tmp = m_output;
+  int drop = tmp->GetMaxDrop();
 
-          }
-          else
-          {
-            if (tmp->m_nextToDraw != NULL && tmp->m_nextToDraw->BreakLineHere())
-            {
-              in.x = configuration->GetIndent();
-              in.y += drop + tmp->m_nextToDraw->GetMaxCenter();
-              drop = tmp->m_nextToDraw->GetMaxDrop();
-            }
-          }
-          tmp = tmp->m_nextToDraw;
+  while (tmp != NULL)
+  {
+    if (tmp->BreakLineHere())
+    {
+      if (tmp->m_bigSkip)
+        in.y += MC_LINE_SKIP;
+      
+      if (tmp->m_previousToDraw != NULL &&
+          tmp->GetStyle() == TS_LABEL)
+        in.y += configuration->GetInterEquationSkip();
+    }
+    
+    tmp->m_currentPoint = in;
+    
+    if (!tmp->m_isBroken)
+    {
+      if ((draw) && (tmp->DrawThisCell(in)))
+        tmp->Draw(in, MAX(tmp->IsMath() ? m_mathFontSize : m_fontSize, MC_MIN_SIZE));
+      if (tmp->m_nextToDraw != NULL)
+      {
+        if (tmp->m_nextToDraw->BreakLineHere())
+        {
+          in.x = configuration->GetIndent();
+          in.y += drop + tmp->m_nextToDraw->GetMaxCenter();
+          drop = tmp->m_nextToDraw->GetMaxDrop();
         }
+        else
+          in.x += (tmp->GetWidth() + MC_CELL_SKIP);
       }
+      
     }
-    configuration->Outdated(false); 
-    UnsetPen();
+    else
+    {
+      if (tmp->m_nextToDraw != NULL && tmp->m_nextToDraw->BreakLineHere())
+      {
+        in.x = configuration->GetIndent();
+        in.y += drop + tmp->m_nextToDraw->GetMaxCenter();
+        drop = tmp->m_nextToDraw->GetMaxDrop();
+      }
+    }
+    tmp = tmp->m_nextToDraw;
+  }
+}
+
+bool GroupCell::DrawOutputFromCache(wxPoint in)
+{
+  Configuration *configuration = (*m_configuration);
+
+  size_t limit = (size_t) configuration->OutputCacheLimit() * 1024 * 1024;
+  if (limit == 0)
+  {
+    ClearOutputCache();
+    return false;
+  }
+  if ((MathCell::Printing()) || (configuration->GetPrinter()) || (m_groupType != GC_TYPE_CODE))
+    return false;
+
+  // The output of the cell maxima currently works on changes all the time.
+  if (m_cellPointers->GetWorkingGroup() == this)
+    return false;
+
+  // Rendering all of the output would lay out the parts that aren't visible, too.
+  if (m_outputLaidOutLazily)
+  {
+    ClearOutputCache();
+    return false;
+  }
+
+  // Selected output is highlighted by drawing a marker below it. Images and
+  // animations already are bitmaps.
+  if ((m_cellPointers->m_selectionStart != NULL) &&
+      (m_cellPointers->m_selectionStart->GetParent() == this))
+    return false;
+  for (MathCell *tmp = m_output; tmp != NULL; tmp = tmp->m_next)
+    if ((tmp->GetType() == MC_TYPE_IMAGE) || (tmp->GetType() == MC_TYPE_SLIDE))
+      return false;
+
+  // The area the output can draw to. The space between two GroupCells is
+  // left untouched as it belongs to the horizontal cursor.
+  int margin = configuration->GetGroupSkip() / 2;
+  wxRect rect(m_outputRect.x, m_outputRect.y - margin,
+              MAX(configuration->GetCanvasSize().GetWidth() - m_outputRect.x, m_outputRect.width),
+              m_outputRect.height + 2 * margin);
+  if ((rect.GetWidth() <= 0) || (rect.GetHeight() <= 0))
+    return false;
+
+  // Bitmaps of very long output would push everything else out of the cache.
+  size_t size = (size_t) rect.GetWidth() * rect.GetHeight() * 4;
+  if (size > limit / 4)
+  {
+    ClearOutputCache();
+    return false;
+  }
+
+  if ((!m_outputCache.IsOk()) ||
+      (m_outputCacheRect != rect) ||
+      (m_outputCacheZoom != configuration->GetZoomFactor()) ||
+      (m_outputCacheStyleVersion != configuration->StyleVersion()) ||
+      (m_outputCacheOutdated != configuration->Outdated()))
+  {
+    ClearOutputCache();
+
+    wxBitmap bitmap(rect.GetWidth(), rect.GetHeight());
+    {
+      wxMemoryDC dc(bitmap);
+      dc.SetBackground(*(wxTheBrushList->FindOrCreateBrush(configuration->DefaultBackgroundColor(),
+                                                           wxBRUSHSTYLE_SOLID)));
+      dc.Clear();
+      dc.SetMapMode(wxMM_TEXT);
+      dc.SetBackgroundMode(wxTRANSPARENT);
+      dc.SetDeviceOrigin(-rect.GetLeft(), -rect.GetTop());
+      wxGCDC antialiassingDC(dc);
+      antialiassingDC.SetDeviceOrigin(-rect.GetLeft(), -rect.GetTop());
+
+      // Render the whole output, not only the part of it that currently is visible.
+      wxDC &oldDC = configuration->GetDC();
+      wxDC &oldAntialiassingDC = configuration->GetAntialiassingDC();
+      int top = configuration->GetTop();
+      int bottom = configuration->GetBottom();
+      configuration->SetContext(dc);
+      configuration->SetAntialiassingDC(antialiassingDC);
+      configuration->SetBounds(-1, -1);
+      wxRect updateRegion = MathCell::GetUpdateRegion();
+      MathCell::SetUpdateRegion(rect);
+      SetPen();
+
+      DrawOutput(in);
+
+      MathCell::SetUpdateRegion(updateRegion);
+      configuration->SetContext(oldDC);
+      configuration->SetAntialiassingDC(oldAntialiassingDC);
+      configuration->SetBounds(top, bottom);
+      SetPen();
+      dc.SelectObject(wxNullBitmap);
+    }
+
+    m_outputCache = bitmap;
+    m_outputCacheRect = rect;
+    m_outputCacheZoom = configuration->GetZoomFactor();
+    m_outputCacheStyleVersion = configuration->StyleVersion();
+    m_outputCacheOutdated = configuration->Outdated();
+    m_cellPointers->m_outputCacheSize += size;
+    m_cellPointers->m_outputCaches.push_back(this);
+
+    // Discard the bitmaps that haven't been drawn for the longest time.
+    while ((m_cellPointers->m_outputCacheSize > limit) &&
+           (m_cellPointers->m_outputCaches.front() != this))
+      dynamic_cast<GroupCell *>(m_cellPointers->m_outputCaches.front())->ClearOutputCache();
+  }
+  else
+  {
+    // The cells still need to know where they are on the screen.
+    DrawOutput(in, false);
+    m_cellPointers->m_outputCaches.remove(this);
+    m_cellPointers->m_outputCaches.push_back(this);
   }
+
+  configuration->GetDC().DrawBitmap(m_outputCache, rect.GetLeft(), rect.GetTop());
+  return true;
+}
+
+void GroupCell::ClearOutputCache()
+{
+  if (!m_outputCache.IsOk())
+    return;
+
+  m_cellPointers->m_outputCacheSize -=
+          (size_t) m_outputCache.GetWidth() * m_outputCache.GetHeight() * 4;
+  m_cellPointers->m_outputCaches.remove(this);
+  m_outputCache = wxNullBitmap;
 }
 
 void GroupCell::CellUnderPointer(GroupCell *cell)
@@ -89,6 +89,8 @@ public:
    */
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   /*! Which GroupCell was the last maxima was working on?
 
     Must be kept in GroupCell as on deletion a GroupCell will unlink itself from 
@@ -145,6 +147,12 @@ public:
   */
   void RemoveOutput();
 
+  /*! Replaces a cell of the output by a list of cells
+
+    Deletes oldCell.
+   */
+  void ReplaceOutputCell(MathCell *oldCell, MathCell *newCells);
+
   wxString ToTeX(wxString imgDir, wxString filename, int *imgCounter);
 
   /*! Convert the current cell to its wxm representation.
@@ -204,6 +212,10 @@ public:
   MathCell *GetOutput()
   { if (m_output == NULL) return NULL; else return m_output->m_next; }
 
+  //! Returns the last cell of the output. NULL if there is no output.
+  MathCell *GetLastOutput()
+  { if (m_output == NULL) return NULL; else return m_lastInOutput; }
+
   //
   wxRect GetOutputRect()
   { return m_outputRect; }
@@ -347,6 +359,22 @@ public:
   //! Draw the bracket of this cell
   void DrawBracket();
 
+  /*! Discard the bitmap of our output Draw() keeps
+
+    Needs to be called whenever the output changes in a way that doesn't change
+    its size.
+   */
+  void ClearOutputCache();
+
+  /*! Tells that a cell of our output lays out its parts only once they are drawn
+
+    A bitmap of the whole output would make it lay out all of them, see
+    MatrCell::LayOutRows() => the output isn't drawn from a bitmap until it
+    is laid out again.
+   */
+  void OutputLaidOutLazily()
+  { m_outputLaidOutLazily = true; }
+
   //! Is this list of cells empty?
   bool Empty();
 
@@ -371,7 +399,43 @@ public:
 
   //! A list of answers provided by the user
   std::list<wxString> m_knownAnswers;
+
+  /*! Remember what has been sent to maxima from this cell
+
+    \param session The maxima process the cell has been evaluated in
+    \param input The contents of the cell
+    \param defined The symbols the cell defines
+    \param used The symbols the cell uses
+   */
+  void Evaluated(long session, wxString input, wxArrayString defined, wxArrayString used)
+  {
+    m_evaluationSession = session;
+    m_evaluatedInput = input;
+    m_definedSymbols = defined;
+    m_usedSymbols = used;
+  }
+
+  //! Has the cell been edited since it has been evaluated in the maxima process session?
+  bool ChangedSinceEvaluation(long session, wxString input)
+  { return (session != m_evaluationSession) || (input != m_evaluatedInput); }
+
+  //! The symbols this cell defined the last time it was evaluated
+  wxArrayString GetDefinedSymbols()
+  { return m_definedSymbols; }
+
+  //! The symbols this cell used the last time it was evaluated
+  wxArrayString GetUsedSymbols()
+  { return m_usedSymbols; }
+
 protected:
+  //! The maxima process this cell has been evaluated in, -1 = none.
+  long m_evaluationSession;
+  //! The contents of this cell the last time it was evaluated
+  wxString m_evaluatedInput;
+  //! The symbols this cell defined the last time it was evaluated
+  wxArrayString m_definedSymbols;
+  //! The symbols this cell used the last time it was evaluated
+  wxArrayString m_usedSymbols;
   GroupCell *m_hiddenTree; // here hidden (folded) tree of GCs is stored
   GroupCell *m_hiddenTreeParent; // store linkage to the parent of the fold
   int m_groupType;
@@ -392,6 +456,36 @@ private:
   bool m_inEvaluationQueue;
   bool m_lastInEvaluationQueue;
   int m_inputWidth, m_inputHeight, m_outputWidth, m_outputHeight;
+
+  /*! Draw the output of this cell
+
+    \param in The position of the first output cell
+    \param draw false = Only assign the output cells their positions.
+   */
+  void DrawOutput(wxPoint in, bool draw = true);
+
+  /*! Draw the output by copying a bitmap of it
+
+    Renders the bitmap first if it doesn't exist or is outdated.
+    Configuration::OutputCacheLimit() limits the memory all these bitmaps 
+    together occupy.
+
+    \return false, if the output cannot be drawn from a bitmap.
+   */
+  bool DrawOutputFromCache(wxPoint in);
+
+  //! A bitmap of our output. See DrawOutputFromCache()
+  wxBitmap m_outputCache;
+  //! The area m_outputCache covers
+  wxRect m_outputCacheRect;
+  //! The zoom factor m_outputCache was drawn with
+  double m_outputCacheZoom;
+  //! The Configuration::StyleVersion() m_outputCache was drawn with
+  long m_outputCacheStyleVersion;
+  //! Was m_outputCache drawn as outdated output?
+  bool m_outputCacheOutdated;
+  //! See OutputLaidOutLazily()
+  bool m_outputLaidOutLazily;
 };
 
 #endif /* GROUPCELL_H */
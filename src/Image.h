@@ -91,6 +91,15 @@ public:
   void ClearCache()
   { if ((m_scaledBitmap.GetWidth() > 1) || (m_scaledBitmap.GetHeight() > 1))m_scaledBitmap.Create(1, 1); }
 
+  //! Roughly estimates how many bytes of memory this image occupies
+  size_t SizeInMemory()
+  {
+    size_t size = m_compressedImage.GetDataLen();
+    if (m_scaledBitmap.IsOk())
+      size += m_scaledBitmap.GetWidth() * m_scaledBitmap.GetHeight() * 4;
+    return size;
+  }
+
   //! Reads the compressed image into a memory buffer
   wxMemoryBuffer ReadCompressedImage(wxInputStream *data);
 
@@ -124,6 +124,14 @@ void ImgCell::MarkAsDeleted()
   ClearCache();
 }
 
+size_t ImgCell::SizeInMemory()
+{
+  size_t size = MathCell::SizeInMemory();
+  if (m_image)
+    size += m_image->SizeInMemory();
+  return size;
+}
+
 wxString ImgCell::GetToolTip(const wxPoint &point)
 {
   if(ContainsPoint(point))
@@ -47,6 +47,8 @@ public:
 
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   void LoadImage(wxString image, bool remove = true);
 
   MathCell *Copy();
@@ -95,6 +95,12 @@ void IntCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t IntCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_base, m_under, m_over, m_var);
+}
+
 void IntCell::SetOver(MathCell *over)
 {
   if (over == NULL)
@@ -157,7 +163,7 @@ void IntCell::RecalculateWidths(int fontsize)
       font = *wxNORMAL_FONT;
     font.SetPointSize(fontsize1);
     dc.SetFont(font);
-    dc.GetTextExtent(wxT("\x5A"), &m_signWidth, &m_signSize);
+    configuration->GetTextExtent(wxT("\x5A"), &m_signWidth, &m_signSize);
 
 #if defined __WXMSW__
     m_signWidth = m_signWidth / 2;
@@ -184,7 +190,7 @@ void IntCell::RecalculateWidths(int fontsize)
       font = *wxNORMAL_FONT;
     font.SetPointSize(fontsize1);
     dc.SetFont(font);
-    dc.GetTextExtent(INTEGRAL_TOP, &m_charWidth, &m_charHeight);
+    configuration->GetTextExtent(INTEGRAL_TOP, &m_charWidth, &m_charHeight);
 
     m_width = m_signWidth +
               m_base->GetFullWidth(scale) +
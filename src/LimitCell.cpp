@@ -78,6 +78,12 @@ void LimitCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t LimitCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_base, m_under, m_name);
+}
+
 
 void LimitCell::SetName(MathCell *name)
 {
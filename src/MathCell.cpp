@@ -945,6 +945,35 @@ void MathCell::MarkAsDeletedList(MathCell *list1,
   }
 }
 
+size_t MathCell::SizeInMemory()
+{
+  return sizeof(MathCell) +
+         (m_toolTip.Length() + m_altCopyText.Length()) * sizeof(wxChar);
+}
+
+size_t MathCell::SizeInMemoryList(MathCell *list1,
+                                  MathCell *list2,
+                                  MathCell *list3,
+                                  MathCell *list4,
+                                  MathCell *list5,
+                                  MathCell *list6,
+                                  MathCell *list7
+  )
+{
+  MathCell *lists[] = {list1, list2, list3, list4, list5, list6, list7};
+  size_t size = 0;
+  for (unsigned int i = 0; i < sizeof(lists) / sizeof(lists[0]); i++)
+  {
+    MathCell *tmp = lists[i];
+    while (tmp != NULL)
+    {
+      size += tmp->SizeInMemory();
+      tmp = tmp->m_next;
+    }
+  }
+  return size;
+}
+
 wxString MathCell::GetToolTipList(const wxPoint &point,
                                   MathCell *list1,
                                   MathCell *list2,
@@ -120,7 +120,24 @@ public:
                          MathCell *list6 = NULL,
                          MathCell *list7 = NULL
     );
-  
+
+  /*! Roughly estimates how many bytes of memory this cell occupies
+
+    Includes the cells this cell contains, but not the cells that follow it
+    in the list. Used for keeping the undo buffer within its memory budget.
+  */
+  virtual size_t SizeInMemory();
+
+  //! Sums up SizeInMemory() for all cells of up to 7 lists of cells.
+  static size_t SizeInMemoryList(MathCell *list1,
+                                 MathCell *list2 = NULL,
+                                 MathCell *list3 = NULL,
+                                 MathCell *list4 = NULL,
+                                 MathCell *list5 = NULL,
+                                 MathCell *list6 = NULL,
+                                 MathCell *list7 = NULL
+    );
+
   //! Sets the region that is to be updated on Draw()
   static void SetUpdateRegion(wxRect region)
   { m_updateRegion = region; }
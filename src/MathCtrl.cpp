@@ -82,9 +82,16 @@ MathCtrl::MathCtrl(wxWindow *parent, int id, wxPoint position, wxSize size) :
   m_dc = new wxClientDC(this);
   m_configuration = new Configuration(*m_dc, true);
   m_configuration->ReadConfig();
-  m_redrawStart = NULL;
   m_redrawRequested = false;
+  m_fullRedrawRequested = false;
+  m_memoryDC = NULL;
+  m_antialiassingDC = NULL;
   m_autocompletePopup = NULL;
+  m_outputBatchDepth = 0;
+  m_outputBatchGroup = NULL;
+  m_outputArrived = false;
+  m_redrawsRequested = 0;
+  m_redrawsPerformed = 0;
 
   m_wxmFormat = wxDataFormat(wxT("text/x-wxmaxima-batch"));
   m_mathmlFormat = wxDataFormat(wxT("MathML"));
@@ -117,7 +124,10 @@ MathCtrl::MathCtrl(wxWindow *parent, int id, wxPoint position, wxSize size) :
   m_blinkDisplayCaret = true;
   m_timer.SetOwner(this, TIMER_ID);
   m_caretTimer.SetOwner(this, CARET_TIMER_ID);
+  m_redrawTimer.SetOwner(this, REDRAW_TIMER_ID);
+  m_redrawStopWatch.Start();
   m_saved = false;
+  m_contentVersion = 0;
   AdjustSize();
   m_autocompleteTemplates = false;
 
@@ -135,10 +145,11 @@ MathCtrl::MathCtrl(wxWindow *parent, int id, wxPoint position, wxSize size) :
   // to be shown causing a size change causing a relayout causing the scrollbar
   // to disappear causing a size change... ...which might be an endless loop.
   ShowScrollbars(wxSHOW_SB_ALWAYS, wxSHOW_SB_ALWAYS);
+  ReadBackgroundColour();
   ClearDocument();
 }
 
-void MathCtrl::RedrawIfRequested()
+void MathCtrl::RedrawIfRequested(bool force)
 {
   if(m_mouseMotionWas)
   {
@@ -223,45 +234,89 @@ void MathCtrl::RedrawIfRequested()
     }
     m_mouseMotionWas = false;
   }
-  if (m_redrawRequested)
+
+  // A cell has changed its size while it was drawn => its GroupCell and the
+  // ones below it need to be laid out again. Recalculate() requests redrawing
+  // the cells that have moved or changed their size.
+  if (!m_cellPointers.m_recalculationRequests.empty())
+  {
+    GroupCell *start = m_tree;
+    while (start != NULL)
+    {
+      bool requested = false;
+      for (std::list<MathCell *>::iterator it = m_cellPointers.m_recalculationRequests.begin();
+           it != m_cellPointers.m_recalculationRequests.end(); ++it)
+        if (*it == start)
+          requested = true;
+      if (requested)
+        break;
+      start = dynamic_cast<GroupCell *>(start->m_next);
+    }
+    m_cellPointers.m_recalculationRequests.clear();
+    if (start != NULL)
+      Recalculate(start, false);
+  }
+
+  // Collapsed output that doesn't need to stay collapsed any more has become visible.
+  if (m_cellPointers.m_collapsedCellVisible)
+  {
+    m_cellPointers.m_collapsedCellVisible = false;
+    ExpandVisibleCollapsedCells();
+  }
+
+  if ((!m_fullRedrawRequested) && (m_rectToRefresh.GetLeft() == -1))
   {
-    Refresh();
     m_redrawRequested = false;
-    m_redrawStart = NULL;
+    return;
   }
-  else
+
+  // While maxima is working its output might arrive far more often than the
+  // screen can display it. In this case we limit the number of redraws and
+  // display everything that has arrived in the meantime with the next one.
+  if ((!force) && (m_outputArrived || (!m_evaluationQueue.Empty())))
   {
-    if(m_rectToRefresh.GetLeft() != -1)
+    long frameTime = 1000 / m_configuration->MaxRedrawRate();
+    long sinceLastRedraw = m_redrawStopWatch.Time();
+    if (sinceLastRedraw < frameTime)
     {
-      CalcScrolledPosition(m_rectToRefresh.x, m_rectToRefresh.y, &m_rectToRefresh.x, &m_rectToRefresh.y);
-      RefreshRect(m_rectToRefresh);
+      if (!m_redrawTimer.IsRunning())
+        m_redrawTimer.StartOnce(frameTime - sinceLastRedraw);
+      return;
     }
   }
+  m_redrawTimer.Stop();
+  m_redrawStopWatch.Start();
+  m_outputArrived = false;
+
+  // Only the part of the worksheet that is currently visible needs to be redrawn
+  wxRect viewport;
+  CalcUnscrolledPosition(0, 0, &viewport.x, &viewport.y);
+  GetClientSize(&viewport.width, &viewport.height);
+
+  if (!m_fullRedrawRequested)
+    viewport.Intersect(m_rectToRefresh);
+
+  m_redrawRequested = false;
+  m_fullRedrawRequested = false;
   m_rectToRefresh = wxRect(-1, -1, -1, -1);
+
+  if ((viewport.GetWidth() > 0) && (viewport.GetHeight() > 0))
+  {
+    CalcScrolledPosition(viewport.x, viewport.y, &viewport.x, &viewport.y);
+    RefreshRect(viewport);
+  }
 }
 
 void MathCtrl::RequestRedraw(GroupCell *start)
 {
+  m_redrawsRequested++;
   m_redrawRequested = true;
 
-  if (start == 0)
-    m_redrawStart = m_tree;
+  // If we don't know where the cell is we have to redraw everything.
+  if ((start == NULL) || (start->m_currentPoint.y < 0))
+    m_fullRedrawRequested = true;
   else
-  {
-    if (m_redrawStart != NULL)
-    {
-      // No need to waste time avoiding to waste time in a refresh when we don't
-      // know our cell's position.
-      if ((start->m_currentPoint.y < 0) || (m_redrawStart->m_currentPoint.y < 0))
-      {
-        m_redrawStart = m_tree;
-      }
-      else if (start->m_currentPoint.y < m_redrawStart->m_currentPoint.y)
-        m_redrawStart = start;
-    }
-    else
-      m_redrawStart = start;
-  }
+    AddToRectToRefresh(GroupCellRedrawRect(start->GetRect()));
 
   // Make sure there is a timeout for the redraw
   if (!m_caretTimer.IsRunning())
@@ -285,12 +340,33 @@ MathCtrl::~MathCtrl()
     DestroyTree();
   m_tree = NULL;
 
+  wxDELETE(m_antialiassingDC);
+  wxDELETE(m_memoryDC);
   wxDELETE(m_configuration);
   wxDELETE(m_dc);
   m_dc = NULL;
   m_configuration = NULL;
 }
 
+wxRect MathCtrl::GroupCellRedrawRect(wxRect rect)
+{
+  // The cell bracket is drawn left of the cell and the horizontal cursor
+  // between two cells.
+  int virtualsize_x;
+  int virtualsize_y;
+  GetVirtualSize(&virtualsize_x, &virtualsize_y);
+  int top = rect.GetTop() - m_configuration->GetGroupSkip();
+  int bottom = rect.GetBottom() + m_configuration->GetGroupSkip();
+  if (top < 0)
+    top = 0;
+  return wxRect(0, top, MAX(virtualsize_x, rect.GetRight() + 1), bottom - top + 1);
+}
+
+void MathCtrl::ReadBackgroundColour()
+{
+  SetBackgroundColour(m_configuration->DefaultBackgroundColor());
+}
+
 /***
  * Redraw the control
  */
@@ -304,20 +380,52 @@ void MathCtrl::OnPaint(wxPaintEvent &event)
     return;
   }
 
+  m_redrawsPerformed++;
+
   // Inform all cells how wide our display is
   m_configuration->SetCanvasSize(GetClientSize());
-  wxMemoryDC dcm;
   wxPaintDC dc(this);
 
-  // Get the font size
-  wxConfig *config = (wxConfig *) wxConfig::Get();
-
-  // Prepare data
   wxRect rect = GetUpdateRegion().GetBox();
   wxSize sz = GetSize();
+  if (sz.x == 0) sz.x = 1;
+  if (sz.y == 0) sz.y = 1;
+
+  // The memory bitmap and the DCs that draw on it are kept between two redraws
+  // and only need to be re-created if our size has changed.
+  if ((m_memoryDC == NULL) || (!m_memory.IsOk()) || (m_memory.GetSize() != sz))
+  {
+    wxDELETE(m_antialiassingDC);
+    if (m_memoryDC == NULL)
+      m_memoryDC = new wxMemoryDC;
+    m_memoryDC->SelectObject(wxNullBitmap);
+    m_memory = wxBitmap(sz);
+    m_memoryDC->SelectObject(m_memory);
+    m_memoryDC->SetMapMode(wxMM_TEXT);
+    m_memoryDC->SetBackgroundMode(wxTRANSPARENT);
+    m_antialiassingDC = new wxGCDC(*m_memoryDC);
+    m_reusableRegion.Clear();
+  }
+  wxMemoryDC &dcm = *m_memoryDC;
+  dcm.SetDeviceOrigin(0, 0);
+
+  // After scrolling most of the window can be copied from the bitmap.
+  wxRegion toRender(rect);
+  if (!m_reusableRegion.IsEmpty())
+    toRender.Subtract(m_reusableRegion);
+  if (toRender.IsEmpty())
+  {
+    dc.Blit(rect.GetLeft(), rect.GetTop(), rect.GetWidth(), rect.GetHeight(), &dcm,
+            rect.GetLeft(), rect.GetTop());
+    return;
+  }
+  wxRect renderRect = toRender.GetBox();
+  m_reusableRegion.Union(renderRect);
+
+  // Prepare data
   int xstart, xend, top, bottom;
-  CalcUnscrolledPosition(rect.GetLeft(), rect.GetTop(), &xstart, &top);
-  CalcUnscrolledPosition(rect.GetRight(), rect.GetBottom(), &xend, &bottom);
+  CalcUnscrolledPosition(renderRect.GetLeft(), renderRect.GetTop(), &xstart, &top);
+  CalcUnscrolledPosition(renderRect.GetRight(), renderRect.GetBottom(), &xend, &bottom);
   wxRect updateRegion;
   updateRegion.SetLeft(xstart);
   updateRegion.SetRight(xend);
@@ -325,31 +433,21 @@ void MathCtrl::OnPaint(wxPaintEvent &event)
   updateRegion.SetBottom(bottom);
   MathCell::SetUpdateRegion(updateRegion);
 
-  if (sz.x == 0) sz.x = 1;
-  if (sz.y == 0) sz.y = 1;
-
-  // Test if m_memory is NULL (resize event)
-  if ((!m_memory.IsOk()) || (m_memory.GetSize() != sz))
-    m_memory = wxBitmap(sz);
+  // Only the part of the bitmap that is to be redrawn needs to be cleared.
+  dcm.SetPen(*wxTRANSPARENT_PEN);
+  dcm.SetBrush(*(wxTheBrushList->FindOrCreateBrush(GetBackgroundColour(), wxBRUSHSTYLE_SOLID)));
+  dcm.DrawRectangle(renderRect);
 
-  // Prepare memory DC
-  wxString bgColStr = wxT("white");
-  config->Read(wxT("Style/Background/color"), &bgColStr);
-  SetBackgroundColour(wxColour(bgColStr));
+  PrepareDC(*m_antialiassingDC);
+  PrepareDC(dcm);
 
-  dcm.SelectObject(m_memory);
-  dcm.SetBackground(*(wxTheBrushList->FindOrCreateBrush(GetBackgroundColour(), wxBRUSHSTYLE_SOLID)));
-  dcm.Clear();
-  dcm.SetMapMode(wxMM_TEXT);
-  dcm.SetBackgroundMode(wxTRANSPARENT);
+  // Don't let cells that are only partially inside the region we redraw
+  // draw over the parts of the bitmap we didn't clear.
+  dcm.SetClippingRegion(xstart, top, xend - xstart + 1, bottom - top + 1);
+  m_antialiassingDC->SetClippingRegion(xstart, top, xend - xstart + 1, bottom - top + 1);
 
-  wxGCDC antiAliassingDC(dcm);
-  
-  PrepareDC(antiAliassingDC);
-  PrepareDC(dcm);
-  
   m_configuration->SetContext(dcm);
-  m_configuration->SetAntialiassingDC(antiAliassingDC);
+  m_configuration->SetAntialiassingDC(*m_antialiassingDC);
   m_configuration->SetBounds(top, bottom);
   int fontsize = m_configuration->GetDefaultFontSize(); // apply zoomfactor to defaultfontsize
 
@@ -422,7 +520,7 @@ void MathCtrl::OnPaint(wxPaintEvent &event)
       tmp->m_currentPoint = point;
       if (tmp->DrawThisCell(point))
       {
-        tmp->InEvaluationQueue(m_evaluationQueue.IsInQueue(tmp));
+        tmp->InEvaluationQueue(IsInEvaluationQueue(tmp));
         tmp->LastInEvaluationQueue(m_evaluationQueue.GetCell() == tmp);
         tmp->Draw(point, MAX(fontsize, MC_MIN_SIZE));
       }
@@ -473,9 +571,11 @@ void MathCtrl::OnPaint(wxPaintEvent &event)
   }
 
   // Blit the memory image to the window
+  dcm.DestroyClippingRegion();
+  m_antialiassingDC->DestroyClippingRegion();
   dcm.SetDeviceOrigin(0, 0);
-  dc.Blit(0, rect.GetTop(), sz.x, rect.GetBottom() - rect.GetTop() + 1, &dcm,
-          0, rect.GetTop());
+  dc.Blit(rect.GetLeft(), rect.GetTop(), rect.GetWidth(), rect.GetHeight(), &dcm,
+          rect.GetLeft(), rect.GetTop());
 
   m_configuration->SetContext(*m_dc);
   m_configuration->UnsetAntialiassingDC();
@@ -541,7 +641,7 @@ GroupCell *MathCtrl::InsertGroupCells(
   if (renumbersections)
     NumberSections();
   Recalculate(where, false);
-  m_saved = false; // document has been modified
+  SetSaved(false); // document has been modified
 
   if (undoBuffer)
     TreeUndo_MarkCellsAsAdded(cells, lastOfCellsToInsert, undoBuffer);
@@ -633,14 +733,16 @@ GroupCell *MathCtrl::GetWorkingGroup(bool resortToLast)
   return tmp;
 }
 
-void MathCtrl::InsertLine(MathCell *newCell, bool forceNewLine)
+void MathCtrl::InsertLine(MathCell *newCell, bool forceNewLine, GroupCell *group)
 {
   if (newCell == NULL)
     return;
 
-  m_saved = false;
+  SetSaved(false);
 
-  GroupCell *tmp = GetWorkingGroup(true);
+  GroupCell *tmp = group;
+  if (tmp == NULL)
+    tmp = GetWorkingGroup(true);
                                              
   if (tmp == NULL)
   {
@@ -655,11 +757,26 @@ void MathCtrl::InsertLine(MathCell *newCell, bool forceNewLine)
 
   if (m_tree->Contains(tmp))
   {
+    // The output of the current batch is laid out per cell.
+    if ((m_outputBatchGroup != NULL) && (m_outputBatchGroup != tmp))
+      FlushOutputBatch();
+
+    m_outputArrived = true;
     newCell->ForceBreakLine(forceNewLine);
     newCell->SetParentList(tmp);
 
     tmp->AppendOutput(newCell);
 
+    if (m_outputBatchDepth > 0)
+    {
+      if (m_outputBatchGroup == NULL)
+        m_outputBatchStopWatch.Start();
+      m_outputBatchGroup = tmp;
+      if (m_outputBatchStopWatch.Time() > MAX_OUTPUT_BATCH_TIME)
+        FlushOutputBatch();
+      return;
+    }
+
     UpdateConfigurationClientSize();
     
     tmp->RecalculateAppended();
@@ -681,6 +798,129 @@ void MathCtrl::InsertLine(MathCell *newCell, bool forceNewLine)
   }
 }
 
+void MathCtrl::BeginOutputBatch()
+{
+  m_outputBatchDepth++;
+}
+
+void MathCtrl::EndOutputBatch()
+{
+  if (m_outputBatchDepth > 0)
+    m_outputBatchDepth--;
+  if (m_outputBatchDepth == 0)
+    FlushOutputBatch();
+}
+
+void MathCtrl::FlushOutputBatch()
+{
+  GroupCell *tmp = m_outputBatchGroup;
+  m_outputBatchGroup = NULL;
+
+  if ((tmp == NULL) || (m_tree == NULL) || (!m_tree->Contains(tmp)))
+    return;
+
+  UpdateConfigurationClientSize();
+
+  tmp->RecalculateAppended();
+  Recalculate(tmp, false);
+
+  if (FollowEvaluation())
+  {
+    SetSelection(NULL);
+    if (GCContainsCurrentQuestion(tmp))
+      OpenQuestionCaret();
+    else
+      ScrollToCaret();
+  }
+  RequestRedraw(tmp);
+}
+
+void MathCtrl::AppendCollapsedOutput(wxString xml, wxString userLabel, GroupCell *group)
+{
+  FlushOutputBatch();
+
+  GroupCell *tmp = group;
+  if (tmp == NULL)
+    tmp = GetWorkingGroup(true);
+
+  if (tmp == NULL)
+  {
+    if (GetActiveCell())
+      tmp = dynamic_cast<GroupCell *>(GetActiveCell()->GetParent());
+  }
+
+  CollapsedCell *collapsed = NULL;
+  if (tmp != NULL)
+    collapsed = dynamic_cast<CollapsedCell *>(tmp->GetLastOutput());
+
+  if (collapsed == NULL)
+  {
+    collapsed = new CollapsedCell(NULL, &m_configuration, &m_cellPointers);
+    collapsed->AppendXML(xml, MC_TYPE_DEFAULT, userLabel);
+    InsertLine(collapsed, true, tmp);
+  }
+  else
+  {
+    SetSaved(false);
+    collapsed->AppendXML(xml, MC_TYPE_DEFAULT, userLabel);
+    tmp->ResetSize();
+    Recalculate(tmp, false);
+    RequestRedraw(tmp);
+  }
+}
+
+void MathCtrl::ExpandCollapsedCell(CollapsedCell *cell)
+{
+  GroupCell *group = dynamic_cast<GroupCell *>(cell->GetParent());
+  if (group == NULL)
+    return;
+
+  wxBusyCursor crs;
+  SetSelection(NULL);
+  group->ReplaceOutputCell(cell, cell->Expand());
+  m_contentVersion++;
+  Recalculate(group, false);
+  RequestRedraw();
+}
+
+void MathCtrl::ExpandVisibleCollapsedCells()
+{
+  wxRect visible;
+  CalcUnscrolledPosition(0, 0, &visible.x, &visible.y);
+  GetClientSize(&visible.width, &visible.height);
+
+  bool expanded = false;
+  for (GroupCell *group = m_tree; group != NULL; group = dynamic_cast<GroupCell *>(group->m_next))
+  {
+    if (group->GetRect().GetTop() > visible.GetBottom())
+      break;
+    if ((group->GetRect().GetBottom() < visible.GetTop()) || group->IsHidden())
+      continue;
+
+    MathCell *cell = group->GetOutput();
+    while (cell != NULL)
+    {
+      MathCell *next = cell->m_next;
+      CollapsedCell *collapsed = dynamic_cast<CollapsedCell *>(cell);
+      if ((collapsed != NULL) && collapsed->ExpandWhenVisible() &&
+          collapsed->GetRect().Intersects(visible))
+      {
+        group->ReplaceOutputCell(collapsed, collapsed->Expand());
+        Recalculate(group, false);
+        expanded = true;
+      }
+      cell = next;
+    }
+  }
+
+  if (expanded)
+  {
+    // The cached renderings of the selection might show the collapsed cells.
+    m_contentVersion++;
+    RequestRedraw();
+  }
+}
+
 void MathCtrl::SetZoomFactor(double newzoom, bool recalc)
 {
   m_configuration->SetZoomFactor(newzoom);
@@ -735,7 +975,17 @@ void MathCtrl::Recalculate(GroupCell *start, bool force)
   
   while (tmp != NULL)
   {
+    // Cells that have changed their position or size need to be redrawn.
+    wxRect oldRect = tmp->GetRect();
+    bool wasPlaced = (tmp->m_currentPoint.y >= 0);
     tmp->Recalculate();
+    wxRect newRect = tmp->GetRect();
+    if ((!wasPlaced) || (oldRect != newRect))
+    {
+      if (wasPlaced)
+        AddToRectToRefresh(GroupCellRedrawRect(oldRect));
+      AddToRectToRefresh(GroupCellRedrawRect(newRect));
+    }
     tmp = dynamic_cast<GroupCell *>(tmp->m_next);
   }
   
@@ -825,11 +1075,13 @@ void MathCtrl::ClearDocument()
   m_hCaretPositionStart = m_hCaretPositionEnd = NULL;
 
   m_evaluationQueue.Clear();
+  for (std::list<EvaluationQueue *>::iterator it = m_sectionQueues.begin(); it != m_sectionQueues.end(); ++it)
+    (*it)->Clear();
   TreeUndo_ClearBuffers();
   DestroyTree();
 
   m_blinkDisplayCaret = true;
-  m_saved = false;
+  SetSaved(false);
   UpdateTableOfContents();
 
   Scroll(0, 0);
@@ -1943,16 +2195,11 @@ bool MathCtrl::Copy(bool astext)
         {
           // Add a bitmap representation of the selected output to the clipboard - if this
           // bitmap isn't way too large for this to make sense:
-          wxBitmap bmp;
           int bitmapScale = 3;
           wxConfig::Get()->Read(wxT("bitmapScale"), &bitmapScale);
-          Bitmap bmp_scaled(&m_configuration, bitmapScale);
-          MathCell *tmp = CopySelection();
-          if (bmp_scaled.SetData(tmp, 4000000))
-          {
-            bmp = bmp_scaled.GetBitmap();
+          wxBitmap bmp = SelectionToBitmap(bitmapScale, 4000000);
+          if (bmp.IsOk())
             data->Add(new wxBitmapDataObject(bmp));
-          }
         }
       }
       wxTheClipboard->SetData(data);
@@ -2183,21 +2430,18 @@ bool MathCtrl::CopyCells()
 
     if(m_configuration->CopyBitmap())
     {
-      MathCell *tmp2 = CopySelection();
       int bitmapScale = 3;
       wxConfig::Get()->Read(wxT("bitmapScale"), &bitmapScale);
-      Bitmap bmp(&m_configuration, bitmapScale);
-      if (bmp.SetData(tmp2, 4000000))
-        data->Add(new wxBitmapDataObject(bmp.GetBitmap()));
+      wxBitmap bmp = SelectionToBitmap(bitmapScale, 4000000);
+      if (bmp.IsOk())
+        data->Add(new wxBitmapDataObject(bmp));
     }
 
     if(m_configuration->CopySVG())
     {    
-      MathCell *tmp = CopySelection();
-      
-      Svgout svg(&m_configuration);
-      svg.SetData(tmp);
-      data->Add(svg.GetDataObject());
+      wxMemoryBuffer svg = SelectionToSVG();
+      if (svg.GetDataLen() > 0)
+        data->Add(Svgout::GetDataObject(svg));
     }
     
     wxTheClipboard->SetData(data);
@@ -2256,6 +2500,10 @@ bool MathCtrl::CanDeleteRegion(GroupCell *start, GroupCell *end)
     if (tmp == GetWorkingGroup())
       return false;
 
+    // ...and of cells whose commands maxima has received ahead of time.
+    if (m_cellPointers.InFlight(tmp))
+      return false;
+
     if (tmp == end)
       return true;
 
@@ -2329,6 +2577,8 @@ void MathCtrl::TreeUndo_DiscardAction(std::list<TreeUndoAction *> *actionList)
   if(!actionList->empty())
   {
     TreeUndoAction *Action = actionList->back();
+    // The cells this action kept for undoing a deletion are no more needed.
+    wxDELETE(Action->m_oldCells);
     wxDELETE(Action);
     actionList->pop_back();
   }
@@ -2361,8 +2611,10 @@ void MathCtrl::TreeUndo_CellLeft()
     undoAction->m_start = activeCell;
     wxASSERT_MSG(undoAction->m_start != NULL, _("Bug: Trying to record a cell contents change without a cell."));
     treeUndoActions.push_front(undoAction);
-    TreeUndo_LimitUndoBuffer();
+    // The cells of m_currentUndoAction now belong to undoAction.
+    m_currentUndoAction.m_oldCells = NULL;
     m_currentUndoAction.Clear();
+    TreeUndo_LimitUndoBuffer();
     TreeUndo_ClearRedoActionList();
   }
   else
@@ -2406,9 +2658,13 @@ void MathCtrl::TreeUndo_MergeSubsequentEdits(bool mergeRequest, std::list<TreeUn
     {
       TreeUndoAction *undoAction = new TreeUndoAction(m_currentUndoAction);
       undoList->push_front(undoAction);
+      // The cells of m_currentUndoAction now belong to undoAction.
+      m_currentUndoAction.m_oldCells = NULL;
       m_currentUndoAction.Clear();
       TreeUndo_ActiveCell = NULL;
       m_TreeUndoMergeStartIsSet = false;
+      if (undoList == &treeUndoActions)
+        TreeUndo_LimitUndoBuffer();
     }
   }
 
@@ -2436,7 +2692,7 @@ void MathCtrl::DeleteRegion(GroupCell *start, GroupCell *end, std::list<TreeUndo
 
   m_hCaretPositionStart = m_hCaretPositionEnd = NULL;
 
-  m_saved = false;
+  SetSaved(false);
 
   SetActiveCell(NULL, false);
   m_hCaretActive = false;
@@ -2448,6 +2704,9 @@ void MathCtrl::DeleteRegion(GroupCell *start, GroupCell *end, std::list<TreeUndo
   while (tmp)
   {
     m_evaluationQueue.Remove(tmp);
+    for (std::list<EvaluationQueue *>::iterator it = m_sectionQueues.begin(); it != m_sectionQueues.end(); ++it)
+      if ((*it)->IsInQueue(tmp))
+        (*it)->Remove(tmp);
 
     if (tmp->IsFoldable() || (tmp->GetGroupType() == GC_TYPE_IMAGE))
     {
@@ -2499,6 +2758,7 @@ void MathCtrl::DeleteRegion(GroupCell *start, GroupCell *end, std::list<TreeUndo
     // If we have a undo buffer to put it into, that is.
     if (undoBuffer)
     {
+      TreeUndo_DropOutput(start);
       if (!m_TreeUndoMergeSubsequentEdits)
       {
         TreeUndoAction *undoAction = new TreeUndoAction;
@@ -2546,6 +2806,7 @@ void MathCtrl::DeleteRegion(GroupCell *start, GroupCell *end, std::list<TreeUndo
       // Add an "end of tree" marker to the end of the list of deleted cells
       end->m_next = NULL;
       end->m_nextToDraw = NULL;
+      TreeUndo_DropOutput(start);
 
       // Now let's put the unlinked cells into an undo buffer.
       if (!m_TreeUndoMergeSubsequentEdits)
@@ -3121,6 +3382,7 @@ void MathCtrl::OnCharInActive(wxKeyEvent &event)
       GetActiveCell()->KeyboardSelectionStartedHere();
       GetActiveCell()->SelectNone();
       SetActiveCell(NULL);
+      RequestRedraw(m_hCaretPositionStart);
       RequestRedraw(m_hCaretPosition);
     }
     else
@@ -3245,7 +3507,7 @@ void MathCtrl::OnCharInActive(wxKeyEvent &event)
   // Update title and toolbar in order to reflect the "unsaved" state of the worksheet.
   if (IsSaved() && activeCell->GetValue() != oldValue)
   {
-    m_saved = false;
+    SetSaved(false);
     RequestRedraw();
   }
   // The keypress might have moved the cursor off-screen.
@@ -3257,7 +3519,7 @@ void MathCtrl::OnCharInActive(wxKeyEvent &event)
 
   if (activeCell->IsDirty())
   {
-    m_saved = false;
+    SetSaved(false);
 
     int height = activeCell->GetHeight();
     //   int fontsize = m_configuration->GetDefaultFontSize();
@@ -4135,6 +4397,9 @@ void MathCtrl::OnTimer(wxTimerEvent &event)
         m_caretTimer.Stop();
     }
     break;
+  case REDRAW_TIMER_ID:
+    RedrawIfRequested();
+    break;
   default:
   {   
       SlideShow *slideshow = NULL;
@@ -4177,6 +4442,61 @@ void MathCtrl::OnTimer(wxTimerEvent &event)
 }
 
 void MathCtrl::RequestRedraw(wxRect rect)
+{
+  m_redrawsRequested++;
+  AddToRectToRefresh(rect);
+}
+
+void MathCtrl::Refresh(bool eraseBackground, const wxRect *rect)
+{
+  // Whatever is to be refreshed cannot be copied from our bitmap.
+  if (rect == NULL)
+    m_reusableRegion.Clear();
+  else
+    m_reusableRegion.Subtract(*rect);
+  wxScrolledCanvas::Refresh(eraseBackground, rect);
+}
+
+void MathCtrl::ScrollWindow(int dx, int dy, const wxRect *rect)
+{
+  // If anything has changed since the last redraw we can as well render
+  // the whole window again.
+  if ((rect != NULL) || (m_memoryDC == NULL) || (m_memory.GetSize() != GetSize()) ||
+      m_fullRedrawRequested || (m_rectToRefresh.GetLeft() != -1))
+  {
+    Refresh();
+    return;
+  }
+
+  // The part of the window that stays visible after scrolling
+  wxRect client(wxPoint(0, 0), GetClientSize());
+  wxRect dest = client;
+  dest.Offset(dx, dy);
+  dest.Intersect(client);
+  if (dest.IsEmpty())
+  {
+    Refresh();
+    return;
+  }
+
+  // Move this part to its new position in the bitmap. Blitting between two
+  // overlapping regions of the same DC isn't supported on all platforms.
+  wxBitmap visible(dest.GetWidth(), dest.GetHeight());
+  wxMemoryDC visibleDC(visible);
+  visibleDC.Blit(0, 0, dest.GetWidth(), dest.GetHeight(), m_memoryDC,
+                 dest.GetLeft() - dx, dest.GetTop() - dy);
+  m_memoryDC->Blit(dest.GetLeft(), dest.GetTop(), dest.GetWidth(), dest.GetHeight(), &visibleDC,
+                   0, 0);
+  visibleDC.SelectObject(wxNullBitmap);
+
+  // Only the newly exposed strip needs to be rendered; The rest of the window
+  // is copied from the bitmap by OnPaint().
+  m_reusableRegion.Offset(dx, dy);
+  m_reusableRegion.Intersect(dest);
+  wxScrolledCanvas::Refresh(false);
+}
+
+void MathCtrl::AddToRectToRefresh(wxRect rect)
 {
   if((m_rectToRefresh.GetLeft() > rect.GetLeft()) || (m_rectToRefresh.GetLeft() < 0))
     m_rectToRefresh.SetLeft(rect.GetLeft());
@@ -4197,6 +4517,10 @@ void MathCtrl::DestroyTree()
   SetHCaret(NULL);
   TreeUndo_ClearUndoActionList();
   TreeUndo_ClearRedoActionList();
+  // Maxima might still send output for commands we have sent ahead of time.
+  for (std::list<CellPointers::CommandInFlight>::iterator it = m_cellPointers.m_commandsInFlight.begin();
+       it != m_cellPointers.m_commandsInFlight.end(); ++it)
+    it->m_cell = NULL;
   wxDELETE(m_tree);
   m_tree = m_last = NULL;
 }
@@ -4212,34 +4536,102 @@ GroupCell *MathCtrl::CopyTree()
   return dynamic_cast<GroupCell *>(m_tree->CopyList());
 }
 
+wxString MathCtrl::RenderCacheKey(int scale)
+{
+  // Every change of the worksheet increments m_contentVersion => a cell that
+  // has been deleted and whose address has been re-used cannot match, either.
+  return wxString::Format(wxT("%p:%p:%i:%i:%li:%li"),
+                          (void *) m_cellPointers.m_selectionStart,
+                          (void *) m_cellPointers.m_selectionEnd,
+                          scale,
+                          m_configuration->ShowCodeCells(),
+                          m_configuration->StyleVersion(),
+                          m_contentVersion);
+}
+
+wxBitmap MathCtrl::SelectionToBitmap(int scale, long maxSize)
+{
+  if (m_cellPointers.m_selectionStart == NULL)
+    return wxNullBitmap;
+
+  wxString key = RenderCacheKey(scale);
+  wxBitmap bmp = m_renderCache.GetBitmap(key);
+  if (bmp.IsOk())
+  {
+    // Too big bitmaps or bitmaps that are too wide or high can crash windows
+    // or the X server.
+    if ((maxSize < 0) ||
+        (
+                (bmp.GetWidth() * bmp.GetHeight() < maxSize) &&
+                (bmp.GetWidth() < 20000) &&
+                (bmp.GetHeight() < 20000)
+        )
+            )
+      return bmp;
+    else
+      return wxNullBitmap;
+  }
+
+  MathCell *tmp = CopySelection();
+  if (tmp == NULL)
+    return wxNullBitmap;
+
+  Bitmap bitmap(&m_configuration, scale);
+  if (bitmap.SetData(tmp, maxSize))
+  {
+    bmp = bitmap.GetBitmap();
+    m_renderCache.AddBitmap(key, bmp);
+  }
+  return bmp;
+}
+
+wxMemoryBuffer MathCtrl::SelectionToSVG()
+{
+  if (m_cellPointers.m_selectionStart == NULL)
+    return wxMemoryBuffer();
+
+  wxString key = RenderCacheKey(SVG_SCALE);
+  wxMemoryBuffer svgContents = m_renderCache.GetSVG(key);
+  if (svgContents.GetDataLen() > 0)
+    return svgContents;
+
+  MathCell *tmp = CopySelection();
+  if (tmp == NULL)
+    return wxMemoryBuffer();
+
+  Svgout svg(&m_configuration, wxEmptyString, SVG_SCALE);
+  if (svg.SetData(tmp))
+  {
+    svgContents = svg.GetSVGData();
+    m_renderCache.AddSVG(key, svgContents);
+  }
+  return svgContents;
+}
+
 /***
  * Copy selection as bitmap
  */
 bool MathCtrl::CopyBitmap()
 {
-  MathCell *tmp = CopySelection();
-
   int bitmapScale = 3;
   wxConfig::Get()->Read(wxT("bitmapScale"), &bitmapScale);
 
-  Bitmap bmp(&m_configuration, bitmapScale);
-  bmp.SetData(tmp);
-
-  bool retval = bmp.ToClipboard();
+  wxBitmap bmp = SelectionToBitmap(bitmapScale);
+  if (!bmp.IsOk())
+    return false;
 
-  return retval;
+  Bitmap bitmap(&m_configuration, bitmapScale);
+  bitmap.SetBitmap(bmp);
+  return bitmap.ToClipboard();
 }
 
 bool MathCtrl::CopySVG()
 {
-  MathCell *tmp = CopySelection();
-
-  Svgout svg(&m_configuration);
-  svg.SetData(tmp);
-
-  bool retval = svg.ToClipboard();
+  wxMemoryBuffer svg = SelectionToSVG();
+  if (svg.GetDataLen() == 0)
+    return false;
 
-  return retval;
+  return Svgout::ToClipboard(svg);
 }
 
 bool MathCtrl::CopyRTF()
@@ -4289,14 +4681,10 @@ wxSize MathCtrl::CopyToFile(wxString file)
   }
   else
   {
-    MathCell *tmp = CopySelection();
-
     Bitmap bmp(&m_configuration);
-    bmp.SetData(tmp);
-
-    wxSize retval = bmp.ToFile(file);
+    bmp.SetBitmap(SelectionToBitmap(1));
 
-    return retval;
+    return bmp.ToFile(file, true);
   }
 }
 
@@ -5702,54 +6090,6 @@ bool MathCtrl::ExportToTeX(wxString file)
   return done;
 }
 
-wxString MathCtrl::UnicodeToMaxima(wxString s)
-{
-#if wxUSE_UNICODE
-  s.Replace(wxT("\x00B2"), wxT("^2"));
-  s.Replace(wxT("\x00B3"), wxT("^3"));
-  s.Replace(wxT("\x00BD"), wxT("(1/2)"));
-  s.Replace(wxT("\x221A"), wxT("sqrt"));
-//  s.Replace(wxT("\x03C0"), wxT("%pi"));
-//  s.Replace(wxT("\x2148"), wxT("%i"));
-//  s.Replace(wxT("\x2147"), wxT("%e"));
-  s.Replace(wxT("\x221E"), wxT("inf"));
-  s.Replace(wxT("\x22C0"), wxT(" and "));
-  s.Replace(wxT("\x22C1"), wxT(" or "));
-  s.Replace(wxT("\x22BB"), wxT(" xor "));
-  s.Replace(wxT("\x22BC"), wxT(" nand "));
-  s.Replace(wxT("\x22BD"), wxT(" nor "));
-  s.Replace(wxT("\x21D2"), wxT(" implies "));
-  s.Replace(wxT("\x21D4"), wxT(" equiv "));
-  s.Replace(wxT("\x00AC"), wxT(" not "));
-  s.Replace(wxT("\x2260"), wxT(" # "));
-  s.Replace(wxT("\x2264"), wxT(" <= "));
-  s.Replace(wxT("\x2265"), wxT(" >= "));
-  s.Replace(wxT("\x2212"), wxT("-")); // An unicode minus sign
-  s.Replace(wxT("\xDCB6"), wxT(" ")); // A non-breakable space
-#endif
-
-  // Convert \x03C0 to %pi if it isn't part of a synbol name
-  wxString retval;
-  for (size_t i = 0; i < s.Length(); i++)
-    switch (wxChar(s[i]))
-    {
-      case wxT('\x03C0'):
-      {
-        if (
-                ((i == 0) || (!wxIsalnum(s[i - 1]))) &&
-                ((i == s.Length() - 1) || (!wxIsalnum(s[i + 1])))
-                )
-          retval += wxT("%pi");
-        else
-          retval += s[i];
-      }
-        break;
-      default:
-        retval += s[i];
-    }
-  return retval;
-}
-
 void MathCtrl::ExportToMAC(wxTextFile &output, GroupCell *tree, bool wxm, const std::vector<int> &cellMap,
                            bool fixReorderedIndices)
 {
@@ -6128,6 +6468,10 @@ void MathCtrl::OnDoubleClick(wxMouseEvent &event)
 
   if (GetActiveCell() != NULL)
     GetActiveCell()->SelectWordUnderCaret();
+  else if ((m_cellPointers.m_selectionStart != NULL) &&
+           (m_cellPointers.m_selectionStart == m_cellPointers.m_selectionEnd) &&
+           (dynamic_cast<CollapsedCell *>(m_cellPointers.m_selectionStart) != NULL))
+    ExpandCollapsedCell(dynamic_cast<CollapsedCell *>(m_cellPointers.m_selectionStart));
   else if (m_cellPointers.m_selectionStart != NULL)
   {
     GroupCell *parent = dynamic_cast<GroupCell *>(m_cellPointers.m_selectionStart->GetParent());
@@ -6241,6 +6585,17 @@ void MathCtrl::AddDocumentToEvaluationQueue()
   SetHCaret(m_last);
 }
 
+bool MathCtrl::IsInEvaluationQueue(GroupCell *cell)
+{
+  if (m_evaluationQueue.IsInQueue(cell))
+    return true;
+
+  for (std::list<EvaluationQueue *>::iterator it = m_sectionQueues.begin(); it != m_sectionQueues.end(); ++it)
+    if ((*it)->IsInQueue(cell))
+      return true;
+  return false;
+}
+
 void MathCtrl::AddToEvaluationQueue(GroupCell *cell)
 {
   if (cell->GetGroupType() == GC_TYPE_CODE)
@@ -6482,14 +6837,48 @@ void MathCtrl::TreeUndo_LimitUndoBuffer()
   long undoLimit = 0;
   config->Read(wxT("undoLimit"), &undoLimit);
 
-  if (undoLimit == 0)
-    return;
+  if (undoLimit != 0)
+  {
+    if (undoLimit < 0)
+      undoLimit = 0;
 
-  if (undoLimit < 0)
-    undoLimit = 0;
+    while ((long) treeUndoActions.size() > undoLimit)
+      TreeUndo_DiscardAction(&treeUndoActions);
+  }
 
-  while ((long) treeUndoActions.size() > undoLimit)
+  if (m_configuration->UndoMemoryLimit() <= 0)
+    return;
+
+  size_t budget = (size_t) m_configuration->UndoMemoryLimit() * 1024 * 1024;
+  size_t size = TreeUndo_SizeInMemory();
+  while ((size > budget) && (treeUndoActions.size() > 1))
+  {
+    size -= treeUndoActions.back()->SizeInMemory();
     TreeUndo_DiscardAction(&treeUndoActions);
+  }
+}
+
+size_t MathCtrl::TreeUndo_SizeInMemory()
+{
+  size_t size = 0;
+  for (std::list<TreeUndoAction *>::iterator it = treeUndoActions.begin(); it != treeUndoActions.end(); ++it)
+    size += (*it)->SizeInMemory();
+  return size;
+}
+
+void MathCtrl::TreeUndo_DropOutput(GroupCell *cells)
+{
+  if (m_configuration->UndoKeepsOutput())
+    return;
+
+  while (cells != NULL)
+  {
+    if (cells->GetGroupType() == GC_TYPE_CODE)
+      cells->RemoveOutput();
+    if (cells->GetHiddenTree())
+      TreeUndo_DropOutput(cells->GetHiddenTree());
+    cells = dynamic_cast<GroupCell *>(cells->m_next);
+  }
 }
 
 bool MathCtrl::CanTreeUndo()
@@ -6565,7 +6954,7 @@ bool MathCtrl::TreeUndo(std::list<TreeUndoAction *> *sourcelist, std::list<TreeU
     return false;
   }
 
-  m_saved = false;
+  SetSaved(false);
 
   // Seems like saving the current value of the currently active cell
   // in the tree undo buffer makes the behavior of TreeUndo feel
@@ -6713,6 +7102,9 @@ bool MathCtrl::TreeUndo(std::list<TreeUndoAction *> *sourcelist, std::list<TreeU
   TreeUndo_MergeSubsequentEdits(false, undoForThisOperation);
 
   sourcelist->pop_front();
+  // The cells this action kept are part of the worksheet again.
+  action->m_oldCells = NULL;
+  wxDELETE(action);
 
   Recalculate(true);
   RequestRedraw();
@@ -7374,7 +7766,7 @@ void MathCtrl::RemoveAllOutput(GroupCell *tree)
   {
     // If this function actually does do something we
     // should enable the "save" button.
-    m_saved = false;
+    SetSaved(false);
 
     tree->RemoveOutput();
 
@@ -7659,7 +8051,7 @@ void MathCtrl::Replace(wxString oldString, wxString newString, bool ignoreCase)
   {
     if (GetActiveCell()->ReplaceSelection(oldString, newString))
     {
-      m_saved = false;
+      SetSaved(false);
       GroupCell *group = dynamic_cast<GroupCell *>(GetActiveCell()->GetParent());
       group->ResetInputLabel();
       group->ResetSize();
@@ -7702,7 +8094,7 @@ int MathCtrl::ReplaceAll(wxString oldString, wxString newString, bool ignoreCase
 
   if (count > 0)
   {
-    m_saved = false;
+    SetSaved(false);
     Recalculate();
     RequestRedraw();
   }
@@ -46,6 +46,15 @@
 #include "AutocompletePopup.h"
 #include "TableOfContents.h"
 #include "ToolBar.h"
+#include "RenderCache.h"
+#include "CollapsedCell.h"
+#include <wx/stopwatch.h>
+
+/*! The maximum time [in milliseconds] output may be kept in a batch before it is displayed
+
+  See MathCtrl::BeginOutputBatch()
+*/
+#define MAX_OUTPUT_BATCH_TIME 200
 
 /*! The canvas that contains the spreadsheet the whole program is about.
 
@@ -94,10 +103,10 @@ private:
     Drawing is done from a wxPaintDC in OnPaint() instead.
   */
   wxDC *m_dc;
-  //! Where do we need to start the repainting of the worksheet?
-  GroupCell *m_redrawStart;
-  //! Do we need to redraw the worksheet?
+  //! Has the worksheet changed since the last redraw?
   bool m_redrawRequested;
+  //! Do we need to redraw the whole visible part of the worksheet?
+  bool m_fullRedrawRequested;
   //! The clipboard format "mathML"
 
   //! A class that publishes wxm data to the clipboard
@@ -211,6 +220,7 @@ private:
       m_newCellsEnd = NULL;
       wxDELETE(m_oldCells);
       m_oldCells = NULL;
+      m_sizeInMemory = -1;
     }
 
     TreeUndoAction()
@@ -219,6 +229,20 @@ private:
       m_oldText = wxEmptyString;
       m_newCellsEnd = NULL;
       m_oldCells = NULL;
+      m_sizeInMemory = -1;
+    }
+
+    /*! Roughly estimates how many bytes of memory this action keeps alive
+
+      The result is cached as an action no more changes once it has been
+      stored in the undo buffer.
+     */
+    size_t SizeInMemory()
+    {
+      if (m_sizeInMemory < 0)
+        m_sizeInMemory = sizeof(TreeUndoAction) + m_oldText.Length() * sizeof(wxChar) +
+                         MathCell::SizeInMemoryList(m_oldCells);
+      return m_sizeInMemory;
     }
 
 
@@ -249,8 +273,13 @@ private:
       the latter might break consecutive undos.
 
       If this field's value is NULL no cells have to be added to undo this action.
+      The action owns these cells: They are deleted if the action is discarded.
     */
     GroupCell *m_oldCells;
+
+  private:
+    //! The cached result of SizeInMemory(). -1 means: Not calculated yet.
+    long m_sizeInMemory;
   };
 
   //! The list of tree actions that can be undone
@@ -277,9 +306,23 @@ private:
    */
   GroupCell *TreeUndo_ActiveCell;
 
-  //! Drop actions from the back of the undo list until itis within the undo limit.
+  /*! Drop actions from the back of the undo list until it is within the undo limit.
+
+    Both the maximum number of actions and the memory budget from
+    Configuration::UndoMemoryLimit() are enforced. The newest action is
+    always kept even if it exceeds the memory budget on its own.
+   */
   void TreeUndo_LimitUndoBuffer();
 
+  //! Roughly estimates how many bytes of memory the undo buffer occupies.
+  size_t TreeUndo_SizeInMemory();
+
+  /*! Drop the regenerable output of cells that are moved to the undo buffer
+
+    Only has an effect if Configuration::UndoKeepsOutput() is false.
+   */
+  void TreeUndo_DropOutput(GroupCell *cells);
+
   /*! Undo an item from a list of undo actions.
 
     \param actionlist The list to take the undo information from
@@ -388,7 +431,8 @@ private:
   enum TimerIDs
   {
     TIMER_ID,
-    CARET_TIMER_ID
+    CARET_TIMER_ID,
+    REDRAW_TIMER_ID
   };
 
   //! Add a line to a file.
@@ -580,9 +624,31 @@ private:
   wxTimer m_timer;
   //! The cursor blink rate. Also the timeout for redrawing the worksheet
   wxTimer m_caretTimer;
+  //! Issues a redraw that had to be postponed in order to keep the frame rate limit
+  wxTimer m_redrawTimer;
+  //! The time since the last redraw
+  wxStopWatch m_redrawStopWatch;
+  //! Has maxima sent output since the last redraw?
+  bool m_outputArrived;
+  //! How often has a redraw been requested?
+  long m_redrawsRequested;
+  //! How often has the worksheet actually been redrawn?
+  long m_redrawsPerformed;
   wxBitmap m_memory;
+  //! The DC that draws into m_memory. Is kept between two redraws.
+  wxMemoryDC *m_memoryDC;
+  //! The antialiassing DC that draws into m_memory. Is kept between two redraws.
+  wxDC *m_antialiassingDC;
+  /*! The part of the window m_memory contains an up-to-date rendering of
+
+    In window coordinates. OnPaint() copies this part from m_memory instead of
+    rendering it again.
+   */
+  wxRegion m_reusableRegion;
   //! True if no changes have to be saved.
   bool m_saved;
+  //! Is incremented on every change of the document, see SetSaved()
+  long m_contentVersion;
   AutoComplete m_autocomplete;
   wxArrayString m_completions;
   bool m_autocompleteTemplates;
@@ -647,6 +713,21 @@ public:
   //! The pointers to cells that can be deleted by these cells on deletion of the cells.
   CellPointers m_cellPointers;
 
+  /*! Renders the current selection as a bitmap
+
+    Reuses the last rendering of the same selection at the same scale, if there is one.
+    \param scale By which factor the resolution should be increased
+    \param maxSize The maximum size [in square pixels] that will be rendered. -1 means: No limit.
+    \return wxNullBitmap, if the bitmap could not be created.
+   */
+  wxBitmap SelectionToBitmap(int scale, long maxSize = -1);
+
+  /*! Renders the current selection as svg
+
+    Reuses the last rendering of the same selection, if there is one.
+   */
+  wxMemoryBuffer SelectionToSVG();
+
   /*! Update the table of contents
 
     This function actually only schedules the update of the table-of-contents-tab.
@@ -675,21 +756,28 @@ public:
   //! Request the worksheet to be redrawn
   void MarkRefreshAsDone()
   {
-    m_redrawStart = NULL;
     m_redrawRequested = false;
+    m_fullRedrawRequested = false;
+    m_rectToRefresh = wxRect(-1, -1, -1, -1);
   }
 
   /*! Redraw the worksheet if RequestRedraw() has been called.
 
     Also handles setting tooltips and redrawing the brackets on mouse movements.
+
+    While maxima is working the redraws are limited to 
+    Configuration::MaxRedrawRate() per second; A redraw that comes too early
+    is postponed and merged with all redraw requests that arrive until it is due.
+
+    \param force true = Don't postpone the redraw even if it comes too early.
    */
-  void RedrawIfRequested();
+  void RedrawIfRequested(bool force = false);
 
   /*! Request the worksheet to be redrawn
 
-    \param start Which cell do we need to start the redraw in? Subsequent calls to 
-    this function with different cells start the redraw at the upmost of the cells
-    that were passed to it.
+    \param start The cell that has changed. NULL means: Redraw the whole visible
+    part of the worksheet. The cells below start are only redrawn if Recalculate()
+    has found them to have moved.
 
     The actual redraw is done in the idle loop which means that as many redraw
     actions are merged as is necessary to allow wxMaxima to process things in
@@ -711,12 +799,27 @@ public:
   void ForceRedraw()
   {
     RequestRedraw();
-    RedrawIfRequested();
+    RedrawIfRequested(true);
   }
 
   //! Is a Redraw requested?
   bool RedrawRequested()
   { return m_redrawRequested; }
+
+  //! How many redraws have been requested since the last ResetRedrawCounters()?
+  long GetRedrawsRequested()
+  { return m_redrawsRequested; }
+
+  //! How many redraws have been performed since the last ResetRedrawCounters()?
+  long GetRedrawsPerformed()
+  { return m_redrawsPerformed; }
+
+  //! Reset the counters GetRedrawsRequested() and GetRedrawsPerformed() report
+  void ResetRedrawCounters()
+  {
+    m_redrawsRequested = 0;
+    m_redrawsPerformed = 0;
+  }
   //! @}
 
   //! To be called after enabling or disabling the visibility of code cells
@@ -724,19 +827,16 @@ public:
 
   //! Re-read the configuration
   void UpdateConfig()
-  { m_configuration->ReadConfig(); }
+  {
+    m_configuration->ReadConfig();
+    ReadBackgroundColour();
+    // The styles might have changed => the cached renderings might be outdated.
+    m_renderCache.Clear();
+  }
 
   //! The name of the currently-opened file
   wxString m_currentFile;
 
-  /*! Make a few unicode characters interpretable by maxima.
-    
-    Does convert the not equal sign to a '#' and similar.
-
-    \todo We perhaps could think of only doing this outside of strings.
-   */
-  wxString UnicodeToMaxima(wxString s);
-
   //! Scroll to the start of the worksheet.
   void ScrollToStart()
   { Scroll(0, 0); }
@@ -881,8 +981,44 @@ public:
 
     If maxima isn't currently evaluating and therefore there is no working group
     the line is appended to m_last, instead.
+    \param group The cell to add the line to instead of the working group,
+    for example one an additional maxima evaluates.
+  */
+  void InsertLine(MathCell *newLine, bool forceNewLine = false, GroupCell *group = NULL);
+
+  /*! Collect the output InsertLine() appends and lay it out only in EndOutputBatch()
+
+    Laying out a new line of output means recalculating the cell it is appended to
+    and the position of all cells below it, scrolling and requesting a redraw. If
+    maxima sends many lines in one packet this is done only once per packet.
+    Output is laid out early if it has been kept for more than MAX_OUTPUT_BATCH_TIME
+    milliseconds or if output is appended to another cell than before.
+
+    Calls can be nested.
+  */
+  void BeginOutputBatch();
+
+  //! Ends a batch of output started by BeginOutputBatch()
+  void EndOutputBatch();
+
+  //! Lays out and displays the output of the current batch now.
+  void FlushOutputBatch();
+
+  /*! Add output to the working group that is kept collapsed until the user expands it
+
+    If the last cell of the working group's output already is a CollapsedCell the
+    output is added to it.
+    \param xml A xml fragment with a root element as it is passed to MathParser::ParseLine()
+    \param userLabel The label for the output the user has defined, if any
+    \param group The cell to add the output to instead of the working group
   */
-  void InsertLine(MathCell *newLine, bool forceNewLine = false);
+  void AppendCollapsedOutput(wxString xml, wxString userLabel = wxEmptyString, GroupCell *group = NULL);
+
+  //! Parse and display the next part of the output a CollapsedCell contains
+  void ExpandCollapsedCell(CollapsedCell *cell);
+
+  //! Expand the visible CollapsedCells whose CollapsedCell::ExpandWhenVisible() is true
+  void ExpandVisibleCollapsedCells();
 
   //! Recalculate the worksheet starting with the cell start.
   void Recalculate(GroupCell *start, bool force = false);
@@ -1037,6 +1173,12 @@ public:
   //! Copy a rtf version of the current selection to the clipboard
   bool CopyRTF();
 
+  /*! Save a bitmap of the current selection to a file
+
+    Unless the selection is an image or animation the image is compressed and
+    written in the background: The file might not exist yet when this function
+    returns. Errors are reported using wxLogError().
+   */
   wxSize CopyToFile(wxString file);
 
   wxSize CopyToFile(wxString file, MathCell *start, MathCell *end, bool asData = false, int scale = 1);
@@ -1238,8 +1380,17 @@ public:
   bool IsSaved()
   { return m_saved; }
 
+  /*! Tells if the document has unsaved changes
+
+    \param saved false means: The document has been modified, which makes the
+                 renderings in m_renderCache outdated.
+   */
   void SetSaved(bool saved)
-  { m_saved = saved; }
+  {
+    if (!saved)
+      m_contentVersion++;
+    m_saved = saved;
+  }
 
   void RemoveAllOutput();
 
@@ -1282,6 +1433,16 @@ public:
   //! The list of cells that have to be evaluated
   EvaluationQueue m_evaluationQueue;
 
+  /*! The evaluation queues of the additional maximas sections are evaluated in
+
+    Cells that are deleted are removed from these queues, too.
+    See wxMaxima::EvaluateSectionsInParallel().
+   */
+  std::list<EvaluationQueue *> m_sectionQueues;
+
+  //! Is this cell in any of the evaluation queues?
+  bool IsInEvaluationQueue(GroupCell *cell);
+
   // methods for folding
   GroupCell *UpdateMLast();
 
@@ -1409,12 +1570,53 @@ public:
 protected:
   void UpdateConfigurationClientSize();
 
+  //! Applies the background colour of the worksheet from the config
+  void ReadBackgroundColour();
+
+  /*! The region that needs to be redrawn if a GroupCell occupying rect has changed
+
+    Includes the cell bracket and the space between this cell and its neighbours.
+   */
+  wxRect GroupCellRedrawRect(wxRect rect);
+
+  //! Adds a rectangle to the region the next redraw will update
+  void AddToRectToRefresh(wxRect rect);
+
+public:
+  //! Invalidates a part of the window. Overridden in order to keep track of m_reusableRegion
+  virtual void Refresh(bool eraseBackground = true, const wxRect *rect = NULL);
+
+  /*! Called by wxScrolledCanvas on scrolling
+
+    Instead of rendering the whole window again this moves the part of m_memory
+    that stays visible and renders only the newly exposed strip. Falls back to
+    redrawing the whole window if the worksheet has changed since the last redraw.
+   */
+  virtual void ScrollWindow(int dx, int dy, const wxRect *rect = NULL);
+
+protected:
+
   //! The x position of the mouse pointer
   int m_pointer_x;
   //! The y position of the mouse pointer
   int m_pointer_y;
   //! Was there a mouse motion we didn't react to until now?
   bool m_mouseMotionWas;
+  //! The last bitmap and svg renderings of selections
+  RenderCache m_renderCache;
+  //! How many calls to BeginOutputBatch() haven't been matched by EndOutputBatch(), yet?
+  int m_outputBatchDepth;
+  //! The cell the output of the current batch has been appended to. NULL = none.
+  GroupCell *m_outputBatchGroup;
+  //! Measures how long the output of the current batch has been waiting
+  wxStopWatch m_outputBatchStopWatch;
+
+  /*! The key m_renderCache stores the renderings of the selection under
+
+    Identifies the selected cells by their addresses: Copying and converting
+    them to text for each lookup costs nearly as much as rendering them.
+   */
+  wxString RenderCacheKey(int scale);
 DECLARE_EVENT_TABLE()
 };
 
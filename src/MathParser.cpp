@@ -48,6 +48,7 @@
 #include "FunCell.h"
 #include "EditorCell.h"
 #include "ImgCell.h"
+#include "CollapsedCell.h"
 #include "SubSupCell.h"
 #include "SlideShowCell.h"
 #include "GroupCell.h"
@@ -366,6 +367,33 @@ MathCell *MathParser::ParseSupTag(wxXmlNode *node)
   return expt;
 }
 
+MathCell *MathParser::ParseCollapsedTag(wxXmlNode *node)
+{
+  CollapsedCell *collapsed = new CollapsedCell(NULL, m_configuration, m_cellPointers);
+  wxXmlNode *chunk = SkipWhitespaceNode(node->GetChildren());
+  while (chunk != NULL)
+  {
+    int style = MC_TYPE_DEFAULT;
+    if (chunk->GetAttribute(wxT("type")) == wxT("error"))
+      style = MC_TYPE_ERROR;
+    if (chunk->GetAttribute(wxT("type")) == wxT("warning"))
+      style = MC_TYPE_WARNING;
+    if (chunk->GetAttribute(wxT("type")) == wxT("prompt"))
+      style = MC_TYPE_PROMPT;
+
+    // The xml parser might have split the text into several nodes.
+    wxString xml;
+    for (wxXmlNode *text = chunk->GetChildren(); text != NULL; text = text->GetNext())
+      xml += text->GetContent();
+    if (xml != wxEmptyString)
+      collapsed->AppendXML(xml, style, chunk->GetAttribute(wxT("userdefinedlabel")));
+
+    chunk = GetNextTag(chunk);
+  }
+  collapsed->SetExpandWhenVisible(true);
+  return collapsed;
+}
+
 MathCell *MathParser::ParseSubSupTag(wxXmlNode *node)
 {
   SubSupCell *subsup = new SubSupCell(NULL, m_configuration, m_cellPointers);
@@ -806,6 +834,10 @@ MathCell *MathParser::ParseTag(wxXmlNode *node, bool all)
       {
         tmp = ParseTableTag(node);
       }
+      else if (tagName == wxT("collapsed"))
+      {
+        tmp = ParseCollapsedTag(node);
+      }
       else if ((tagName == wxT("mth")) || (tagName == wxT("line")))
       {
         tmp = ParseTag(node->GetChildren());
@@ -996,65 +1028,45 @@ MathCell *MathParser::ParseTag(wxXmlNode *node, bool all)
  * Put the result in line.
  */
 MathCell *MathParser::ParseLine(wxString s, int style)
+{
+  long showLength = (*m_configuration)->ShowLengthChars();
+
+  if (((long) s.Length() < showLength) || (showLength == 0))
+    return ParseXML(s, style);
+
+  // Don't parse and layout the expression before the user asks us to.
+  CollapsedCell *cell = new CollapsedCell(NULL, m_configuration, m_cellPointers);
+  cell->AppendXML(s, style, m_userDefinedLabel);
+  return cell;
+}
+
+MathCell *MathParser::ParseXML(wxString s, int style)
 {
   m_ParserStyle = style;
   m_FracStyle = FracCell::FC_NORMAL;
   m_highlight = false;
   MathCell *cell = NULL;
 
-  int showLength;
-  
-  switch ((*m_configuration)->ShowLength())
-  {
-    case 0:
-      showLength = 50000;
-      break;
-    case 1:
-      showLength = 500000;
-      break;
-    case 2:
-      showLength = 5000000;
-      break;
-    case 3:
-      showLength = 0;
-      break;
-  default:
-      showLength = 50000;    
-  }
-
 #if wxUSE_UNICODE
   m_graphRegex.Replace(&s, wxT("\xFFFD"));
 #else
   m_graphRegex.Replace(&s, wxT("?"));
 #endif
 
-  if (((long) s.Length() < showLength) || (showLength == 0))
-  {
-
-    wxXmlDocument xml;
+  wxXmlDocument xml;
 
 #if wxUSE_UNICODE
-    wxStringInputStream xmlStream(s);
+  wxStringInputStream xmlStream(s);
 #else
-    wxString su(s.wc_str(*wxConvCurrent), wxConvUTF8);
-    wxStringInputStream xmlStream(su);
+  wxString su(s.wc_str(*wxConvCurrent), wxConvUTF8);
+  wxStringInputStream xmlStream(su);
 #endif
 
-    xml.Load(xmlStream, wxT("UTF-8"), wxXMLDOC_KEEP_WHITESPACE_NODES);
+  xml.Load(xmlStream, wxT("UTF-8"), wxXMLDOC_KEEP_WHITESPACE_NODES);
 
-    wxXmlNode *doc = xml.GetRoot();
+  wxXmlNode *doc = xml.GetRoot();
 
-    if (doc != NULL)
-      cell = ParseTag(doc->GetChildren());
-  }
-  else
-  {
-    cell = new TextCell(NULL, m_configuration, m_cellPointers,
-                        _(" << Expression longer than allowed by the configuration setting! >>"));
-    cell->SetToolTip(_("The maximum size of a expression wxMaxima is allowed to be displayed"
-                       "can be changed in the configuration dialogue."
-                       ));
-    cell->ForceBreakLine(true);
-  }
+  if (doc != NULL)
+    cell = ParseTag(doc->GetChildren());
   return cell;
 }
@@ -49,8 +49,16 @@ public:
   ~MathParser();
 
   void SetUserLabel(wxString label){ m_userDefinedLabel = label; }
+  /*! Parses a line of maxima's output
+
+    Expressions that are longer than the configured maximum length are
+    returned as a CollapsedCell that is only parsed on demand.
+   */
   MathCell *ParseLine(wxString s, int style = MC_TYPE_DEFAULT);
 
+  //! Parses a xml fragment regardless of its length
+  MathCell *ParseXML(wxString s, int style = MC_TYPE_DEFAULT);
+
   MathCell *ParseTag(wxXmlNode *node, bool all = true);
 
 private:
@@ -127,6 +135,9 @@ private:
 
   MathCell *ParseSubSupTag(wxXmlNode *node);
 
+  //! Restores a CollapsedCell without parsing its contents, see CollapsedCell::ToXML()
+  MathCell *ParseCollapsedTag(wxXmlNode *node);
+
   wxString m_userDefinedLabel;
   wxRegEx m_graphRegex;
 
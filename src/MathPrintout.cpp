@@ -29,6 +29,9 @@
 #include "GroupCell.h"
 
 #include <wx/config.h>
+#if wxUSE_POSTSCRIPT
+#include <wx/dcps.h>
+#endif
 
 #define PRINT_MARGIN_HORIZONTAL 5
 #define PRINT_MARGIN_VERTICAL 5
@@ -37,14 +40,39 @@ MathPrintout::MathPrintout(wxString title, Configuration **configuration) : wxPr
 {
   m_configuration = configuration;
   m_oldconfig = *m_configuration;
+  m_printConfig = NULL;
   m_numberOfPages = 0;
   m_tree = NULL;
+  m_layoutPageSize = wxSize(-1, -1);
+  m_layoutScale = -1;
+  m_fontSize = 12;
+  wxConfig::Get()->Read(wxT("fontsize"), &m_fontSize);
 }
 
 MathPrintout::~MathPrintout()
 {
   DestroyTree();
   *m_configuration = m_oldconfig;
+  wxDELETE(m_printConfig);
+}
+
+Configuration *MathPrintout::GetPrintConfiguration(wxDC *dc)
+{
+  if (m_printConfig == NULL)
+  {
+    m_printConfig = new Configuration(*dc);
+    m_printConfig->ShowCodeCells(m_oldconfig->ShowCodeCells());
+    m_printConfig->ShowBrackets(m_printConfig->PrintBrackets());
+    m_printConfig->LineWidth_em(400);
+    // Inform the output routines that we are printing
+    m_printConfig->SetPrinter(true);
+  }
+  else
+    m_printConfig->SetContext(*dc);
+
+  m_printConfig->SetScale(GetPPIScale());
+  *m_configuration = m_printConfig;
+  return m_printConfig;
 }
 
 void MathPrintout::SetData(GroupCell *tree)
@@ -73,24 +101,10 @@ bool MathPrintout::OnPrintPage(int num)
   int marginX, marginY;
   GetPageMargins(&marginX, &marginY);
 
-
-  Configuration configuration(*dc);
-  *m_configuration = &configuration;
-  configuration.ShowCodeCells(m_oldconfig->ShowCodeCells());
-  configuration.ShowBrackets(configuration.PrintBrackets());
-  configuration.SetScale(ppiScale);
-  configuration.LineWidth_em(400);
-  int pageWidth, pageHeight;
-  GetPageSizePixels(&pageWidth, &pageHeight);
-  double scale = GetPPIScale();
-
-  configuration.SetClientWidth(pageWidth - 2 * marginX
-                               - MathCell::Scale_Px((*m_configuration)->GetBaseIndent(), scale));
-  configuration.SetClientHeight(pageHeight - 2 * marginY);
-
-  configuration.SetIndent(marginX);
-  // Inform the output routines that we are printing
-  configuration.SetPrinter(true);
+  // The layout has been calculated in OnPreparePrinting(): We only need to
+  // point the configuration to the dc of the current page.
+  Configuration *configuration = GetPrintConfiguration(dc);
+  configuration->SetIndent(marginX);
   // Make sure that during print nothing is outside the crop rectangle
 
   marginX += MathCell::Scale_Px((*m_configuration)->GetBaseIndent(), ppiScale);
@@ -112,12 +126,8 @@ bool MathPrintout::OnPrintPage(int num)
     wxPoint point;
     point.x = marginX;
     point.y = marginY + tmp->GetMaxCenter() + GetHeaderHeight();
-    wxConfigBase *config = wxConfig::Get();
-    int fontsize = 12;
     int drop = tmp->GetMaxDrop();
 
-    config->Read(wxT("fontsize"), &fontsize);
-
     PrintHeader(num, dc, ppiScale);
     MathCell::ClipToDrawRegion(false);
 
@@ -127,7 +137,7 @@ bool MathPrintout::OnPrintPage(int num)
       // cells aren't printed" problem on linux.
       // No Idea why, though.
       dc->SetPen(wxPen(wxT("light grey"), 1, wxPENSTYLE_SOLID));
-      tmp->Draw(point, fontsize);
+      tmp->Draw(point, m_fontSize);
       if (tmp->m_next != NULL)
       {
         point.x = marginX;
@@ -172,6 +182,7 @@ void MathPrintout::BreakPages()
   int skip = MathCell::Scale_Px((*m_configuration)->GetGroupSkip(), scale);;
 
   GroupCell *tmp = dynamic_cast<GroupCell *>(m_tree);
+  m_pages.clear();
   m_pages.push_back(tmp);
 
   m_numberOfPages = 1;
@@ -200,8 +211,12 @@ void MathPrintout::BreakPages()
 
 void MathPrintout::SetupData()
 {
+  wxSize oldPageSize = m_layoutPageSize;
+  double oldScale = m_layoutScale;
   Recalculate();
-  BreakPages();
+  // Page breaks only change if the layout has changed.
+  if ((m_pages.empty()) || (oldPageSize != m_layoutPageSize) || (oldScale != m_layoutScale))
+    BreakPages();
 }
 
 void MathPrintout::GetPageInfo(int *minPage, int *maxPage,
@@ -270,29 +285,28 @@ void MathPrintout::Recalculate()
   GroupCell *tmp = m_tree;
 
   wxDC *dc = GetDC();
-  Configuration configuration(*dc);
-  *m_configuration = &configuration;
-  configuration.ShowCodeCells(m_oldconfig->ShowCodeCells());
-  configuration.SetScale(GetPPIScale());
-  configuration.LineWidth_em(400);
-  configuration.ShowBrackets(configuration.PrintBrackets());
-  configuration.SetScale(GetPPIScale());
-  configuration.LineWidth_em(400);
+  Configuration *configuration = GetPrintConfiguration(dc);
 
   int marginX, marginY;
   GetPageMargins(&marginX, &marginY);
   int pageWidth, pageHeight;
   GetPageSizePixels(&pageWidth, &pageHeight);
-  int scale = configuration.GetScale();
+  double scale = configuration->GetScale();
 
-  configuration.SetClientWidth(pageWidth - 2 * marginX
-                               - MathCell::Scale_Px((*m_configuration)->GetBaseIndent(), scale));
-  configuration.SetClientHeight(pageHeight - 2 * marginY);
+  // Laying out a big document is expensive => only do so if the page geometry
+  // has changed since the last time.
+  if ((m_layoutPageSize == wxSize(pageWidth, pageHeight)) && (m_layoutScale == scale))
+    return;
+  m_layoutPageSize = wxSize(pageWidth, pageHeight);
+  m_layoutScale = scale;
+
+  configuration->SetClientWidth(pageWidth - 2 * marginX
+                                - MathCell::Scale_Px(configuration->GetBaseIndent(), scale));
+  configuration->SetClientHeight(pageHeight - 2 * marginY);
 
-  configuration.SetCanvasSize(wxSize(pageWidth - marginX, pageHeight - marginY));
-  marginX += MathCell::Scale_Px(configuration.GetBaseIndent(), scale);
-  configuration.SetIndent(marginX);
-  configuration.SetPrinter(true);
+  configuration->SetCanvasSize(wxSize(pageWidth - marginX, pageHeight - marginY));
+  marginX += MathCell::Scale_Px(configuration->GetBaseIndent(), scale);
+  configuration->SetIndent(marginX);
   MathCell::ClipToDrawRegion(false);
 
   while (tmp != NULL)
@@ -335,6 +349,52 @@ void MathPrintout::GetScreenScale(double *scaleX, double *scaleY)
   *scaleY = ((double) previewSizeY) / ((double) pageSizeY);
 }
 
+#if wxUSE_POSTSCRIPT
+bool MathPrintout::ExportToPostScript(wxString file)
+{
+  wxPrintData printData;
+  printData.SetPrintMode(wxPRINT_MODE_FILE);
+  printData.SetFilename(file);
+  wxPostScriptDC dc(printData);
+  if (!dc.IsOk())
+    return false;
+
+  // Tell the printout about the geometry of the "printer" the same way
+  // wxPrinter would do.
+  SetDC(&dc);
+  wxSize ppiScreen = wxGetDisplayPPI();
+  wxSize ppiPrinter = dc.GetPPI();
+  SetPPIScreen(ppiScreen.x, ppiScreen.y);
+  SetPPIPrinter(ppiPrinter.x, ppiPrinter.y);
+  int pageWidth, pageHeight;
+  dc.GetSize(&pageWidth, &pageHeight);
+  SetPageSizePixels(pageWidth, pageHeight);
+  SetPaperRectPixels(wxRect(0, 0, pageWidth, pageHeight));
+  int pageWidthMM, pageHeightMM;
+  dc.GetSizeMM(&pageWidthMM, &pageHeightMM);
+  SetPageSizeMM(pageWidthMM, pageHeightMM);
+
+  OnPreparePrinting();
+
+  int minPage, maxPage, fromPage, toPage;
+  GetPageInfo(&minPage, &maxPage, &fromPage, &toPage);
+
+  OnBeginPrinting();
+  bool success = OnBeginDocument(fromPage, toPage);
+  for (int page = fromPage; success && (page <= toPage) && HasPage(page); page++)
+  {
+    dc.StartPage();
+    success = OnPrintPage(page);
+    dc.EndPage();
+  }
+  if (success)
+    OnEndDocument();
+  OnEndPrinting();
+  SetDC(NULL);
+  return success;
+}
+#endif
+
 void MathPrintout::DestroyTree()
 {
   wxDELETE(m_tree);
@@ -57,6 +57,11 @@ public:
 
   void BreakPages();
 
+  /*! Lay out the tree at the page scale
+
+    Does nothing if the tree already has been laid out for the current page size
+    and resolution.
+   */
   void Recalculate();
 
   bool OnPrintPage(int num);
@@ -79,12 +84,38 @@ public:
 
   void GetScreenScale(double *scaleX, double *scaleY);
 
+#if wxUSE_POSTSCRIPT
+  /*! Print the tree into a PostScript file without any dialogue
+
+    Uses the same layout and page breaking the printer would use.
+    \return false, if the file couldn't be written.
+   */
+  bool ExportToPostScript(wxString file);
+#endif
+
 private:
+  /*! Returns the configuration that is used for laying out and drawing the pages
+
+    The configuration is only created once per printout: Creating a
+    Configuration means reading the settings from the config storage
+    and checking which fonts are installed which is too expensive to do
+    once per page.
+   */
+  Configuration *GetPrintConfiguration(wxDC *dc);
+
   Configuration **m_configuration, *m_oldconfig;
+  //! The configuration all pages are laid out and drawn with
+  Configuration *m_printConfig;
   int m_numberOfPages;
   wxString m_title;
   GroupCell *m_tree;
   vector<GroupCell *> m_pages;
+  //! The page size the tree has been laid out for. (-1,-1) means: Not laid out yet.
+  wxSize m_layoutPageSize;
+  //! The scale the tree has been laid out for.
+  double m_layoutScale;
+  //! The font size the cells are drawn with
+  int m_fontSize;
 };
 
 #endif // MATHPRINTOUT_H
@@ -27,6 +27,12 @@
 */
 
 #include "MatrCell.h"
+#include "GroupCell.h"
+
+//! Matrices with more elements than this are laid out lazily, see MatrCell::LayOutRows()
+#define MATRIX_LAZY_ELEMENTS 2500
+//! The number of rows of a lazily laid out matrix that are laid out in advance
+#define MATRIX_LAZY_ROWS 50
 
 MatrCell::MatrCell(MathCell *parent, Configuration **config, CellPointers *cellPointers) : MathCell(parent, config)
 {
@@ -36,6 +42,10 @@ MatrCell::MatrCell(MathCell *parent, Configuration **config, CellPointers *cellP
   m_specialMatrix = false;
   m_inferenceMatrix = false;
   m_rowNames = m_colNames = false;
+  m_layoutFontSize = -1;
+  m_layoutScale = -1;
+  m_rowsLaidOut = 0;
+  m_estimatedCenter = m_estimatedDrop = 0;
 }
 
 void MatrCell::SetParent(MathCell *parent)
@@ -105,23 +115,44 @@ void MatrCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
-void MatrCell::RecalculateWidths(int fontsize)
+size_t MatrCell::SizeInMemory()
+{
+  size_t size = MathCell::SizeInMemory();
+  for (unsigned int i = 0; i < m_cells.size(); i++)
+    size += SizeInMemoryList(m_cells[i]);
+  return size;
+}
+
+void MatrCell::LayOutRows(int first, int last)
 {
   Configuration *configuration = (*m_configuration);
   double scale = configuration->GetScale();
-  for (int i = 0; i < m_matWidth * m_matHeight; i++)
-  {
-    m_cells[i]->RecalculateWidthsList(MAX(MC_MIN_SIZE, fontsize - 2));
-  }
-  m_widths.clear();
-  for (int i = 0; i < m_matWidth; i++)
+  int fontsize = MAX(MC_MIN_SIZE, m_layoutFontSize - 2);
+
+  // The widths of the columns grow with every row that is laid out.
+  for (int j = first; j < last; j++)
   {
-    m_widths.push_back(0);
-    for (int j = 0; j < m_matHeight; j++)
+    if (m_rowLaidOut[j])
+      continue;
+    m_rowLaidOut[j] = true;
+    m_rowsLaidOut++;
+    m_centers[j] = 0;
+    m_drops[j] = 0;
+    for (int i = 0; i < m_matWidth; i++)
     {
-      m_widths[i] = MAX(m_widths[i], m_cells[m_matWidth * j + i]->GetFullWidth(scale));
+      MathCell *cell = m_cells[m_matWidth * j + i];
+      cell->RecalculateWidthsList(fontsize);
+      cell->RecalculateHeightList(fontsize);
+      m_widths[i] = MAX(m_widths[i], cell->GetFullWidth(scale));
+      m_centers[j] = MAX(m_centers[j], cell->GetMaxCenter());
+      m_drops[j] = MAX(m_drops[j], cell->GetMaxDrop());
     }
   }
+}
+
+void MatrCell::UpdateWidth()
+{
+  double scale = (*m_configuration)->GetScale();
   m_width = 0;
   for (int i = 0; i < m_matWidth; i++)
   {
@@ -129,40 +160,81 @@ void MatrCell::RecalculateWidths(int fontsize)
   }
   if (m_width < Scale_Px(14, scale))
     m_width = Scale_Px(14, scale);
-  ResetData();
 }
 
-void MatrCell::RecalculateHeight(int fontsize)
+void MatrCell::UpdateHeight()
 {
-  Configuration *configuration = (*m_configuration);
-  double scale = configuration->GetScale();
+  double scale = (*m_configuration)->GetScale();
 
-  for (int i = 0; i < m_matWidth * m_matHeight; i++)
-  {
-    m_cells[i]->RecalculateHeightList(MAX(MC_MIN_SIZE, fontsize - 2));
-  }
-  m_centers.clear();
-  m_drops.clear();
-  for (int i = 0; i < m_matHeight; i++)
-  {
-    m_centers.push_back(0);
-    m_drops.push_back(0);
-    for (int j = 0; j < m_matWidth; j++)
-    {
-      m_centers[i] = MAX(m_centers[i], m_cells[m_matWidth * i + j]->GetMaxCenter());
-      m_drops[i] = MAX(m_drops[i], m_cells[m_matWidth * i + j]->GetMaxDrop());
-    }
-  }
   m_height = 0;
   for (int i = 0; i < m_matHeight; i++)
   {
     m_height += (m_centers[i] + m_drops[i] + Scale_Px(10, scale));
   }
   if (m_height == 0)
-    m_height = fontsize + Scale_Px(10, scale);
+    m_height = m_layoutFontSize + Scale_Px(10, scale);
   m_center = m_height / 2;
 }
 
+void MatrCell::RecalculateWidths(int fontsize)
+{
+  Configuration *configuration = (*m_configuration);
+  double scale = configuration->GetScale();
+
+  // A big matrix contains many cells => we only lay them out again if
+  // something has changed since the last time.
+  if ((m_width < 0) || (m_widths.size() != (unsigned int) m_matWidth) ||
+      (m_layoutFontSize != fontsize) || (m_layoutScale != scale) ||
+      configuration->ForceUpdate())
+  {
+    m_layoutFontSize = fontsize;
+    m_layoutScale = scale;
+    m_rowsLaidOut = 0;
+    m_rowLaidOut.assign(m_matHeight, false);
+    m_widths.assign(m_matWidth, 0);
+    m_centers.assign(m_matHeight, 0);
+    m_drops.assign(m_matHeight, 0);
+
+    // On the screen only the first rows of a big matrix are laid out now,
+    // the rest once they are scrolled into view, see Draw().
+    int rows = m_matHeight;
+    if (configuration->LazyLayout() && (m_matWidth * m_matHeight > MATRIX_LAZY_ELEMENTS))
+      rows = MIN(m_matHeight, MATRIX_LAZY_ROWS);
+    LayOutRows(0, rows);
+
+    // The other rows are assumed to be as high as the average of these.
+    // The estimate isn't updated later so laying out a row doesn't move the
+    // rows above it.
+    if (rows > 0)
+    {
+      long centers = 0, drops = 0;
+      for (int j = 0; j < rows; j++)
+      {
+        centers += m_centers[j];
+        drops += m_drops[j];
+      }
+      m_estimatedCenter = centers / rows;
+      m_estimatedDrop = drops / rows;
+      for (int j = rows; j < m_matHeight; j++)
+      {
+        m_centers[j] = m_estimatedCenter;
+        m_drops[j] = m_estimatedDrop;
+      }
+    }
+  }
+  UpdateWidth();
+  ResetData();
+
+  // Our GroupCell must not draw all of us into its output cache.
+  if ((m_rowsLaidOut < m_matHeight) && (dynamic_cast<GroupCell *>(m_group) != NULL))
+    dynamic_cast<GroupCell *>(m_group)->OutputLaidOutLazily();
+}
+
+void MatrCell::RecalculateHeight(int fontsize)
+{
+  UpdateHeight();
+}
+
 void MatrCell::Draw(wxPoint point, int fontsize)
 {
   if (DrawThisCell(point) && InUpdateRegion())
@@ -172,20 +244,73 @@ void MatrCell::Draw(wxPoint point, int fontsize)
     wxDC &dc = configuration->GetDC();
     double scale = configuration->GetScale();
     wxPoint mp;
-    mp.x = point.x + Scale_Px(5, scale);
-    mp.y = point.y - m_center;
-    for (int i = 0; i < m_matWidth; i++)
+    wxRect updateRegion = GetUpdateRegion();
+
+    // Our GroupCell has placed us for the size we had before the rows below
+    // were laid out.
+    int top = point.y - m_center;
+
+    // Lay out the rows of a lazily laid out matrix that are about to be drawn.
+    if (m_rowsLaidOut < m_matHeight)
+    {
+      int first = 0;
+      int last = m_matHeight;
+      if (!Printing())
+      {
+        // The rows that intersect with the update region
+        first = m_matHeight;
+        last = 0;
+        int y = top + Scale_Px(5, scale);
+        for (int j = 0; (j < m_matHeight) && (y <= updateRegion.GetBottom()); j++)
+        {
+          int bottom = y + m_centers[j] + m_drops[j];
+          if (bottom >= updateRegion.GetTop())
+          {
+            first = MIN(first, j);
+            last = j + 1;
+          }
+          y = bottom + Scale_Px(10, scale);
+        }
+      }
+      if (first < last)
+      {
+        int oldWidth = m_width;
+        int oldHeight = m_height;
+        LayOutRows(first, last);
+        UpdateWidth();
+        UpdateHeight();
+        ResetData();
+        // Our size was only an estimate => the cells of our GroupCell and
+        // the ones below need to make room. The rest of the worksheet
+        // doesn't need to be laid out again.
+        if (((m_width != oldWidth) || (m_height != oldHeight)) && (m_group != NULL))
+        {
+          m_group->ResetSize();
+          m_cellPointers->m_recalculationRequests.push_back(m_group);
+        }
+      }
+    }
+
+    mp.y = top + Scale_Px(5, scale);
+    for (int j = 0; j < m_matHeight; j++)
     {
-      mp.y = point.y - m_center + Scale_Px(5, scale);
-      for (int j = 0; j < m_matHeight; j++)
+      mp.y += m_centers[j];
+      // Drawing the rows of a big matrix that aren't in the region we
+      // currently update would only cost time.
+      if (Printing() ||
+          ((mp.y + m_drops[j] >= updateRegion.GetTop()) &&
+           (mp.y - m_centers[j] <= updateRegion.GetBottom())))
       {
-        mp.y += m_centers[j];
-        wxPoint mp1(mp);
-        mp1.x = mp.x + (m_widths[i] - m_cells[j * m_matWidth + i]->GetFullWidth(scale)) / 2;
-        m_cells[j * m_matWidth + i]->DrawList(mp1, MAX(MC_MIN_SIZE, fontsize - 2));
-        mp.y += (m_drops[j] + Scale_Px(10, scale));
+        mp.x = point.x + Scale_Px(5, scale);
+        for (int i = 0; i < m_matWidth; i++)
+        {
+          wxPoint mp1(mp);
+          mp1.x = mp.x + (m_widths[i] - m_cells[j * m_matWidth + i]->GetFullWidth(scale)) / 2;
+          m_cells[j * m_matWidth + i]->DrawList(mp1, MAX(MC_MIN_SIZE, fontsize - 2));
+          mp.x += (m_widths[i] + Scale_Px(10, scale));
+        }
       }
-      mp.x += (m_widths[i] + Scale_Px(10, scale));
+      mp.y += (m_drops[j] + Scale_Px(10, scale));
     }
     SetPen(1.5);
     if (m_specialMatrix)
@@ -38,6 +38,8 @@ public:
 
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   virtual wxString GetToolTip(const wxPoint &point);
 
   MathCell *Copy();
@@ -99,6 +101,33 @@ protected:
   vector<int> m_widths;
   vector<int> m_drops;
   vector<int> m_centers;
+  //! The font size the rows were laid out for
+  int m_layoutFontSize;
+  //! The scale the rows were laid out for
+  double m_layoutScale;
+  /*! Which rows have had their elements laid out?
+
+    Big matrices on the screen lay out their rows only when they are drawn the
+    first time. Until then each row is assumed to be m_estimatedCenter +
+    m_estimatedDrop high and doesn't contribute to the column widths.
+   */
+  vector<bool> m_rowLaidOut;
+  //! The number of rows in m_rowLaidOut that have been laid out
+  int m_rowsLaidOut;
+  //! The center of the rows that haven't been laid out, yet
+  int m_estimatedCenter;
+  //! The drop of the rows that haven't been laid out, yet
+  int m_estimatedDrop;
+
+  /*! Lays out the elements of the rows first...last-1 that haven't been laid out, yet
+
+    Updates the widths of the columns and the heights of these rows.
+   */
+  void LayOutRows(int first, int last);
+  //! Calculates m_width from the widths of the columns
+  void UpdateWidth();
+  //! Calculates m_height and m_center from the heights of the rows
+  void UpdateHeight();
 
 private:
   CellPointers *m_cellPointers;
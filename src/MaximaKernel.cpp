@@ -0,0 +1,350 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class MaximaKernel
+
+  MaximaKernel is an additional maxima process a section of the worksheet can be
+  evaluated in while the rest of the worksheet is evaluated by other maximas.
+*/
+
+#include "MaximaKernel.h"
+
+MaximaKernel::MaximaKernel(int number, long session)
+{
+  m_number = number;
+  m_session = session;
+  m_server = NULL;
+  m_client = NULL;
+  m_process = NULL;
+  m_pid = -1;
+  m_ready = false;
+  m_cell = NULL;
+  m_inPreamble = false;
+  m_outputCount = 0;
+  m_searched = 0;
+  m_lastPrompt = wxT("(%i1) ");
+}
+
+void MaximaKernel::SetMarkers(wxString promptPrefix, wxString promptSuffix,
+                              wxString symbolsPrefix, wxString symbolsSuffix, wxString framePrefix)
+{
+  m_promptPrefix = promptPrefix;
+  m_promptSuffix = promptSuffix;
+  m_symbolsPrefix = symbolsPrefix;
+  m_symbolsSuffix = symbolsSuffix;
+  m_framePrefix = framePrefix;
+}
+
+MaximaKernel::~MaximaKernel()
+{
+  if (m_process != NULL)
+  {
+    m_process->Detach();
+    if (m_pid > 0)
+      wxProcess::Kill(m_pid, wxSIGKILL);
+    else if (m_process->GetPid() > 0)
+      wxProcess::Kill(m_process->GetPid(), wxSIGKILL);
+  }
+
+  if (m_client != NULL)
+  {
+    m_client->Notify(false);
+    m_client->Destroy();
+  }
+
+  if (m_server != NULL)
+  {
+    m_server->Notify(false);
+    m_server->Destroy();
+  }
+}
+
+int MaximaKernel::StartServer(wxEvtHandler *handler, int id, int port)
+{
+  for (int i = 0; i < 50; i++)
+  {
+    wxIPV4address addr;
+#ifndef __WXMAC__
+    addr.LocalHost();
+#else
+    addr.AnyAddress();
+#endif
+    addr.Service(port + i);
+
+    m_server = new wxSocketServer(addr);
+    if (m_server->Ok())
+    {
+      m_server->SetEventHandler(*handler, id);
+      m_server->SetNotify(wxSOCKET_CONNECTION_FLAG);
+      m_server->Notify(true);
+      return port + i;
+    }
+    m_server->Destroy();
+    m_server = NULL;
+  }
+  return -1;
+}
+
+bool MaximaKernel::StartProcess(wxEvtHandler *handler, int id, int stdoutId, int stderrId,
+                                wxString command)
+{
+  m_process = new MaximaProcess(handler, id);
+  if (wxExecute(command, wxEXEC_ASYNC, m_process) < 0)
+  {
+    m_process = NULL;
+    return false;
+  }
+  // A maxima whose pipes nobody empties blocks as soon as they are full.
+  m_process->StartReading(stdoutId, stderrId);
+  return true;
+}
+
+bool MaximaKernel::Connect(wxEvtHandler *handler, int id, wxString setup)
+{
+  if ((m_server == NULL) || (m_client != NULL))
+    return false;
+
+  m_client = m_server->Accept(false);
+  if (m_client == NULL)
+    return false;
+
+  m_client->SetEventHandler(*handler, id);
+  m_client->SetNotify(wxSOCKET_INPUT_FLAG | wxSOCKET_LOST_FLAG);
+  m_client->Notify(true);
+
+  // Only one maxima is supposed to connect to us.
+  m_server->Notify(false);
+
+  Send(NULL, setup);
+  return true;
+}
+
+void MaximaKernel::Send(GroupCell *cell, wxString command, bool preamble)
+{
+  if (m_client == NULL)
+    return;
+
+  m_cell = cell;
+  m_inPreamble = preamble;
+  m_outputCount = 0;
+#if wxUSE_UNICODE
+  m_client->Write(command.utf8_str(), strlen(command.utf8_str()));
+#else
+  m_client->Write(command.c_str(), command.Length());
+#endif
+}
+
+bool MaximaKernel::ReadSetupDone(wxString marker)
+{
+  if (m_ready)
+    return true;
+
+  size_t end = FindEnd(0, 0, marker);
+  if (end == wxString::npos)
+    return false;
+
+  // The process id of the lisp: The pid of the process we have started
+  // might be the one of the script that has started the lisp.
+  int s = m_output.Left(end).Find(wxT("pid="));
+  if (s != wxNOT_FOUND)
+  {
+    wxString pid = m_output.Mid(s + 4).BeforeFirst(wxT('\n'));
+    pid.Trim().ToLong(&m_pid);
+  }
+
+  m_output = m_output.Mid(end + marker.Length());
+  m_searched = 0;
+  m_ready = true;
+  return true;
+}
+
+//! Does the marker start at this position of the string?
+static bool StartsAt(const wxString &str, size_t pos, const wxString &marker)
+{
+  return str.compare(pos, marker.Length(), marker) == 0;
+}
+
+size_t MaximaKernel::FindEnd(size_t start, size_t from, const wxString &end)
+{
+  // The end marker might begin in the part of the output that has already
+  // been searched.
+  if (start + m_searched + 1 > from + end.Length())
+    from = start + m_searched + 1 - end.Length();
+
+  size_t pos = m_output.find(end, from);
+  if (pos == wxString::npos)
+    m_searched = m_output.Length() - start;
+  return pos;
+}
+
+size_t MaximaKernel::TextEnd(size_t start)
+{
+  // All markers begin with a "<".
+  const wxString markers[] = {wxT("<mth>"), wxT("<statusbar>"), m_promptPrefix, m_symbolsPrefix, m_framePrefix};
+  const size_t markerCount = sizeof(markers) / sizeof(markers[0]);
+
+  size_t pos = start;
+  while ((pos = m_output.find(wxT('<'), pos)) != wxString::npos)
+  {
+    for (size_t i = 0; i < markerCount; i++)
+    {
+      // A marker that hasn't been received completely, yet, ends the text, too.
+      size_t length = wxMin(markers[i].Length(), m_output.Length() - pos);
+      if (m_output.compare(pos, length, markers[i], 0, length) == 0)
+        return pos - start;
+    }
+    pos++;
+  }
+  return m_output.Length() - start;
+}
+
+void MaximaKernel::ReadOutput(std::list<Output> &output)
+{
+  size_t start = 0;
+  while (start < m_output.Length())
+  {
+    size_t next = wxString::npos;
+    if (StartsAt(m_output, start, m_promptPrefix))
+    {
+      size_t end = FindEnd(start, start + m_promptPrefix.Length(), m_promptSuffix);
+      if (end != wxString::npos)
+      {
+        output.push_back(Output(Output::prompt, m_output.Mid(start + m_promptPrefix.Length(),
+                                                             end - start - m_promptPrefix.Length())));
+        next = end + m_promptSuffix.Length();
+      }
+    }
+    else if (StartsAt(m_output, start, wxT("<mth>")))
+    {
+      size_t end = FindEnd(start, start + 5, wxT("</mth>"));
+      if (end != wxString::npos)
+      {
+        next = end + 6;
+        output.push_back(Output(Output::math, m_output.Mid(start, next - start)));
+      }
+    }
+    else if (StartsAt(m_output, start, wxT("<statusbar>")))
+    {
+      size_t end = FindEnd(start, start + 11, wxT("</statusbar>"));
+      if (end != wxString::npos)
+      {
+        output.push_back(Output(Output::statusBar, m_output.Mid(start + 11, end - start - 11)));
+        next = end + 12;
+      }
+    }
+    else if (StartsAt(m_output, start, m_symbolsPrefix))
+    {
+      size_t end = FindEnd(start, start + m_symbolsPrefix.Length(), m_symbolsSuffix);
+      if (end != wxString::npos)
+      {
+        output.push_back(Output(Output::symbols, m_output.Mid(start + m_symbolsPrefix.Length(),
+                                                              end - start - m_symbolsPrefix.Length())));
+        next = end + m_symbolsSuffix.Length();
+      }
+    }
+    else if (StartsAt(m_output, start, m_framePrefix))
+    {
+      // The header <FRAME-type:length/> tells how long the message is.
+      size_t pos = start + m_framePrefix.Length();
+      size_t length = 0;
+      wxChar type = 0;
+      bool complete = false;
+      if (pos + 2 <= m_output.Length())
+      {
+        type = m_output[pos];
+        pos += 2;
+        while ((pos < m_output.Length()) && (m_output[pos] >= wxT('0')) && (m_output[pos] <= wxT('9')))
+          length = length * 10 + (m_output[pos++] - wxT('0'));
+        if (pos + 2 <= m_output.Length())
+        {
+          pos += 2;
+          complete = (pos + length <= m_output.Length());
+        }
+      }
+      if (complete)
+      {
+        wxString message = m_output.Mid(pos, length);
+        wxString startTag, endTag;
+        Output::Type outputType = Output::math;
+        switch (type)
+        {
+          case wxT('M'):
+            startTag = wxT("<mth>");
+            endTag = wxT("</mth>");
+            break;
+          case wxT('S'):
+            startTag = wxT("<statusbar>");
+            endTag = wxT("</statusbar>");
+            outputType = Output::statusBar;
+            break;
+          case wxT('Y'):
+            startTag = m_symbolsPrefix;
+            endTag = m_symbolsSuffix;
+            outputType = Output::symbols;
+            break;
+        }
+        // As in wxMaxima::ReadFrame(): If the lisp has counted bytes instead of
+        // characters we drop the header and read the message by its tags.
+        if ((startTag == wxEmptyString) || (!message.StartsWith(startTag)) || (!message.EndsWith(endTag)))
+          next = pos;
+        else
+        {
+          if (outputType != Output::math)
+            message = message.Mid(startTag.Length(), message.Length() - startTag.Length() - endTag.Length());
+          output.push_back(Output(outputType, message));
+          next = pos + length;
+        }
+      }
+    }
+    else
+    {
+      size_t length = TextEnd(start);
+      if (length > 0)
+      {
+        wxArrayString lines;
+        OutputClassifier::Type textType =
+          m_outputClassifier.Classify(m_output.begin() + start, m_output.begin() + start + length, lines);
+        if (!lines.IsEmpty())
+        {
+          Output::Type type = Output::text;
+          if (textType == OutputClassifier::error)
+            type = Output::error;
+          if (textType == OutputClassifier::warning)
+            type = Output::warning;
+          wxString text = lines[0];
+          for (size_t i = 1; i < lines.GetCount(); i++)
+            text += wxT("\n") + lines[i];
+          output.push_back(Output(type, text));
+        }
+        next = start + length;
+      }
+    }
+
+    // The rest of the output hasn't arrived, yet.
+    if (next == wxString::npos)
+      break;
+    start = next;
+    m_searched = 0;
+  }
+
+  if (start > 0)
+    m_output = m_output.Mid(start);
+}
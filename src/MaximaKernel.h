@@ -0,0 +1,263 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class MaximaKernel
+
+  MaximaKernel is an additional maxima process a section of the worksheet can be
+  evaluated in while the rest of the worksheet is evaluated by other maximas.
+*/
+
+#ifndef MAXIMAKERNEL_H
+#define MAXIMAKERNEL_H
+
+#include <wx/wx.h>
+#include <wx/socket.h>
+#include <wx/process.h>
+#include "EvaluationQueue.h"
+#include "MaximaProcess.h"
+#include "OutputClassifier.h"
+#include <list>
+
+/*! An additional maxima process with its own connection and evaluation queue
+
+  MaximaKernel handles the connection to the maxima process and splits its
+  output into pieces, see ReadOutput(). It keeps its own parse state so the
+  output of our main maxima and the one of the additional maximas never mix:
+  Placing the pieces in the worksheet is left to wxMaxima, see
+  wxMaxima::KernelEvent().
+ */
+class MaximaKernel
+{
+public:
+  //! A piece of the output maxima has sent, see ReadOutput()
+  struct Output
+  {
+    //! The kinds of output maxima sends
+    enum Type
+    {
+      math,      //!< A <mth> tag
+      text,      //!< Text outside of any tag
+      warning,   //!< Text outside of any tag that contains a warning
+      error,     //!< Text outside of any tag that contains an error message
+      symbols,   //!< Symbols for autocompletion
+      statusBar, //!< A message for the status bar
+      prompt     //!< A prompt: maxima has finished a command or asks a question
+    };
+
+    Output(Type type, wxString text)
+    {
+      m_type = type;
+      m_text = text;
+    }
+
+    Type m_type;
+    //! The math tag, the text or the contents of the other tags
+    wxString m_text;
+  };
+
+  /*! \param number The number the user sees this kernel by
+      \param session The number that identifies this maxima process, see GroupCell::Evaluated()
+   */
+  MaximaKernel(int number, long session);
+
+  /*! Tells the kernel the markers maxima's output is structured by
+
+    \param promptPrefix The text that precedes maxima's prompts
+    \param promptSuffix The text that follows maxima's prompts
+    \param symbolsPrefix The start of a list of symbols for autocompletion
+    \param symbolsSuffix The end of a list of symbols for autocompletion
+    \param framePrefix The start of the header that tells a message's length
+   */
+  void SetMarkers(wxString promptPrefix, wxString promptSuffix,
+                  wxString symbolsPrefix, wxString symbolsSuffix, wxString framePrefix);
+
+  //! Kills the maxima process and closes the connection to it
+  ~MaximaKernel();
+
+  /*! Starts the server the maxima process will connect to
+
+    \param handler The event handler the server's events are sent to
+    \param id The id of the server's events
+    \param port The first port to try
+    \return The port the server listens on, or -1 if no server could be started
+   */
+  int StartServer(wxEvtHandler *handler, int id, int port);
+
+  /*! Starts the maxima process
+
+    \param handler The event handler to send the wxProcessEvent and the process' output to
+    \param id The id of the wxProcessEvent
+    \param stdoutId The id of the events with data from maxima's stdout, see MaximaProcess
+    \param stderrId The id of the events with data from maxima's stderr
+    \param command The command that starts a maxima that connects to our server
+   */
+  bool StartProcess(wxEvtHandler *handler, int id, int stdoutId, int stderrId, wxString command);
+
+  /*! Accepts the connection of the maxima process and sends it its setup commands
+
+    \param handler The event handler the socket's events are sent to
+    \param id The id of the socket's events
+    \param setup The commands that set up maxima, see wxMaxima::SetupPayload()
+   */
+  bool Connect(wxEvtHandler *handler, int id, wxString setup);
+
+  //! Is this the socket server or the connection of this kernel?
+  bool Owns(wxSocketBase *socket)
+  { return (socket != NULL) && ((socket == m_server) || (socket == m_client)); }
+
+  //! Is this the process of this kernel?
+  bool OwnsProcess(wxProcess *process)
+  { return (m_process != NULL) && (process == m_process); }
+
+  //! To be called when the process has terminated
+  void ProcessTerminated()
+  { m_process = NULL; }
+
+  //! The connection to maxima
+  wxSocketBase *GetClient()
+  { return m_client; }
+
+  /*! Sends a command to maxima
+
+    \param cell The cell the command belongs to
+    \param command The command
+    \param preamble true means: The command is part of m_preamble.
+   */
+  void Send(GroupCell *cell, wxString command, bool preamble = false);
+
+  //! Appends data maxima has sent to the output that waits for being interpreted
+  void AddOutput(wxString data)
+  { m_output += data; }
+
+  /*! Looks for the marker maxima sends after having processed its setup commands
+
+    The greeting and the answer to the setup commands are discarded.
+    \return true, if maxima is ready to evaluate commands.
+   */
+  bool ReadSetupDone(wxString marker);
+
+  /*! Splits the output maxima has sent into the pieces that are complete
+
+    Everything up to the first piece that hasn't been received completely is
+    removed from the output. The next call continues the search for the end
+    of this piece where this one has stopped.
+    \param output The pieces are appended to this list
+   */
+  void ReadOutput(std::list<Output> &output);
+
+  //! Has maxima processed its setup commands?
+  bool IsReady()
+  { return m_ready; }
+
+  //! The cell of the command maxima is working on, or NULL if maxima is idle
+  GroupCell *GetCell()
+  { return m_cell; }
+
+  //! Does the command maxima is working on belong to m_preamble?
+  bool InPreamble()
+  { return m_inPreamble; }
+
+  //! To be called when maxima has finished the current command
+  void CommandFinished()
+  { m_cell = NULL; }
+
+  //! Counts the pieces of output of the current command and returns the count before this one
+  int CountOutput()
+  { return m_outputCount++; }
+
+  //! The number the user knows this kernel by
+  int GetNumber()
+  { return m_number; }
+
+  //! The number that identifies this maxima process, see GroupCell::Evaluated()
+  long GetSession()
+  { return m_session; }
+
+  //! The last input prompt maxima has sent
+  wxString GetLastPrompt()
+  { return m_lastPrompt; }
+
+  void SetLastPrompt(wxString prompt)
+  { m_lastPrompt = prompt; }
+
+  //! The cells this maxima still has to evaluate
+  EvaluationQueue m_evaluationQueue;
+
+  /*! The cells in front of the first section this maxima still has to evaluate
+
+    They are evaluated before the cells in m_evaluationQueue: They contain the
+    definitions the sections rely on. Their output is discarded as our main
+    maxima displays it. See wxMaxima::EvaluateSectionsInParallel().
+   */
+  EvaluationQueue m_preamble;
+
+private:
+  int m_number;
+  long m_session;
+  wxSocketServer *m_server;
+  wxSocketBase *m_client;
+  MaximaProcess *m_process;
+  //! The process id of the lisp maxima runs in
+  long m_pid;
+  bool m_ready;
+  //! The cell of the command maxima is working on
+  GroupCell *m_cell;
+  //! See InPreamble()
+  bool m_inPreamble;
+  //! See CountOutput()
+  int m_outputCount;
+  //! The output maxima has sent that hasn't been interpreted, yet
+  wxString m_output;
+  /*! How far the search for the end of the piece m_output starts with has got
+
+    Maxima might send big pieces of output in many chunks. Without remembering
+    where the search has stopped each chunk would cause the whole piece to be
+    searched again.
+   */
+  size_t m_searched;
+  wxString m_lastPrompt;
+  wxString m_promptPrefix;
+  wxString m_promptSuffix;
+  wxString m_symbolsPrefix;
+  wxString m_symbolsSuffix;
+  wxString m_framePrefix;
+  //! Tells error messages and warnings from ordinary text
+  OutputClassifier m_outputClassifier;
+
+  /*! Looks for the end of a piece of output
+
+    \param start The position the piece starts at
+    \param from The first position the end might be found at
+    \param end The marker that ends the piece
+    \return The position of the end marker or wxString::npos
+   */
+  size_t FindEnd(size_t start, size_t from, const wxString &end);
+
+  /*! Looks for the end of text that isn't part of a tag
+
+    \param start The position the text starts at
+    \return The length of the text. Text that might be the start of a tag
+            whose rest hasn't arrived, yet, isn't part of it.
+   */
+  size_t TextEnd(size_t start);
+};
+
+#endif // MAXIMAKERNEL_H
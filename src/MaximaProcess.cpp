@@ -0,0 +1,197 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class MaximaProcess
+
+  MaximaProcess is a maxima process whose stdout and stderr are read by
+  background threads.
+*/
+
+#include "MaximaProcess.h"
+#include <wx/app.h>
+#include <wx/stream.h>
+#include <wx/thread.h>
+#include <vector>
+
+//! The maximum number of bytes a reader thread reads at once
+#define PIPE_CHUNK_SIZE 65536
+//! How long [in milliseconds] we wait for the pipes to be closed after the process has terminated
+#define PIPE_EOF_TIMEOUT 2000
+
+/*! A thread that reads one pipe of a maxima process
+
+  wxInputStream::Read() blocks until data arrives and then returns all data
+  that is waiting in the pipe. The thread is detached and deletes itself once
+  the pipe has been closed.
+ */
+class MaximaPipeReader : public wxThread
+{
+public:
+  MaximaPipeReader(MaximaProcess *process, wxInputStream *stream, int id) :
+          wxThread(wxTHREAD_DETACHED)
+  {
+    m_process = process;
+    m_stream = stream;
+    m_id = id;
+  }
+
+protected:
+  virtual ExitCode Entry()
+  {
+    std::vector<char> buffer(PIPE_CHUNK_SIZE);
+    while (true)
+    {
+      m_stream->Read(&buffer[0], buffer.size());
+      size_t read = m_stream->LastRead();
+      // Read() reads nothing only at the end of the pipe or on an error.
+      if (read == 0)
+        break;
+
+      wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, m_id);
+      event->SetString(wxString::From8BitData(&buffer[0], read));
+      wxQueueEvent(m_process, event);
+    }
+
+    // An empty chunk tells the process that we have finished.
+    wxQueueEvent(m_process, new wxThreadEvent(wxEVT_THREAD, m_id));
+    return 0;
+  }
+
+private:
+  MaximaProcess *m_process;
+  wxInputStream *m_stream;
+  int m_id;
+};
+
+MaximaProcess::MaximaProcess(wxEvtHandler *parent, int id) : wxProcess(parent, id)
+{
+  m_processId = id;
+  m_readers = 0;
+  m_terminated = false;
+  m_reported = false;
+  m_waitedForReaders = false;
+  m_deleteWhenDone = false;
+  m_scheduledForDeletion = false;
+  m_exitPid = 0;
+  m_exitStatus = 0;
+  m_reportTimer.SetOwner(this);
+  Redirect();
+}
+
+void MaximaProcess::StartReading(int stdoutId, int stderrId)
+{
+  wxInputStream *streams[2] = {GetInputStream(), GetErrorStream()};
+  int ids[2] = {stdoutId, stderrId};
+  for (int i = 0; i < 2; i++)
+  {
+    if (streams[i] == NULL)
+      continue;
+    MaximaPipeReader *reader = new MaximaPipeReader(this, streams[i], ids[i]);
+    if (reader->Run() != wxTHREAD_NO_ERROR)
+    {
+      delete reader;
+      continue;
+    }
+    m_readers++;
+  }
+}
+
+void MaximaProcess::OnOutput(wxThreadEvent &event)
+{
+  // The chunk is passed on right now so it reaches our parent before the
+  // termination of the process does.
+  event.SetEventObject(this);
+  wxEvtHandler *parent = GetNextHandler();
+  if (parent != NULL)
+    parent->ProcessEvent(event);
+
+  if (event.GetString().IsEmpty())
+  {
+    m_readers--;
+    if (m_reported)
+      DeleteIfDone();
+    else
+      ReportTermination();
+  }
+}
+
+void MaximaProcess::OnTerminate(int pid, int status)
+{
+  m_terminated = true;
+  m_exitPid = pid;
+  m_exitStatus = status;
+
+  // The last words of a crashing maxima might still wait in the pipes or in our
+  // event queue: The parent learns about the termination only after the readers
+  // have delivered everything. A child process that has inherited the pipes
+  // (gnuplot, for example) might keep them open, though, so we don't wait forever.
+  if (m_readers > 0)
+    m_reportTimer.StartOnce(PIPE_EOF_TIMEOUT);
+  ReportTermination();
+}
+
+void MaximaProcess::OnReportTimer(wxTimerEvent &WXUNUSED(event))
+{
+  m_waitedForReaders = true;
+  ReportTermination();
+}
+
+void MaximaProcess::ReportTermination()
+{
+  if ((!m_terminated) || m_reported || ((m_readers > 0) && (!m_waitedForReaders)))
+    return;
+  m_reported = true;
+  m_reportTimer.Stop();
+
+  wxProcessEvent event(m_processId, m_exitPid, m_exitStatus);
+  event.SetEventObject(this);
+
+  // Whoever handles the event is responsible for deleting us, see DeleteWhenDone().
+  wxEvtHandler *parent = GetNextHandler();
+  if ((parent == NULL) || (!parent->ProcessEvent(event)))
+    m_deleteWhenDone = true;
+
+  // Anything the pipes might still deliver isn't of interest to anybody and
+  // our parent might not exist any more when it arrives.
+  Detach();
+  DeleteIfDone();
+}
+
+void MaximaProcess::DeleteWhenDone()
+{
+  m_deleteWhenDone = true;
+  DeleteIfDone();
+}
+
+void MaximaProcess::DeleteIfDone()
+{
+  // The readers use our pipes until they have finished.
+  if (m_reported && m_deleteWhenDone && (m_readers <= 0) && (!m_scheduledForDeletion))
+  {
+    m_scheduledForDeletion = true;
+    wxTheApp->ScheduleForDestruction(this);
+  }
+}
+
+BEGIN_EVENT_TABLE(MaximaProcess, wxProcess)
+                EVT_THREAD(wxID_ANY, MaximaProcess::OnOutput)
+                EVT_TIMER(wxID_ANY, MaximaProcess::OnReportTimer)
+END_EVENT_TABLE()
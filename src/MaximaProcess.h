@@ -0,0 +1,119 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class MaximaProcess
+
+  MaximaProcess is a maxima process whose stdout and stderr are read by
+  background threads.
+*/
+
+#ifndef MAXIMAPROCESS_H
+#define MAXIMAPROCESS_H
+
+#include <wx/process.h>
+#include <wx/event.h>
+#include <wx/string.h>
+#include <wx/timer.h>
+
+/*! A maxima process whose stdout and stderr are read by background threads
+
+  Polling the pipes of the process meant that messages from a crashing maxima
+  showed up only after the next tick of a timer, that big amounts of data were
+  slow to drain and that the timer woke up the CPU every second. Instead two
+  detached threads read the pipes in bulk as soon as data arrives and post the
+  chunks they have read as wxThreadEvents:
+   - The chunks are sent to the event handler that was given to the
+     constructor as long as the process isn't detached.
+   - The string of the event contains the data maxima has sent, one byte per
+     character (see wxString::To8BitData()).
+   - An event with an empty string tells that the pipe has been closed.
+   - The event object is the MaximaProcess the chunk comes from.
+
+  The termination of the process is reported only after both threads have
+  delivered everything maxima has written to its pipes.
+
+  The pipes belong to this object. Therefore it cannot be deleted while the
+  threads still read from them: Whoever handles the wxProcessEvent calls
+  DeleteWhenDone() instead of deleting it. If nobody handles the event the
+  object deletes itself.
+ */
+class MaximaProcess : public wxProcess
+{
+public:
+  /*! Creates the process object for wxExecute()
+
+    \param parent The event handler the wxProcessEvent and the output are sent to
+    \param id The id of the wxProcessEvent
+   */
+  MaximaProcess(wxEvtHandler *parent, int id);
+
+  /*! Start reading maxima's stdout and stderr
+
+    To be called after wxExecute() has started the process.
+    \param stdoutId The id of the wxThreadEvents with data from stdout
+    \param stderrId The id of the wxThreadEvents with data from stderr
+   */
+  void StartReading(int stdoutId, int stderrId);
+
+  //! Called by wxWidgets when the process has terminated
+  virtual void OnTerminate(int pid, int status);
+
+  //! Deletes this object as soon as the reader threads have finished
+  void DeleteWhenDone();
+
+private:
+  //! Forwards a chunk of output or the end of a pipe to the parent
+  void OnOutput(wxThreadEvent &event);
+
+  //! Stops waiting for pipes a child of maxima keeps open
+  void OnReportTimer(wxTimerEvent &event);
+
+  //! Sends the wxProcessEvent to the parent once the pipes are drained
+  void ReportTermination();
+
+  //! Deletes this object once it isn't needed any more
+  void DeleteIfDone();
+
+  //! The id of the wxProcessEvent
+  int m_processId;
+  //! How many threads still read from our pipes?
+  int m_readers;
+  //! Has the process terminated?
+  bool m_terminated;
+  //! Has the termination been reported to the parent?
+  bool m_reported;
+  //! Have we given up waiting for the readers to finish?
+  bool m_waitedForReaders;
+  //! Are we responsible for deleting this object?
+  bool m_deleteWhenDone;
+  //! Has ScheduleForDestruction() been called for this object?
+  bool m_scheduledForDeletion;
+  //! The process id OnTerminate() was called with
+  int m_exitPid;
+  //! The exit status OnTerminate() was called with
+  int m_exitStatus;
+  //! Limits how long we wait for the pipes to be closed
+  wxTimer m_reportTimer;
+
+  DECLARE_EVENT_TABLE()
+};
+
+#endif // MAXIMAPROCESS_H
@@ -0,0 +1,214 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class OutputClassifier
+
+  OutputClassifier tells if the text maxima outputs outside of xml tags is an
+  error message, a warning or ordinary text.
+*/
+
+#include "OutputClassifier.h"
+#include <wx/wxcrt.h>
+#include <queue>
+
+OutputClassifier::OutputClassifier()
+{
+  m_nodes.push_back(Node());
+
+  // Each line starts with a newline so the patterns starting with a newline
+  // only match at the beginning of a line.
+  AddPattern(wxT("\n-- an error."), matchError);
+  AddPattern(wxT(":incorrect syntax:"), matchError);
+  AddPattern(wxT("\nincorrect syntax"), matchError);
+  AddPattern(wxT("\nMaxima encountered a Lisp error"), matchError);
+  AddPattern(wxT("\nkillcontext: no such context"), matchError);
+  // a gcl error message
+  AddPattern(wxT("\ndbl:MAXIMA>>"), matchError);
+  // a sbcl error message
+  AddPattern(wxT("\nTo enable the Lisp debugger set *debugger-hook* to nil."), matchError);
+  // The rest of a gnuplot error (a line number, a colon and a space) is checked
+  // by Classify().
+  AddPattern(wxT(".gnuplot\", line "), matchGnuplotLine);
+
+  AddPattern(wxT("\nWarning:"), matchWarning);
+  AddPattern(wxT("\nWARNING:"), matchWarning);
+  AddPattern(wxT("\nwarning:"), matchWarning);
+  AddPattern(wxT(": Warning:"), matchWarning);
+  AddPattern(wxT(": warning:"), matchWarning);
+
+  Compile();
+}
+
+void OutputClassifier::AddPattern(const wxString &pattern, Match match)
+{
+  int state = 0;
+  for (wxString::const_iterator it = pattern.begin(); it != pattern.end(); ++it)
+  {
+    wxChar c = *it;
+    std::map<wxChar, int>::const_iterator next = m_nodes[state].next.find(c);
+    if (next != m_nodes[state].next.end())
+      state = next->second;
+    else
+    {
+      m_nodes.push_back(Node());
+      m_nodes[state].next[c] = m_nodes.size() - 1;
+      state = m_nodes.size() - 1;
+    }
+  }
+  m_nodes[state].match |= match;
+}
+
+void OutputClassifier::Compile()
+{
+  // The fail links are calculated breadth-first: The fail link of a state
+  // always points to a state that is nearer to the start.
+  std::queue<int> states;
+  for (std::map<wxChar, int>::const_iterator it = m_nodes[0].next.begin();
+       it != m_nodes[0].next.end(); ++it)
+  {
+    m_nodes[it->second].fail = 0;
+    states.push(it->second);
+  }
+
+  while (!states.empty())
+  {
+    int state = states.front();
+    states.pop();
+    for (std::map<wxChar, int>::const_iterator it = m_nodes[state].next.begin();
+         it != m_nodes[state].next.end(); ++it)
+    {
+      int child = it->second;
+      m_nodes[child].fail = Step(m_nodes[state].fail, it->first);
+      // A pattern that ends in the fail state ends here, too.
+      m_nodes[child].match |= m_nodes[m_nodes[child].fail].match;
+      states.push(child);
+    }
+  }
+}
+
+int OutputClassifier::Step(int state, wxChar c) const
+{
+  while (true)
+  {
+    std::map<wxChar, int>::const_iterator next = m_nodes[state].next.find(c);
+    if (next != m_nodes[state].next.end())
+      return next->second;
+    if (state == 0)
+      return 0;
+    state = m_nodes[state].fail;
+  }
+}
+
+OutputClassifier::Type OutputClassifier::Classify(wxString::const_iterator begin,
+                                                  wxString::const_iterator end,
+                                                  wxArrayString &lines) const
+{
+  Type type = plain;
+  int state = Step(0, wxT('\n'));
+  // Did the last character we have read contain whitespace?
+  bool whitespace = true;
+  // How many quotes have we read? A gnuplot error starts with a quoted file name.
+  int quotes = 0;
+  // How far are we into the line number of a gnuplot error?
+  // 0 = not in a gnuplot error, 1 = no digit read yet, 2 = in the digits,
+  // 3 = after the colon.
+  int gnuplotLine = 0;
+
+  wxString::const_iterator lineStart = begin;
+  // Has the current line contained anything but whitespace?
+  bool blankLine = true;
+  for (wxString::const_iterator it = begin; it != end; ++it)
+  {
+    wxChar c = *it;
+    bool newline = (c == wxT('\n')) || (c == wxT('\r'));
+    bool space = (c == wxT(' ')) || (c == wxT('\t'));
+
+    if (newline)
+    {
+      if (!blankLine)
+        lines.Add(wxString(lineStart, it));
+      lineStart = it + 1;
+      blankLine = true;
+    }
+    else if (!space)
+      blankLine = false;
+
+    // Once we know that the text is an error message there is nothing left to find.
+    if (type == error)
+      continue;
+
+    // Translate the character to the whitespace-merged version of the text
+    wxChar normalized = c;
+    if (newline)
+    {
+      normalized = wxT('\n');
+      whitespace = true;
+    }
+    else if (space)
+    {
+      // Merge non-newline whitespace to a space.
+      if (whitespace)
+        continue;
+      normalized = wxT(' ');
+      whitespace = true;
+    }
+    else
+      whitespace = false;
+
+    // Check the line number of a gnuplot error
+    switch (gnuplotLine)
+    {
+    case 1:
+      gnuplotLine = wxIsdigit(normalized) ? 2 : 0;
+      break;
+    case 2:
+      if (normalized == wxT(':'))
+        gnuplotLine = 3;
+      else if (!wxIsdigit(normalized))
+        gnuplotLine = 0;
+      break;
+    case 3:
+      if (normalized == wxT(' '))
+        type = error;
+      gnuplotLine = 0;
+      break;
+    }
+
+    if (normalized == wxT('"'))
+      quotes++;
+
+    state = Step(state, normalized);
+    int match = m_nodes[state].match;
+    if (match & matchError)
+      type = error;
+    else if ((match & matchWarning) && (type == plain))
+      type = warning;
+    // The pattern contains the closing quote of the file name, so the opening
+    // one must have been read before.
+    if ((match & matchGnuplotLine) && (quotes >= 2))
+      gnuplotLine = 1;
+  }
+
+  if (!blankLine)
+    lines.Add(wxString(lineStart, end));
+
+  return type;
+}
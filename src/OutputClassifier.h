@@ -0,0 +1,106 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class OutputClassifier
+
+  OutputClassifier tells if the text maxima outputs outside of xml tags is an
+  error message, a warning or ordinary text.
+*/
+
+#ifndef OUTPUTCLASSIFIER_H
+#define OUTPUTCLASSIFIER_H
+
+#include <wx/string.h>
+#include <wx/arrstr.h>
+#include <vector>
+#include <map>
+
+/*! Classifies maxima's unstructured text output in a single pass
+
+  Chatty packages can output lots of text that isn't enclosed in xml tags.
+  Instead of searching this text once for every message that marks an error
+  or a warning this class compiles all of these messages into one automaton
+  (Aho-Corasick) that finds all of them while reading the text only once.
+
+  The messages are matched against a version of the text in which each line
+  is stripped of its leading whitespace and in which runs of spaces and tabs
+  are merged to a single space. This version of the text is never actually
+  built: The characters are normalized while reading the text.
+ */
+class OutputClassifier
+{
+public:
+  //! What kind of text we have got?
+  enum Type
+  {
+    plain,   //!< Ordinary text
+    warning, //!< At least one line of the text is a warning
+    error    //!< At least one line of the text is an error message
+  };
+
+  OutputClassifier();
+
+  /*! Classify a text and split it into lines
+
+    \param begin The start of the text
+    \param end The end of the text
+    \param lines Receives all lines of the text that contain more than whitespace.
+           DOS and MAC line endings are understood, too.
+    \return The kind of text we have got.
+   */
+  Type Classify(wxString::const_iterator begin, wxString::const_iterator end,
+                wxArrayString &lines) const;
+
+private:
+  //! What a match in the automaton means
+  enum Match
+  {
+    matchNone = 0,
+    matchWarning = 1,
+    matchError = 2,
+    //! The start of a gnuplot error message that still needs a line number
+    matchGnuplotLine = 4
+  };
+
+  //! One state of the automaton
+  struct Node
+  {
+    Node() : fail(0), match(matchNone) {}
+    //! The state the next character leads to
+    std::map<wxChar, int> next;
+    //! The state for the longest suffix of this state that is a prefix of a pattern
+    int fail;
+    //! The patterns that end in this state
+    int match;
+  };
+
+  //! Add a pattern to the trie
+  void AddPattern(const wxString &pattern, Match match);
+  //! Calculate the fail links after all patterns have been added
+  void Compile();
+  //! The state that follows the state <code>state</code> on reading c
+  int Step(int state, wxChar c) const;
+
+  //! The states of the automaton. State 0 is the start.
+  std::vector<Node> m_nodes;
+};
+
+#endif // OUTPUTCLASSIFIER_H
@@ -89,6 +89,12 @@ void ParenCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t ParenCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_innerCell, m_open, m_close);
+}
+
 void ParenCell::SetInner(MathCell *inner, int type)
 {
   if (inner == NULL)
@@ -230,8 +236,7 @@ void ParenCell::RecalculateHeight(int fontsize)
   m_center = m_height / 2;
 
   SetFont(fontsize);
-  wxDC& dc = configuration->GetDC();
-  dc.GetTextExtent(wxT("("), &m_charWidth1, &m_charHeight1);
+  configuration->GetTextExtent(wxT("("), &m_charWidth1, &m_charHeight1);
   if(m_charHeight1 < 2)
     m_charHeight1 = 2;
 
@@ -0,0 +1,111 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class RenderCache
+
+  RenderCache remembers the images the last copy and export operations have rendered.
+*/
+
+#include "RenderCache.h"
+
+RenderCache::RenderCache(size_t maxSize)
+{
+  m_maxSize = maxSize;
+}
+
+size_t RenderCache::Entry::Size()
+{
+  size_t size = m_key.Length() * sizeof(wxChar) + m_svg.GetDataLen();
+  if (m_bitmap.IsOk())
+    size += m_bitmap.GetWidth() * m_bitmap.GetHeight() * 4;
+  return size;
+}
+
+RenderCache::Entry *RenderCache::Find(wxString key)
+{
+  for (std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+  {
+    if (it->m_key == key)
+    {
+      // Move the entry to the front of the list.
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return &m_entries.front();
+    }
+  }
+  return NULL;
+}
+
+wxBitmap RenderCache::GetBitmap(wxString key)
+{
+  Entry *entry = Find(key);
+  if (entry == NULL)
+    return wxNullBitmap;
+  return entry->m_bitmap;
+}
+
+void RenderCache::AddBitmap(wxString key, wxBitmap bitmap)
+{
+  Entry *entry = Find(key);
+  if (entry == NULL)
+  {
+    m_entries.push_front(Entry());
+    entry = &m_entries.front();
+    entry->m_key = key;
+  }
+  entry->m_bitmap = bitmap;
+  Limit();
+}
+
+wxMemoryBuffer RenderCache::GetSVG(wxString key)
+{
+  Entry *entry = Find(key);
+  if (entry == NULL)
+    return wxMemoryBuffer();
+  return entry->m_svg;
+}
+
+void RenderCache::AddSVG(wxString key, wxMemoryBuffer svg)
+{
+  Entry *entry = Find(key);
+  if (entry == NULL)
+  {
+    m_entries.push_front(Entry());
+    entry = &m_entries.front();
+    entry->m_key = key;
+  }
+  entry->m_svg = svg;
+  Limit();
+}
+
+void RenderCache::Limit()
+{
+  size_t size = 0;
+  for (std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    size += it->Size();
+
+  // The most recent entry is kept even if it is too big on its own: It is the one
+  // that is most likely to be requested again.
+  while ((size > m_maxSize) && (m_entries.size() > 1))
+  {
+    size -= m_entries.back().Size();
+    m_entries.pop_back();
+  }
+}
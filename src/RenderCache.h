@@ -0,0 +1,92 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class RenderCache
+
+  RenderCache remembers the images the last copy and export operations have rendered.
+*/
+
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <wx/wx.h>
+#include <wx/buffer.h>
+#include <list>
+
+/*! A cache for bitmap and svg renderings of parts of the worksheet
+
+  Laying out a selection at the export scale and drawing it is expensive for
+  big selections - and the same selection tends to be copied several times in
+  a row: As a bitmap, as svg, into several applications or into a file.
+
+  Each entry is identified by a key that describes the contents and the scale
+  of the rendered cells. The least recently used entries are dropped as soon
+  as the cache exceeds its memory limit.
+ */
+class RenderCache
+{
+public:
+  //! \param maxSize The maximum number of bytes this cache may occupy
+  RenderCache(size_t maxSize = 64 * 1024 * 1024);
+
+  //! Returns the bitmap cached for this key. wxNullBitmap means: There is none.
+  wxBitmap GetBitmap(wxString key);
+
+  //! Remember a bitmap
+  void AddBitmap(wxString key, wxBitmap bitmap);
+
+  //! Returns the svg data cached for this key. An empty buffer means: There is none.
+  wxMemoryBuffer GetSVG(wxString key);
+
+  //! Remember svg data
+  void AddSVG(wxString key, wxMemoryBuffer svg);
+
+  //! Forget everything, for example if the styles have changed
+  void Clear()
+  { m_entries.clear(); }
+
+private:
+  //! One cached rendering
+  struct Entry
+  {
+    wxString m_key;
+    wxBitmap m_bitmap;
+    wxMemoryBuffer m_svg;
+
+    //! Roughly estimates how many bytes this entry occupies
+    size_t Size();
+  };
+
+  /*! Searches for an entry and marks it as being the most recently used one
+
+    \return NULL, if there is no entry for this key
+   */
+  Entry *Find(wxString key);
+
+  //! Drop the least recently used entries until the cache fits into m_maxSize
+  void Limit();
+
+  //! The cached renderings, the most recently used one first
+  std::list<Entry> m_entries;
+  size_t m_maxSize;
+};
+
+#endif // RENDERCACHE_H
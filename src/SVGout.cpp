@@ -280,33 +280,47 @@ Svgout::SVGDataObject::SVGDataObject(wxMemoryBuffer data) : wxCustomDataObject(m
 
 wxDataFormat Svgout::m_svgFormat;
 
+wxMemoryBuffer Svgout::GetSVGData()
+{
+  wxMemoryBuffer svgContents;
+  {
+    char *data =(char *) malloc(8192);
+    wxFileInputStream str(m_filename);
+    if(str.IsOk())
+      while (!str.Eof())
+      {
+        str.Read(data,8192);
+        svgContents.AppendData(data,str.LastRead());
+      }
+    free(data);
+  }
+  wxRemoveFile(m_filename);
+  m_filename = wxEmptyString;
+  return svgContents;
+}
+
 Svgout::SVGDataObject *Svgout::GetDataObject()
 {
-    wxMemoryBuffer svgContents;
-    {
-      char *data =(char *) malloc(8192);
-      wxFileInputStream str(m_filename);
-      if(str.IsOk())
-        while (!str.Eof())
-        {
-          str.Read(data,8192);
-          svgContents.AppendData(data,str.LastRead());
-        }
-      free(data);
-    }
-    wxRemoveFile(m_filename);
-    m_filename = wxEmptyString;
+  return GetDataObject(GetSVGData());
+}
 
-    return new SVGDataObject(svgContents);
+Svgout::SVGDataObject *Svgout::GetDataObject(wxMemoryBuffer svg)
+{
+  m_svgFormat = wxDataFormat(wxT("image/svg+xml"));
+  return new SVGDataObject(svg);
 }
 
 bool Svgout::ToClipboard()
+{
+  return ToClipboard(GetSVGData());
+}
+
+bool Svgout::ToClipboard(wxMemoryBuffer svg)
 {
   if (wxTheClipboard->Open())
   {
-    bool res = wxTheClipboard->SetData(GetDataObject());
+    bool res = wxTheClipboard->SetData(GetDataObject(svg));
     wxTheClipboard->Close();
-    m_filename = wxEmptyString;
     return res;
   }
   return false;
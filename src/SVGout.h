@@ -25,6 +25,10 @@
 #include "MathCell.h"
 
 #include <wx/dcsvg.h>
+
+//! The factor svg renderings are made at in order to provide a fine enough grid for the coordinates
+#define SVG_SCALE 10
+
 /* Renders portions of the work sheet (including 2D maths) as svg.
 
    This is used for exporting HTML with embedded maths as a scalable vector
@@ -35,7 +39,7 @@ class Svgout
 public:
   /*! The constructor.
   */
-  Svgout(Configuration **configuration, wxString filename = wxEmptyString, int scale = 10);
+  Svgout(Configuration **configuration, wxString filename = wxEmptyString, int scale = SVG_SCALE);
 
   ~Svgout();
   
@@ -107,6 +111,18 @@ private:
 public:
   //! Returns the svg representation in a format that can be placed on the clipBoard.
   SVGDataObject *GetDataObject();
+
+  /*! Returns the svg representation as a memory buffer
+
+    Deletes the file the svg data has been written to.
+   */
+  wxMemoryBuffer GetSVGData();
+
+  //! Converts svg data to a format that can be placed on the clipBoard.
+  static SVGDataObject *GetDataObject(wxMemoryBuffer svg);
+
+  //! Puts svg data on the clipboard
+  static bool ToClipboard(wxMemoryBuffer svg);
 };
 
 #endif // SVGOUT_H
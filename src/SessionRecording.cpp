@@ -0,0 +1,122 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class SessionRecording
+
+  SessionRecording reads and writes recordings of the data exchanged with maxima.
+*/
+
+#include "SessionRecording.h"
+
+#include <wx/file.h>
+
+SessionRecording::SessionRecording()
+{
+}
+
+SessionRecording::~SessionRecording()
+{
+  StopRecording();
+}
+
+bool SessionRecording::StartRecording(wxString file)
+{
+  StopRecording();
+  if (!m_file.Open(file, wxT("wb")))
+    return false;
+  m_stopWatch.Start();
+  return true;
+}
+
+void SessionRecording::StopRecording()
+{
+  if (m_file.IsOpened())
+    m_file.Close();
+}
+
+void SessionRecording::Add(Direction direction, const char *data, size_t length)
+{
+  if (!m_file.IsOpened())
+    return;
+
+  wxString header = wxString::Format(wxT("%c %li %lu\n"),
+                                     (direction == fromMaxima) ? '<' : '>',
+                                     m_stopWatch.Time(),
+                                     (unsigned long) length);
+  m_file.Write(header);
+  m_file.Write(data, length);
+  m_file.Write(wxT("\n"));
+}
+
+bool SessionRecording::Load(wxString file)
+{
+  m_records.clear();
+
+  wxFile input;
+  if (!input.Open(file))
+    return false;
+
+  wxFileOffset size = input.Length();
+  if (size < 0)
+    return false;
+
+  wxMemoryBuffer contents;
+  if (input.Read(contents.GetWriteBuf(size), size) != size)
+    return false;
+  contents.UngetWriteBuf(size);
+
+  const char *data = (const char *) contents.GetData();
+  size_t pos = 0;
+  while (pos < (size_t) size)
+  {
+    // Read the header line
+    size_t end = pos;
+    while ((end < (size_t) size) && (data[end] != '\n'))
+      end++;
+    if (end >= (size_t) size)
+      return false;
+    wxString header = wxString::FromUTF8(data + pos, end - pos);
+    pos = end + 1;
+
+    Record record;
+    if (header.StartsWith(wxT("<")))
+      record.m_direction = fromMaxima;
+    else if (header.StartsWith(wxT(">")))
+      record.m_direction = toMaxima;
+    else
+      return false;
+
+    wxString time = header.Mid(2).BeforeFirst(wxT(' '));
+    wxString length = header.Mid(2).AfterFirst(wxT(' '));
+    unsigned long recordLength;
+    if ((!time.ToLong(&record.m_time)) || (!length.ToULong(&recordLength)))
+      return false;
+
+    // Read the data and the newline that follows it
+    if (pos + recordLength > (size_t) size)
+      return false;
+    record.m_data.AppendData(data + pos, recordLength);
+    pos += recordLength + 1;
+
+    m_records.push_back(record);
+  }
+  return true;
+}
@@ -0,0 +1,107 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class SessionRecording
+
+  SessionRecording reads and writes recordings of the data exchanged with maxima.
+*/
+
+#ifndef SESSIONRECORDING_H
+#define SESSIONRECORDING_H
+
+#include <wx/string.h>
+#include <wx/buffer.h>
+#include <wx/ffile.h>
+#include <wx/stopwatch.h>
+#include <vector>
+
+/*! Reads and writes recordings of the data exchanged with maxima
+
+  A recording is a file that contains one record per chunk of data. Each
+  record starts with a header line of the form "<direction> <time> <length>":
+    - direction is '<' for data maxima has sent and '>' for data that was sent 
+      to maxima,
+    - time is the number of milliseconds since the recording started and
+    - length is the number of bytes of data.
+
+  The header is followed by exactly length bytes of data and a newline.
+  This means the data is kept byte-for-byte, whichever characters it contains.
+ */
+class SessionRecording
+{
+public:
+  //! The direction the data of a record was sent in
+  enum Direction
+  {
+    fromMaxima,
+    toMaxima
+  };
+
+  //! One chunk of data
+  struct Record
+  {
+    Direction m_direction;
+    //! The time the data was sent at [in milliseconds since the start of the recording]
+    long m_time;
+    wxMemoryBuffer m_data;
+  };
+
+  SessionRecording();
+
+  ~SessionRecording();
+
+  //! Start writing a recording to a file. Returns false if the file cannot be written.
+  bool StartRecording(wxString file);
+
+  //! Finish the recording that is currently written
+  void StopRecording();
+
+  //! Is a recording currently written?
+  bool IsRecording()
+  { return m_file.IsOpened(); }
+
+  //! Add a chunk of data to the recording that is currently written
+  void Add(Direction direction, const char *data, size_t length);
+
+  /*! Reads a recording
+
+    \return false, if the file cannot be read or isn't a valid recording.
+   */
+  bool Load(wxString file);
+
+  //! The number of records Load() has read
+  size_t GetRecordCount()
+  { return m_records.size(); }
+
+  //! Returns a record Load() has read
+  Record &GetRecord(size_t i)
+  { return m_records[i]; }
+
+private:
+  //! The file a recording is currently written to
+  wxFFile m_file;
+  //! Measures the time since the recording has been started
+  wxStopWatch m_stopWatch;
+  //! The records Load() has read
+  std::vector<Record> m_records;
+};
+
+#endif // SESSIONRECORDING_H
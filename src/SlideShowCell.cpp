@@ -181,6 +181,15 @@ void SlideShow::MarkAsDeleted()
   ClearCache();
 }
 
+size_t SlideShow::SizeInMemory()
+{
+  size_t size = MathCell::SizeInMemory();
+  for (int i = 0; i < m_size; i++)
+    if (m_images[i])
+      size += m_images[i]->SizeInMemory();
+  return size;
+}
+
 void SlideShow::SetDisplayedIndex(int ind)
 {
   if (ind >= 0 && ind < m_size)
@@ -60,6 +60,8 @@ public:
 
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   /*! Remove all cached scaled images from memory
 
     To be called when the slideshow is outside of the displayed portion 
@@ -86,6 +86,12 @@ void SqrtCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t SqrtCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_innerCell, m_open, m_close);
+}
+
 
 void SqrtCell::SetInner(MathCell *inner)
 {
@@ -118,7 +124,7 @@ void SqrtCell::RecalculateWidths(int fontsize)
                 configuration->GetTeXCMEX());
     font.SetPointSize(fontsize1);
     dc.SetFont(font);
-    dc.GetTextExtent(wxT("s"), &m_signWidth, &m_signSize);
+    configuration->GetTextExtent(wxT("s"), &m_signWidth, &m_signSize);
     m_signTop = m_signSize / 5;
     m_width = m_innerCell->GetFullWidth(scale) + m_signWidth;
 
@@ -155,7 +161,7 @@ void SqrtCell::RecalculateWidths(int fontsize)
                   configuration->GetTeXCMEX());
     font.SetPointSize(fontsize1);
     dc.SetFont(font);
-    dc.GetTextExtent(wxT("s"), &m_signWidth, &m_signSize);
+    configuration->GetTextExtent(wxT("s"), &m_signWidth, &m_signSize);
     m_signTop = m_signSize / 5;
     m_width = m_innerCell->GetFullWidth(scale) + m_signWidth;
   }
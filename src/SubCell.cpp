@@ -73,6 +73,12 @@ void SubCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t SubCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_baseCell, m_indexCell);
+}
+
 
 void SubCell::SetIndex(MathCell *index)
 {
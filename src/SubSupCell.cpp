@@ -82,6 +82,12 @@ void SubSupCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t SubSupCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_baseCell, m_indexCell, m_exptCell);
+}
+
 
 void SubSupCell::SetIndex(MathCell *index)
 {
@@ -91,6 +91,12 @@ void SumCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t SumCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         SizeInMemoryList(m_base, m_under, m_over);
+}
+
 
 void SumCell::SetOver(MathCell *over)
 {
@@ -142,7 +148,7 @@ void SumCell::RecalculateWidths(int fontsize)
       font = *wxNORMAL_FONT;
     font.SetPointSize(fontsize1);
     dc.SetFont(font);
-    dc.GetTextExtent(m_sumStyle == SM_SUM ? wxT(SUM_SIGN) : wxT(PROD_SIGN), &m_signWidth, &m_signSize);
+    configuration->GetTextExtent(m_sumStyle == SM_SUM ? wxT(SUM_SIGN) : wxT(PROD_SIGN), &m_signWidth, &m_signSize);
     m_signWCenter = m_signWidth / 2;
     m_signTop = (2 * m_signSize) / 5;
     m_signSize = (2 * m_signSize) / 5;
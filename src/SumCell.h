@@ -48,6 +48,8 @@ public:
   
   void MarkAsDeleted();
 
+  size_t SizeInMemory();
+
   MathCell *Copy();
   CellPointers *m_cellPointers;
   virtual wxString GetToolTip(const wxPoint &point)
@@ -62,6 +62,13 @@ void TextCell::MarkAsDeleted()
     m_cellPointers->m_cellUnderPointer = NULL;
 }
 
+size_t TextCell::SizeInMemory()
+{
+  return MathCell::SizeInMemory() +
+         (m_text.Length() + m_displayedText.Length() + m_userDefinedLabel.Length() +
+          m_altText.Length() + m_altJsText.Length()) * sizeof(wxChar);
+}
+
 void TextCell::SetValue(const wxString &text)
 {
   m_toolTip = m_initialToolTip;
@@ -317,16 +324,16 @@ void TextCell::RecalculateWidths(int fontsize)
       
       // Check for output annotations (/R/ for CRE and /T/ for Taylor expressions)
       if (text.Right(2) != wxT("/ "))
-        dc.GetTextExtent(wxT("(%o") + LabelWidthText() + wxT(")"), &m_width, &m_height);
+        configuration->GetTextExtent(wxT("(%o") + LabelWidthText() + wxT(")"), &m_width, &m_height);
       else
-        dc.GetTextExtent(wxT("(%o") + LabelWidthText() + wxT(")/R/"), &m_width, &m_height);
+        configuration->GetTextExtent(wxT("(%o") + LabelWidthText() + wxT(")/R/"), &m_width, &m_height);
 
       // We will decrease it before use
       m_fontSizeLabel = m_fontSize;
       wxASSERT_MSG((m_width > 0) || (text == wxEmptyString),
                    _("The letter \"X\" is of width zero. Installing http://www.math.union.edu/~dpvc/jsmath/download/jsMath-fonts.html and checking \"Use JSmath fonts\" in the configuration dialogue should fix it."));
       if (m_width < 1) m_width = 10;
-      dc.GetTextExtent(text, &m_labelWidth, &m_labelHeight);
+      configuration->GetTextExtent(text, &m_labelWidth, &m_labelHeight);
       wxASSERT_MSG((m_labelWidth > 0) || (m_displayedText == wxEmptyString),
                    _("Seems like something is broken with the maths font. Installing http://www.math.union.edu/~dpvc/jsmath/download/jsMath-fonts.html and checking \"Use JSmath fonts\" in the configuration dialogue should fix it."));
       wxFont font(dc.GetFont());
@@ -335,14 +342,14 @@ void TextCell::RecalculateWidths(int fontsize)
         int fontsize1 = Scale_Px(--m_fontSizeLabel, scale);
         font.SetPointSize(fontsize1);
         dc.SetFont(font);
-        dc.GetTextExtent(text, &m_labelWidth, &m_labelHeight);
+        configuration->GetTextExtent(text, &m_labelWidth, &m_labelHeight);
       }
     }
 
       /// Check if we are using jsMath and have jsMath character
     else if (m_altJs && configuration->CheckTeXFonts())
     {
-      dc.GetTextExtent(m_altJsText, &m_width, &m_height);
+      configuration->GetTextExtent(m_altJsText, &m_width, &m_height);
 
       if (m_texFontname == wxT("jsMath-cmsy10"))
         m_height = m_height / 2;
@@ -351,19 +358,19 @@ void TextCell::RecalculateWidths(int fontsize)
       /// We are using a special symbol
     else if (m_alt)
     {
-      dc.GetTextExtent(m_altText, &m_width, &m_height);
+      configuration->GetTextExtent(m_altText, &m_width, &m_height);
     }
 
       /// Empty string has height of X
     else if (m_displayedText == wxEmptyString)
     {
-      dc.GetTextExtent(wxT("gXÄy"), &m_width, &m_height);
+      configuration->GetTextExtent(wxT("gXÄy"), &m_width, &m_height);
       m_width = 0;
     }
 
       /// This is the default.
     else
-      dc.GetTextExtent(m_displayedText, &m_width, &m_height);
+      configuration->GetTextExtent(m_displayedText, &m_width, &m_height);
 
     m_width = m_width + 2 * Scale_Px(MC_TEXT_PADDING, scale);
     m_height = m_height + 2 * Scale_Px(MC_TEXT_PADDING, scale);
@@ -40,6 +40,8 @@ public:
   TextCell(MathCell *parent, Configuration **config, CellPointers *cellPointers, wxString text = wxEmptyString);
 
   void MarkAsDeleted();
+
+  size_t SizeInMemory();
   
   CellPointers *m_cellPointers;
 
@@ -0,0 +1,75 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file defines the class TextExtentCache
+
+  TextExtentCache remembers the sizes of the texts that have already been measured.
+*/
+
+#include "TextExtentCache.h"
+
+TextExtentCache::TextExtentCache(size_t maxEntries)
+{
+  m_maxEntries = maxEntries;
+}
+
+wxString TextExtentCache::FontKey(const wxFont &font)
+{
+  return wxString::Format(wxT("%s\t%i\t%i\t%i\t%i\t%i\t%i\t"),
+                          font.GetFaceName().c_str(),
+                          (int) font.GetFamily(),
+                          (int) font.GetEncoding(),
+                          font.GetPointSize(),
+                          (int) font.GetWeight(),
+                          (int) font.GetStyle(),
+                          (int) font.GetUnderlined());
+}
+
+void TextExtentCache::GetTextExtent(wxDC &dc, const wxString &text, wxCoord *width, wxCoord *height)
+{
+  wxFont font = dc.GetFont();
+  wxSize size;
+  if (!font.IsOk())
+    dc.GetTextExtent(text, &size.x, &size.y);
+  else
+  {
+    wxString key = FontKey(font) + text;
+    ExtentHash::iterator it = m_extents.find(key);
+    if (it != m_extents.end())
+      size = it->second;
+    else
+    {
+      dc.GetTextExtent(text, &size.x, &size.y);
+      if (m_extents.size() >= m_maxEntries)
+        m_extents.clear();
+      m_extents[key] = size;
+    }
+  }
+  if (width != NULL)
+    *width = size.x;
+  if (height != NULL)
+    *height = size.y;
+}
+
+void TextExtentCache::Clear()
+{
+  m_extents.clear();
+}
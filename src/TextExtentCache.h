@@ -0,0 +1,69 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  This file declares the class TextExtentCache
+
+  TextExtentCache remembers the sizes of the texts that have already been measured.
+*/
+
+#ifndef TEXTEXTENTCACHE_H
+#define TEXTEXTENTCACHE_H
+
+#include <wx/wx.h>
+#include <wx/hashmap.h>
+
+/*! A cache for the sizes of texts
+
+  Asking the drawing context for the extent of a text is by far the most
+  expensive part of laying out the worksheet - and most texts (variable names,
+  numbers, operators and labels) occur over and over again in the same font.
+
+  The cache is keyed by the font's face name, family, encoding, point size,
+  weight, style and underlining plus the text. Like the drawing context it measures with it is
+  only used from the thread that lays out the worksheet.
+ */
+class TextExtentCache
+{
+public:
+  //! \param maxEntries The number of measurements after which the cache is emptied
+  TextExtentCache(size_t maxEntries = 65536);
+
+  /*! Determine the size of a text in the font the drawing context currently uses
+
+    Asks the drawing context only if this text hasn't been measured in this font before.
+   */
+  void GetTextExtent(wxDC &dc, const wxString &text, wxCoord *width, wxCoord *height);
+
+  //! Forget everything, for example if the resolution of the drawing context has changed
+  void Clear();
+
+private:
+  //! Generates a string that identifies a font
+  static wxString FontKey(const wxFont &font);
+
+  WX_DECLARE_STRING_HASH_MAP(wxSize, ExtentHash);
+
+  //! The known sizes, keyed by FontKey() + text
+  ExtentHash m_extents;
+  size_t m_maxEntries;
+};
+
+#endif // TEXTEXTENTCACHE_H
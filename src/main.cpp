@@ -101,6 +101,8 @@ There are a few other coding-style rules, as well:
 
 #include <wx/cmdline.h>
 #include <wx/fileconf.h>
+#include <wx/ffile.h>
+#include <wx/thread.h>
 #include "Dirstructure.h"
 #include <iostream>
 
@@ -129,6 +131,10 @@ void MyApp::Cleanup_Static()
 bool MyApp::OnInit()
 {
   m_frame = NULL;
+  m_batchJobs = 1;
+  m_batchRunning = 0;
+  m_batchHtml = false;
+  m_batchFailures = 0;
 //  atexit(Cleanup_Static);
   int lang = wxLANGUAGE_UNKNOWN;
 
@@ -145,9 +151,21 @@ bool MyApp::OnInit()
                   {wxCMD_LINE_SWITCH, "h", "help", "show this help message", wxCMD_LINE_VAL_NONE},
                   {wxCMD_LINE_OPTION, "o", "open", "open a file"},
                   {wxCMD_LINE_SWITCH, "b", "batch",
-                   "run the file and exit afterwards. Halts on questions and stops on errors."},
+                   "run the files without showing a window, save them and exit afterwards. "
+                   "Errors don't stop the evaluation unless \"Abort evaluation on error\" is set in the configuration; "
+                   "files that contain errors are saved, too. A file maxima asks a question for is "
+                   "neither finished nor saved. Replaces the old -b that evaluated one file in a window."},
+                  {wxCMD_LINE_OPTION, "j", "jobs",
+                   "in batch mode: the number of files that are evaluated at once", wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "summary",
+                   "in batch mode: write a tab-separated summary to a file instead of stdout"},
+                  {wxCMD_LINE_SWITCH, NULL, "html", "in batch mode: additionally export each file as HTML"},
                   { wxCMD_LINE_OPTION, "f", "ini", "use a specific configuration file" },
-                  {wxCMD_LINE_PARAM, NULL, NULL, "input file", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL},
+                  {wxCMD_LINE_OPTION, NULL, "record", "record the data exchanged with maxima to a file"},
+                  {wxCMD_LINE_OPTION, NULL, "replay",
+                   "replay a recorded session instead of starting maxima"},
+                  {wxCMD_LINE_PARAM, NULL, NULL, "input file", wxCMD_LINE_VAL_STRING,
+                   wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE},
                   {wxCMD_LINE_NONE}
           };
 
@@ -254,6 +272,25 @@ bool MyApp::OnInit()
     batchmode = true;
   }
 
+  cmdLineParser.Found(wxT("record"), &m_recordFile);
+  cmdLineParser.Found(wxT("replay"), &m_replayFile);
+
+  if (batchmode)
+  {
+    wxArrayString files;
+    if (cmdLineParser.Found(wxT("o"), &file))
+      files.Add(file);
+    for (size_t i = 0; i < cmdLineParser.GetParamCount(); i++)
+      files.Add(cmdLineParser.GetParam(i));
+
+    long jobs = wxThread::GetCPUCount();
+    cmdLineParser.Found(wxT("j"), &jobs);
+    wxString summary;
+    cmdLineParser.Found(wxT("summary"), &summary);
+
+    return StartBatch(files, jobs, summary, cmdLineParser.Found(wxT("html")));
+  }
+
   if (cmdLineParser.Found(wxT("o"), &file))
   {
     wxFileName FileName = file;
@@ -305,7 +342,101 @@ int MyApp::OnExit()
 
 int window_counter = 0;
 
-void MyApp::NewWindow(wxString file, bool batchmode)
+bool MyApp::StartBatch(wxArrayString files, long jobs, wxString summary, bool exportHTML)
+{
+  m_batchJobs = jobs;
+  if (m_batchJobs < 1)
+    m_batchJobs = 1;
+  m_batchSummary = summary;
+  m_batchHtml = exportHTML;
+  m_batchFailures = 0;
+  m_batchRunning = 0;
+
+#if defined __WXMAC__
+  // There is no menu bar to quit from.
+  wxApp::SetExitOnFrameDelete(true);
+#endif
+
+  if (m_batchSummary != wxEmptyString)
+  {
+    wxFFile summaryFile(m_batchSummary, wxT("w"));
+    if (!summaryFile.IsOpened())
+    {
+      std::cerr << "Cannot write the summary to " << m_batchSummary.utf8_str() << "\n";
+      return false;
+    }
+  }
+  WriteBatchSummary(wxT("file\tstatus\tmilliseconds\terrors"));
+
+  for (size_t i = 0; i < files.GetCount(); i++)
+  {
+    wxFileName FileName = files[i];
+    FileName.MakeAbsolute();
+    m_batchFiles.Add(FileName.GetFullPath());
+  }
+
+  StartBatchJobs();
+
+  // If no window could be opened there is no main loop that ever would end.
+  return m_batchRunning > 0;
+}
+
+void MyApp::StartBatchJobs()
+{
+  while ((m_batchRunning < m_batchJobs) && (!m_batchFiles.IsEmpty()))
+  {
+    wxString file = m_batchFiles[0];
+    m_batchFiles.RemoveAt(0);
+
+    if (!wxFileExists(file))
+    {
+      m_batchFailures++;
+      WriteBatchSummary(file + wxT("\tcannot open\t0\t0"));
+      continue;
+    }
+    m_batchRunning++;
+    NewWindow(file, true, true);
+  }
+}
+
+void MyApp::BatchFinished(wxString file, wxString status, long milliseconds, long errors)
+{
+  if (status != wxT("ok"))
+    m_batchFailures++;
+
+  WriteBatchSummary(file + wxT("\t") + status +
+                    wxString::Format(wxT("\t%li\t%li"), milliseconds, errors));
+
+  // The window that has called us closes itself => its slot is free now.
+  m_batchRunning--;
+  StartBatchJobs();
+}
+
+void MyApp::WriteBatchSummary(wxString line)
+{
+  if (m_batchSummary == wxEmptyString)
+  {
+    std::cout << line.utf8_str() << "\n";
+    std::cout.flush();
+    return;
+  }
+
+  // Appending each line as soon as it is known leaves a useful summary even if
+  // a later file makes wxMaxima crash.
+  wxFFile summaryFile(m_batchSummary, wxT("a"));
+  if (summaryFile.IsOpened())
+    summaryFile.Write(line + wxT("\n"), wxConvUTF8);
+}
+
+int MyApp::OnRun()
+{
+  int retval = wxApp::OnRun();
+  if (m_batchFailures > 0)
+    return 1;
+  return retval;
+}
+
+void MyApp::NewWindow(wxString file, bool batchmode, bool headless)
 {
   int x = 40, y = 40, h = 650, w = 950, m = 0;
   int rs = 0;
@@ -339,7 +470,7 @@ void MyApp::NewWindow(wxString file, bool batchmode)
   m_frame = new wxMaxima((wxFrame *) NULL, -1, _("wxMaxima"), m_configFileName,
                          wxPoint(x, y), wxSize(w, h));
 
-  if (m == 1)
+  if ((m == 1) && !headless)
     m_frame->Maximize(true);
 
   if (file.Length() > 0 && wxFileExists(file))
@@ -348,10 +479,31 @@ void MyApp::NewWindow(wxString file, bool batchmode)
   }
 
   m_frame->SetBatchMode(batchmode);
+  if (headless)
+    m_frame->SetHeadless(m_batchHtml);
   topLevelWindows.Append(m_frame);
   if (topLevelWindows.GetCount() > 1)
     m_frame->SetTitle(wxString::Format(_("untitled %d"), ++window_counter));
 
+  // Only the first window records or replays a session.
+  if (m_recordFile != wxEmptyString)
+  {
+    if (!m_frame->SetSessionRecording(m_recordFile))
+      wxLogError(_("Cannot write the session recording to %s"), m_recordFile);
+    m_recordFile = wxEmptyString;
+  }
+  if (m_replayFile != wxEmptyString)
+  {
+    m_frame->SetSessionReplay(m_replayFile);
+    m_replayFile = wxEmptyString;
+  }
+
+  if (headless)
+  {
+    m_frame->InitSession();
+    return;
+  }
+
   SetTopWindow(m_frame);
   m_frame->Show(true);
   m_frame->InitSession();
@@ -64,6 +64,7 @@
 #include <wx/dynlib.h>
 #include <wx/dir.h>
 #include <wx/filename.h>
+#include <wx/file.h>
 #include <wx/artprov.h>
 #include <wx/aboutdlg.h>
 #include <wx/utils.h>
@@ -91,7 +92,17 @@ unicode char? On wxMaxima's side we don't handle that case, currently.
 
 enum
 {
-  maxima_process_id
+  maxima_process_id,
+  //! The chunks of data from maxima's stdout, see MaximaProcess
+  maxima_stdout_id,
+  //! The chunks of data from maxima's stderr, see MaximaProcess
+  maxima_stderr_id,
+  //! The processes of the maximas sections are evaluated in, see MaximaKernel
+  kernel_process_id,
+  //! The chunks of data from the stdout of a MaximaKernel
+  kernel_stdout_id,
+  //! The chunks of data from the stderr of a MaximaKernel
+  kernel_stderr_id
 };
 
 void wxMaxima::ConfigChanged()
@@ -120,6 +131,11 @@ void wxMaxima::ConfigChanged()
   m_autoSaveInterval = 0;
   config->Read(wxT("autoSaveInterval"), &m_autoSaveInterval);
   m_autoSaveInterval *= 60000;
+
+  // A standby maxima has been set up using the old settings.
+  KillStandby();
+  StartStandby();
+
   m_console->UpdateConfig();
   // UpdateUserSymbols();
 }
@@ -139,11 +155,9 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title, const wxStrin
   m_CWD = wxEmptyString;
   m_port = 4010;
   m_pid = -1;
-  wxASSERT(m_gnuplotErrorRegex.Compile(wxT("\".*\\.gnuplot\", line [0-9][0-9]*: ")));
   m_hasEvaluatedCells = false;
   m_process = NULL;
-  m_maximaStdout = NULL;
-  m_maximaStderr = NULL;
+  m_maximaStdin = NULL;
   m_ready = false;
   m_inLispMode = false;
   m_first = true;
@@ -154,16 +168,31 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title, const wxStrin
 
   m_symbolsPrefix = wxT("<wxxml-symbols>");
   m_symbolsSuffix = wxT("</wxxml-symbols>");
+  m_framePrefix = wxT("<FRAME-");
   m_firstPrompt = wxT("(%i1) ");
 
   m_client = NULL;
   m_server = NULL;
+  m_standbyProcess = NULL;
+  m_standbyClient = NULL;
+  m_standbyPid = -1;
+  m_standbyReady = false;
+  m_checkedCell = NULL;
+  m_checkedCellErrorIndex = 0;
+  m_maximaSession = 0;
+  m_maximaSessions = 0;
+  m_setupDoneMarker = wxT("<wxsetup-done/>");
+  m_startupTime = -1;
 
   config->Read(wxT("lastPath"), &m_lastPath);
   m_lastPrompt = wxEmptyString;
 
   m_closing = false;
   m_openFile = wxEmptyString;
+  m_batchmode = false;
+  m_headless = false;
+  m_headlessDone = false;
+  m_headlessExportHTML = false;
   m_fileSaved = true;
   m_printData = NULL;
 
@@ -188,7 +217,10 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title, const wxStrin
 
   m_console->SetFocus();
   m_console->m_keyboardInactiveTimer.SetOwner(this, KEYBOARD_INACTIVITY_TIMER_ID);
-  m_maximaStdoutPollTimer.SetOwner(this, MAXIMA_STDOUT_POLL_ID);
+  m_replayTimer.SetOwner(this, REPLAY_TIMER_ID);
+  m_pipeTransport = false;
+  m_replayRecord = 0;
+  m_replayedBytes = 0;
 
   m_autoSaveTimer.SetOwner(this, AUTO_SAVE_TIMER_ID);
 
@@ -198,13 +230,6 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title, const wxStrin
 
   StatusMaximaBusy(disconnected);
 
-  /// RegEx for function definitions
-  wxASSERT(m_funRegEx.Compile(wxT("^ *([[:alnum:]%_]+) *\\(([[:alnum:]%_,[[.].] ]*)\\) *:=")));
-  // RegEx for variable definitions
-  wxASSERT(m_varRegEx.Compile(wxT("^ *([[:alnum:]%_]+) *:")));
-  // RegEx for blank statement removal
-  wxASSERT(m_blankStatementRegEx.Compile(wxT("(^;)|((^|;)(((\\/\\*.*\\*\\/)?([[:space:]]*))+;)+)")));
-
   m_statusBar->GetNetworkStatusElement()->Connect(wxEVT_LEFT_DCLICK,
                                                   wxCommandEventHandler(wxMaxima::NetworkDClick),
                                                   NULL, this);
@@ -221,8 +246,7 @@ wxMaxima::~wxMaxima()
     m_process->Detach();
 
   m_process = NULL;
-  m_maximaStdout = NULL;
-  m_maximaStderr = NULL;
+  m_maximaStdin = NULL;
 
   if(m_inputBuffer != NULL)
     delete [] m_inputBuffer;
@@ -287,38 +311,126 @@ bool MyDropTarget::OnDropFiles(wxCoord x, wxCoord y, const wxArrayString &files)
 //--------------------------------------------------------------------------------
 void wxMaxima::InitSession()
 {
-  bool server = false;
-  int defaultPort = 4010;
+  if (m_replayFile != wxEmptyString)
+  {
+    if (!StartReplay())
+      SetStatusText(_("Cannot read the recorded session"), 1);
+  }
+  else
+  {
+    bool server = false;
+    int defaultPort = 4010;
 
-  wxConfig::Get()->Read(wxT("defaultPort"), &defaultPort);
-  m_port = defaultPort;
+    wxConfig::Get()->Read(wxT("defaultPort"), &defaultPort);
+    m_port = defaultPort;
 
-  while (!(server = StartServer()))
-  {
-    m_port++;
-    if (m_port > defaultPort + 50)
+    while (!(server = StartServer()))
     {
-      wxMessageBox(_("wxMaxima could not start the server.\n\n"
-                             "Please check you have network support\n"
-                             "enabled and try again!"),
-                   _("Fatal error"),
-                   wxOK | wxICON_ERROR);
-      break;
+      m_port++;
+      if (m_port > defaultPort + 50)
+      {
+        if (!m_headless)
+          wxMessageBox(_("wxMaxima could not start the server.\n\n"
+                                 "Please check you have network support\n"
+                                 "enabled and try again!"),
+                       _("Fatal error"),
+                       wxOK | wxICON_ERROR);
+        break;
+      }
     }
-  }
 
-  if (!server)
-    SetStatusText(_("Starting server failed"));
-  else if (!StartMaxima())
-    SetStatusText(_("Starting Maxima process failed"), 1);
+    if (!server)
+    {
+      SetStatusText(_("Starting server failed"));
+      if (m_headless)
+        FinishHeadless(wxT("cannot start server"));
+    }
+    else if (!StartMaxima())
+    {
+      SetStatusText(_("Starting Maxima process failed"), 1);
+      if (m_headless)
+        FinishHeadless(wxT("cannot start maxima"));
+    }
+  }
 
   Refresh();
   ConfigChanged();
   m_console->SetFocus();
-  if (m_autoSaveInterval > 10000)
+  if ((m_autoSaveInterval > 10000) && !m_headless)
     m_autoSaveTimer.StartOnce(m_autoSaveInterval);
 }
 
+void wxMaxima::SetHeadless(bool exportHTML)
+{
+  m_headless = true;
+  m_headlessDone = false;
+  m_headlessExportHTML = exportHTML;
+  m_headlessFile = m_openFile;
+  SetBatchMode(true);
+
+  // A window that is never shown never receives a paint event that would
+  // provide the worksheet with a draw context. But OnIdle() waits for one
+  // before it opens the file.
+  m_headlessBitmap.Create(16, 16);
+  m_headlessDC.SelectObject(m_headlessBitmap);
+  m_console->m_configuration->SetContext(m_headlessDC);
+  m_headlessStopWatch.Start();
+}
+
+bool wxMaxima::StartHeadless()
+{
+  if (!m_headless || m_headlessDone || !m_console->m_evaluationQueue.Empty())
+    return false;
+
+  m_console->AddDocumentToEvaluationQueue();
+  if (m_console->m_evaluationQueue.Empty())
+  {
+    // Nothing to evaluate
+    FinishHeadless(wxT("ok"));
+    return false;
+  }
+  return true;
+}
+
+void wxMaxima::FinishHeadless(wxString status)
+{
+  if (!m_headless || m_headlessDone)
+    return;
+  m_headlessDone = true;
+  SetBatchMode(false);
+  m_console->m_evaluationQueue.Clear();
+
+  wxString file = m_console->m_currentFile;
+  // A file whose evaluation has caused errors is saved, too: Its output shows what went wrong.
+  if ((status == wxT("ok")) && (m_console->m_cellPointers.m_errorList.Size() > 0))
+    status = wxT("error");
+  if ((status == wxT("ok")) || (status == wxT("error")))
+  {
+    // Without a file name SaveFile() would ask the user for one.
+    if (file == wxEmptyString)
+      status = wxT("cannot open");
+    else if (!SaveFile(false))
+      status = wxT("cannot save");
+    else if (m_headlessExportHTML)
+    {
+      wxFileName htmlFile(file);
+      htmlFile.SetExt(wxT("html"));
+      if (!m_console->ExportToHTML(htmlFile.GetFullPath()))
+        status = wxT("cannot export html");
+    }
+  }
+  if (file == wxEmptyString)
+    file = m_headlessFile;
+
+  wxGetApp().BatchFinished(file, status, m_headlessStopWatch.Time(),
+                           m_console->m_cellPointers.m_errorList.Size());
+
+  // The file has already been saved if it needed to be => OnClose() won't ask.
+  wxCloseEvent *closeEvent = new wxCloseEvent(wxEVT_CLOSE_WINDOW, GetId());
+  closeEvent->SetEventObject(this);
+  GetEventHandler()->QueueEvent(closeEvent);
+}
+
 void wxMaxima::FirstOutput(wxString s)
 {
   Dirstructure dirstructure;
@@ -370,21 +482,14 @@ void wxMaxima::ConsoleAppend(wxString s, int type, wxString userLabel)
 
   if (m_maxOutputCellsPerCommand > 0)
   {
-    // If we already have output more lines than we are allowed to we a inform the user
-    // about this and return.
-    if (m_outputCellsFromCurrentCommand++ == m_maxOutputCellsPerCommand)
+    // If we already have output more lines than we are allowed to we don't display
+    // the rest of the output but keep it collapsed until the user asks for it.
+    if (m_outputCellsFromCurrentCommand++ >= m_maxOutputCellsPerCommand)
     {
-      DoRawConsoleAppend(
-              _("... [suppressed additional lines since the output is longer than allowed in the configuration] "),
-              MC_TYPE_ERROR);
-      return;
-    };
-
-
-    // If we already have output more lines than we are allowed to and we already
-    // have informed the user about this we return immediately
-    if (m_outputCellsFromCurrentCommand > m_maxOutputCellsPerCommand)
+      if ((type == MC_TYPE_DEFAULT) || (type == MC_TYPE_ERROR) || (type == MC_TYPE_WARNING))
+        m_console->AppendCollapsedOutput(CollapsibleXML(s, type), userLabel);
       return;
+    }
   }
 
   if ((type != MC_TYPE_ERROR) && (type != MC_TYPE_WARNING))
@@ -478,6 +583,53 @@ void wxMaxima::ConsoleAppend(wxString s, int type, wxString userLabel)
 //  m_console->Recalculate();
 }
 
+wxString wxMaxima::CollapsibleXML(wxString s, int type)
+{
+  wxString textType;
+  if (type == MC_TYPE_ERROR)
+    textType = wxT(" type=\"error\"");
+  if (type == MC_TYPE_WARNING)
+    textType = wxT(" type=\"warning\"");
+
+  wxString xml;
+  while (s.Length() > 0)
+  {
+    int start = wxNOT_FOUND;
+    if (type == MC_TYPE_DEFAULT)
+      start = s.Find(wxT("<mth"));
+
+    // Text outside a math tag: Each line becomes a line of text.
+    wxString text = s;
+    if (start != wxNOT_FOUND)
+      text = s.Left(start);
+    wxStringTokenizer lines(text, wxT("\n"));
+    while (lines.HasMoreTokens())
+    {
+      wxString line = lines.GetNextToken();
+      wxString trimmed = line;
+      trimmed.Trim();
+      trimmed.Trim(false);
+      if (trimmed.Length() > 0)
+        xml += wxT("<mth><t") + textType + wxT(">") + MathCell::XMLescape(line) + wxT("</t></mth>");
+    }
+
+    if (start == wxNOT_FOUND)
+      break;
+
+    // The math tag itself already is xml.
+    int end = s.Find(wxT("</mth>"));
+    if (end == wxNOT_FOUND)
+      end = s.Length();
+    else
+      end += 6;
+    wxString math = s.Mid(start, end - start);
+    math.Replace(wxT("\n"), wxT(" "), true);
+    xml += math;
+    s = s.Mid(end);
+  }
+  return wxT("<span>") + xml + wxT("</span>");
+}
+
 void wxMaxima::DoConsoleAppend(wxString s, int type, bool newLine,
                                bool bigSkip, wxString userLabel)
 {
@@ -524,68 +676,60 @@ void wxMaxima::DoRawConsoleAppend(wxString s, int type)
   }
 
   else
-  {
-    wxStringTokenizer tokens(s, wxT("\n"));
-    int count = 0;
-    MathCell *tmp = NULL, *lst = NULL;
-    while (tokens.HasMoreTokens())
-    {
-      TextCell *cell = new TextCell(m_console->GetTree(), &(m_console->m_configuration),
-                                    &m_console->m_cellPointers,
-                                    tokens.GetNextToken());
+    m_console->InsertLine(TextLines(s, type), true);
+
+  if (scrollToCaret) m_console->ScrollToCaret();
+}
 
-      cell->SetType(type);
+MathCell *wxMaxima::TextLines(wxString s, int type)
+{
+  wxStringTokenizer tokens(s, wxT("\n"));
+  MathCell *tmp = NULL, *lst = NULL;
+  while (tokens.HasMoreTokens())
+  {
+    TextCell *cell = new TextCell(m_console->GetTree(), &(m_console->m_configuration),
+                                  &m_console->m_cellPointers,
+                                  tokens.GetNextToken());
 
-      if (tokens.HasMoreTokens())
-        cell->SetSkip(false);
+    cell->SetType(type);
 
-      if (lst == NULL)
-        tmp = lst = cell;
-      else
-      {
-        lst->AppendCell(cell);
-        cell->ForceBreakLine(true);
-        lst = cell;
-      }
+    if (tokens.HasMoreTokens())
+      cell->SetSkip(false);
 
-      count++;
+    if (lst == NULL)
+      tmp = lst = cell;
+    else
+    {
+      lst->AppendCell(cell);
+      cell->ForceBreakLine(true);
+      lst = cell;
     }
-    m_console->InsertLine(tmp, true);
   }
-
-  if (scrollToCaret) m_console->ScrollToCaret();
+  return tmp;
 }
 
-/*! Remove empty statements
- *
- * We need to remove any statement which would be considered empty
- * and thus cause an error. Comments within non-empty expressions seem to
- * be fine.
- *
- * What we need to remove is any statements which are any amount of whitespace
- * and any amount of comments, in any order, ended by a semicolon,
- * and nothing else.
- *
- * The most that should be left over is a single empty statement, ";".
- *
- * @param s The command string from which to remove comment expressions.
- */
-void wxMaxima::StripComments(wxString &s)
+void wxMaxima::WriteToMaximaStdin(const char *data, size_t length)
 {
-  if (s.StartsWith(wxT(":lisp\n")) || s.StartsWith(wxT(":lisp ")))
+  // The pipe is non-blocking: Write() writes only as much as fits into it.
+  // Maxima's stdout is read by a thread of its own, see MaximaProcess, so
+  // maxima can always make room by reading on.
+  while ((length > 0) && (m_maximaStdin != NULL))
   {
-    int start = 0;
-    int commentStart = 0;
-    while ((commentStart = s.find(wxT(';'), start)) != wxNOT_FOUND)
+    m_maximaStdin->Write(data, length);
+    size_t written = m_maximaStdin->LastWrite();
+    if (written == 0)
     {
-      int commentEnd = s.find(wxT('\n'), commentStart);
-      if (commentEnd == wxNOT_FOUND)
-        commentEnd = s.length();
-      s = s.SubString(0, commentStart - 1) + s.SubString(commentEnd, s.length());
+      if (m_maximaStdin->GetLastError() != wxSTREAM_NO_ERROR)
+      {
+        SetStatusText(_("Could not send the command to maxima."), 1);
+        return;
+      }
+      wxMilliSleep(1);
+      continue;
     }
+    data += written;
+    length -= written;
   }
-  else
-    m_blankStatementRegEx.Replace(&s, wxT(";"));
 }
 
 void wxMaxima::SendMaxima(wxString s, bool addToHistory)
@@ -593,9 +737,8 @@ void wxMaxima::SendMaxima(wxString s, bool addToHistory)
   // Normally we catch parenthesis errors before adding cells to the
   // evaluation queue. But if the error is introduced only after the
   // cell is placed in the evaluation queue we need to catch it here.
-  int index;
-  wxString parenthesisError = GetUnmatchedParenthesisState(s,index);
-  if (parenthesisError == wxEmptyString)
+  CommandPreprocessor command;
+  if (command.Process(s, m_inLispMode))
   {
 
     if (!m_variablesOK)
@@ -604,8 +747,6 @@ void wxMaxima::SendMaxima(wxString s, bool addToHistory)
       SetupVariables();
     }
 
-    s = m_console->UnicodeToMaxima(s);
-
     // If there is no working group and we still are trying to send something
     // we are trying to change maxima's settings from the background and might never
     // get an answer that changes the status again.
@@ -616,61 +757,35 @@ void wxMaxima::SendMaxima(wxString s, bool addToHistory)
 
     m_dispReadOut = false;
 
+    // The command with its unicode characters translated and its empty statements removed
+    s = command.GetCommand();
+
     /// Add this command to History
     if (addToHistory)
       AddToHistory(s);
 
-    StripComments(s);
-
-    if (s.StartsWith(wxT(":lisp ")) || s.StartsWith(wxT(":lisp\n")))
-      s.Replace(wxT("\n"), wxT(" "));
-
-    s.Trim(true);
-    s.Append(wxT("\n"));
-
-    /// Check for function/variable definitions
-    wxStringTokenizer commands(s, wxT(";$"));
-    while (commands.HasMoreTokens())
-    {
-      wxString line = commands.GetNextToken();
-      if (m_varRegEx.Matches(line))
-        m_console->AddSymbol(m_varRegEx.GetMatch(line, 1));
-
-      if (m_funRegEx.Matches(line))
-      {
-        wxString funName = m_funRegEx.GetMatch(line, 1);
-        m_console->AddSymbol(funName);
-
-        /// Create a template from the input
-        wxString args = m_funRegEx.GetMatch(line, 2);
-        wxStringTokenizer argTokens(args, wxT(","));
-        funName << wxT("(");
-        int count = 0;
-        while (argTokens.HasMoreTokens())
-        {
-          if (count > 0)
-            funName << wxT(",");
-          wxString a = argTokens.GetNextToken().Trim().Trim(false);
-          if (a != wxEmptyString)
-          {
-            if (a[0] == '[')
-              funName << wxT("[<") << a.SubString(1, a.Length() - 2) << wxT(">]");
-            else
-              funName << wxT("<") << a << wxT(">");
-            count++;
-          }
-        }
-        funName << wxT(")");
-        m_console->AddSymbol(funName, AutoComplete::tmplte);
-      }
-    }
+    /// Offer the functions and variables the command defines for autocompletion
+    AddToAutocompletion(command);
 
     if (m_client)
     {
 #if wxUSE_UNICODE
       m_client->Write(s.utf8_str(), strlen(s.utf8_str()));
+      m_sessionRecording.Add(SessionRecording::toMaxima, s.utf8_str(), strlen(s.utf8_str()));
 #else
       m_client->Write(s.c_str(), s.Length());
+      m_sessionRecording.Add(SessionRecording::toMaxima, s.c_str(), s.Length());
+#endif
+      m_statusBar->NetworkStatus(StatusBar::transmit);
+    }
+    else if (m_pipeTransport && (m_maximaStdin != NULL))
+    {
+#if wxUSE_UNICODE
+      WriteToMaximaStdin(s.utf8_str(), strlen(s.utf8_str()));
+      m_sessionRecording.Add(SessionRecording::toMaxima, s.utf8_str(), strlen(s.utf8_str()));
+#else
+      WriteToMaximaStdin(s.c_str(), s.Length());
+      m_sessionRecording.Add(SessionRecording::toMaxima, s.c_str(), s.Length());
 #endif
       m_statusBar->NetworkStatus(StatusBar::transmit);
     }
@@ -678,12 +793,27 @@ void wxMaxima::SendMaxima(wxString s, bool addToHistory)
   else
   {
     ConsoleAppend(_("Refusing to send cell to maxima: ") +
-                  parenthesisError + wxT("\n"),
+                  command.GetError() + wxT("\n"),
                   MC_TYPE_ERROR);
     m_console->m_cellPointers.SetWorkingGroup(NULL);
   }
 }
 
+void wxMaxima::AddToAutocompletion(CommandPreprocessor &command)
+{
+  const wxArrayString &variables = command.GetVariables();
+  for (size_t i = 0; i < variables.GetCount(); i++)
+    m_console->AddSymbol(variables[i]);
+
+  const wxArrayString &functions = command.GetFunctions();
+  for (size_t i = 0; i < functions.GetCount(); i++)
+    m_console->AddSymbol(functions[i]);
+
+  const wxArrayString &templates = command.GetTemplates();
+  for (size_t i = 0; i < templates.GetCount(); i++)
+    m_console->AddSymbol(templates[i], AutoComplete::tmplte);
+}
+
 ///--------------------------------------------------------------------------------
 ///  Socket stuff
 ///--------------------------------------------------------------------------------
@@ -710,11 +840,6 @@ void wxMaxima::ClientEvent(wxSocketEvent &event)
     case wxSOCKET_INPUT:
       m_statusBar->NetworkStatus(StatusBar::receive);
 
-      // Read out stderr: We will do that in the background on a regular basis, anyway.
-      // But if we do it manually now, too, the probability that things are presented
-      // to the user in chronological order increases a bit.
-      ReadStdErr();
-
       // It is theoretically possible that the client has exited after sending us
       // data and before we had been able to process it.
       if (m_client == NULL)
@@ -726,72 +851,8 @@ void wxMaxima::ClientEvent(wxSocketEvent &event)
       {
         int read;
         read = m_client->LastCount();
-
-        // For some reason our input buffer can actually contain NULL Chars...
-        SanitizeSocketBuffer(m_inputBuffer, read);
-        m_inputBuffer[read] = 0;
-
-        wxString newChars;
-        {
-          // Don't open a assert window every single time maxima mixes UTF8 and the current
-          // codepage
-          wxLogStderr logStderr;
-#if wxUSE_UNICODE
-          newChars = wxString(m_inputBuffer, wxConvUTF8);
-#else
-          newChars = wxString(m_inputBuffer, *wxConvCurrent);
-#endif
-        }
-        if (IsPaneDisplayed(menu_pane_xmlInspector))
-          m_xmlInspector->Add(newChars);
-
-        // This way we can avoid searching the whole string for a
-        // ending tag if we have received only a few bytes of the
-        // data between 2 tags
-        if(m_currentOutput != wxEmptyString)
-          m_currentOutputEnd = m_currentOutput.Right(MIN(30,m_currentOutput.Length())) + newChars;
-        else
-          m_currentOutputEnd = wxEmptyString;
-        
-        m_currentOutput += newChars;
-
-        if (!m_dispReadOut &&
-            (m_currentOutput != wxT("\n")) &&
-            (m_currentOutput != wxT("<wxxml-symbols></wxxml-symbols>")))
-        {
-          StatusMaximaBusy(transferring);
-          m_dispReadOut = true;
-        }
-
-        size_t length_old = -1;
-
-        while (length_old != m_currentOutput.Length())
-        {
-          length_old = m_currentOutput.Length();
-
-          // Handle the <mth> tag that contains math output and sometimes text.
-          ReadMath(m_currentOutput);
-
-          // The following function calls each extract and remove one type of XML tag
-          // information from the beginning of the data string we got - but only do so
-          // after the closing tag has been transferred, as well.
-          ReadLoadSymbols(m_currentOutput);
-
-          // The prompt that tells us that maxima awaits the next command
-          ReadPrompt(m_currentOutput);
-
-          // Handle the XML tag that contains Status bar updates
-          ReadStatusBar(m_currentOutput);
-
-          // Handle text that isn't wrapped in a known tag
-          if (!m_first)
-            // Handle text that isn't XML output: Mostly Error messages or warnings.
-            ReadMiscText(m_currentOutput);
-          else
-            // This function determines the port maxima is running on from  the text
-            // maxima outputs at startup. This piece of text is afterwards discarded.
-            ReadFirstPrompt(m_currentOutput);
-        }
+        m_sessionRecording.Add(SessionRecording::fromMaxima, m_inputBuffer, read);
+        InterpretMaximaOutput(DecodeMaximaOutput(m_inputBuffer, read));
       }
       break;
 
@@ -810,8 +871,7 @@ void wxMaxima::ClientEvent(wxSocketEvent &event)
       if (!m_closing)
       {
         m_process = NULL;
-        m_maximaStdout = NULL;
-        m_maximaStderr = NULL;
+        m_maximaStdin = NULL;
       }
       m_isConnected = false;
       m_currentOutput = wxEmptyString;
@@ -841,6 +901,135 @@ void wxMaxima::ClientEvent(wxSocketEvent &event)
   }
 }
 
+wxString wxMaxima::DecodeMaximaOutput(char *buffer, int length)
+{
+  // For some reason our input buffer can actually contain NULL Chars...
+  SanitizeSocketBuffer(buffer, length);
+  buffer[length] = 0;
+
+  wxString newChars;
+  {
+    // Don't open a assert window every single time maxima mixes UTF8 and the current
+    // codepage
+    wxLogStderr logStderr;
+#if wxUSE_UNICODE
+    newChars = wxString(buffer, wxConvUTF8);
+#else
+    newChars = wxString(buffer, *wxConvCurrent);
+#endif
+  }
+  return newChars;
+}
+
+void wxMaxima::InterpretMaximaOutput(wxString newChars)
+{
+  if (IsPaneDisplayed(menu_pane_xmlInspector))
+    m_xmlInspector->Add(newChars);
+
+  // This way we can avoid searching the whole string for a
+  // ending tag if we have received only a few bytes of the
+  // data between 2 tags
+  if(m_currentOutput != wxEmptyString)
+    m_currentOutputEnd = m_currentOutput.Right(MIN(30,m_currentOutput.Length())) + newChars;
+  else
+    m_currentOutputEnd = wxEmptyString;
+  
+  m_currentOutput += newChars;
+
+  if (!m_dispReadOut &&
+      (m_currentOutput != wxT("\n")) &&
+      (m_currentOutput != wxT("<wxxml-symbols></wxxml-symbols>")))
+  {
+    StatusMaximaBusy(transferring);
+    m_dispReadOut = true;
+  }
+
+  // All output this packet contains is laid out and displayed in one go.
+  m_console->BeginOutputBatch();
+
+  size_t length_old = -1;
+
+  while (length_old != m_currentOutput.Length())
+  {
+    length_old = m_currentOutput.Length();
+
+    // Handle messages that are preceded by a header that tells their length.
+    ReadFrame(m_currentOutput);
+
+    // Handle the <mth> tag that contains math output and sometimes text.
+    ReadMath(m_currentOutput);
+
+    // The following function calls each extract and remove one type of XML tag
+    // information from the beginning of the data string we got - but only do so
+    // after the closing tag has been transferred, as well.
+    ReadLoadSymbols(m_currentOutput);
+
+    // The prompt that tells us that maxima awaits the next command. Reacting
+    // to it needs the output of the finished command to be laid out.
+    if (m_currentOutput.StartsWith(m_promptPrefix))
+      m_console->FlushOutputBatch();
+    ReadPrompt(m_currentOutput);
+
+    // Handle the XML tag that contains Status bar updates
+    ReadStatusBar(m_currentOutput);
+
+    // The acknowledgement of the setup commands
+    ReadSetupDone(m_currentOutput);
+
+    // Handle text that isn't wrapped in a known tag
+    if (!m_first)
+      // Handle text that isn't XML output: Mostly Error messages or warnings.
+      ReadMiscText(m_currentOutput);
+    else
+      // This function determines the port maxima is running on from  the text
+      // maxima outputs at startup. This piece of text is afterwards discarded.
+      ReadFirstPrompt(m_currentOutput);
+  }
+
+  m_console->EndOutputBatch();
+}
+
+bool wxMaxima::StartReplay()
+{
+  if (!m_sessionReplay.Load(m_replayFile))
+    return false;
+
+  m_replayRecord = 0;
+  m_replayedBytes = 0;
+  m_first = true;
+  SetStatusText(_("Replaying a recorded session..."), 1);
+  m_console->ResetRedrawCounters();
+  m_replayStopWatch.Start();
+  m_replayTimer.StartOnce(1);
+  return true;
+}
+
+void wxMaxima::ReplayNextRecord()
+{
+  // Nobody would answer the commands that were sent to maxima.
+  while ((m_replayRecord < m_sessionReplay.GetRecordCount()) &&
+         (m_sessionReplay.GetRecord(m_replayRecord).m_direction != SessionRecording::fromMaxima))
+    m_replayRecord++;
+
+  if (m_replayRecord >= m_sessionReplay.GetRecordCount())
+  {
+    SetStatusText(wxString::Format(_("Replayed %li bytes of output in %li ms, %li of %li requested redraws performed"),
+                                   m_replayedBytes, m_replayStopWatch.Time(),
+                                   m_console->GetRedrawsPerformed(), m_console->GetRedrawsRequested()), 1);
+    return;
+  }
+
+  wxMemoryBuffer &data = m_sessionReplay.GetRecord(m_replayRecord++).m_data;
+  wxCharBuffer buffer(data.GetDataLen());
+  memcpy(buffer.data(), data.GetData(), data.GetDataLen());
+  m_replayedBytes += data.GetDataLen();
+  InterpretMaximaOutput(DecodeMaximaOutput(buffer.data(), data.GetDataLen()));
+
+  // Return to the event loop between two chunks of output, just as we would do
+  // if they had been sent by maxima.
+  m_replayTimer.StartOnce(1);
+}
+
 /*!
  * ServerEvent is triggered when maxima connects to the socket server.
  */
@@ -854,7 +1043,17 @@ void wxMaxima::ServerEvent(wxSocketEvent &event)
       if (m_isConnected)
       {
         wxSocketBase *tmp = m_server->Accept(false);
-        tmp->Close();
+        if ((m_standbyProcess != NULL) && (m_standbyClient == NULL))
+        {
+          // This is the standby maxima we have started in the background.
+          m_standbyClient = tmp;
+          m_standbyClient->SetEventHandler(*this, socket_standby_id);
+          m_standbyClient->SetNotify(wxSOCKET_INPUT_FLAG | wxSOCKET_LOST_FLAG);
+          m_standbyClient->Notify(true);
+          SetupStandby();
+        }
+        else
+          tmp->Close();
         return;
       }
       m_statusBar->NetworkStatus(StatusBar::idle);
@@ -876,11 +1075,11 @@ void wxMaxima::ServerEvent(wxSocketEvent &event)
       m_statusBar->NetworkStatus(StatusBar::offline);
       StatusMaximaBusy(disconnected);
       SetBatchMode(false);
-      ReadStdErr();
       m_pid = -1;
       m_isConnected = false;
       if (!m_closing)
       {
+        FinishHeadless(wxT("maxima terminated"));
         if (m_unsuccessfullConnectionAttempts > 0)
           ConsoleAppend(wxT("\nSERVER: Lost socket connection ...\n"
                                     "Restart Maxima with 'Maxima->Restart Maxima'.\n"),
@@ -951,9 +1150,11 @@ bool wxMaxima::StartMaxima(bool force)
   {
     // The new maxima process will be in its initial condition => mark it as such.
     m_hasEvaluatedCells = false;
+    m_console->m_cellPointers.m_commandsInFlight.clear();
+    KillKernels();
+    // Nothing has been evaluated in the new maxima, yet.
+    m_maximaSession = ++m_maximaSessions;
 
-    // We start checking for maximas output again as soon as we send some data to the program.
-    m_maximaStdoutPollTimer.Stop();
     m_CWD = wxEmptyString;
     if (m_isConnected)
     {
@@ -966,32 +1167,47 @@ bool wxMaxima::StartMaxima(bool force)
     m_console->m_cellPointers.SetWorkingGroup(NULL);
 
     m_variablesOK = false;
+
+    m_pipeTransport = false;
+    wxConfig::Get()->Read(wxT("pipeTransport"), &m_pipeTransport);
+
+    if (SwapInStandby())
+    {
+      m_console->m_cellPointers.m_errorList.Clear();
+      return true;
+    }
+    // A standby that is still starting up would be mistaken for the maxima
+    // we start now.
+    KillStandby();
+
     wxString command = GetCommand();
 
+    // If we talk to maxima via its stdin and stdout we only need to know its
+    // process id: setup-client is the command that would tell us and it would
+    // redirect maxima's output to a socket.
+    wxString pipeSetup = wxT(" -r \":lisp (progn (princ (quote |pid=|)) (princ (getpid)) (terpri))\"");
+
     if (command.Length() > 0)
     {
 
-#if defined(__WXMSW__)
-      wxString clisp = command.SubString(1, command.Length() - 3);
-      clisp.Replace("\\bin\\maxima.bat", "\\clisp-*.*");
-      if (wxFindFirstFile(clisp, wxDIR).empty())
-        command.Append(wxString::Format(wxT(" -s %d "), m_port));
+      if (m_pipeTransport)
+        command.Append(pipeSetup);
       else
-        command.Append(wxString::Format(wxT(" -r \":lisp (setup-client %d)\""), m_port));
+        command.Append(SocketParameters(command, m_port));
+#if defined(__WXMSW__)
       wxSetEnv(wxT("home"), wxGetHomeDir());
       wxSetEnv(wxT("maxima_signals_thread"), wxT("1"));
-#else
-      command.Append(wxString::Format(wxT(" -r \":lisp (setup-client %d)\""),
-                                      m_port));
 #endif
 
 #if defined __WXMAC__
       wxSetEnv(wxT("DISPLAY"), wxT(":0.0"));
 #endif
 
-      m_process = new wxProcess(this, maxima_process_id);
-      m_process->Redirect();
+      m_process = new MaximaProcess(this, maxima_process_id);
+      m_processOutput = wxEmptyString;
       m_first = true;
+      m_startupStopWatch.Start();
+      m_startupTime = -1;
       m_pid = -1;
       SetStatusText(_("Starting Maxima..."), 1);
       if (wxExecute(command, wxEXEC_ASYNC, m_process) < 0)
@@ -999,15 +1215,23 @@ bool wxMaxima::StartMaxima(bool force)
         StatusMaximaBusy(process_wont_start);
         SetStatusText(_("Cannot start the maxima binary"), 1);
         m_process = NULL;
-        m_maximaStdout = NULL;
-        m_maximaStderr = NULL;
+        m_maximaStdin = NULL;
         m_statusBar->NetworkStatus(StatusBar::offline);
         return false;
       }
-      m_maximaStdout = m_process->GetInputStream();
-      m_maximaStderr = m_process->GetErrorStream();
+      m_process->StartReading(maxima_stdout_id, maxima_stderr_id);
       m_lastPrompt = wxT("(%i1) ");
       StatusMaximaBusy(wait_for_start);
+
+      if (m_pipeTransport)
+      {
+        // There is no connection to wait for: We can talk to maxima right now.
+        m_maximaStdin = m_process->GetOutputStream();
+        m_statusBar->NetworkStatus(StatusBar::idle);
+        m_currentOutput = wxEmptyString;
+        m_isConnected = true;
+        SetupVariables();
+      }
     }
     else
     {
@@ -1019,75 +1243,786 @@ bool wxMaxima::StartMaxima(bool force)
   return true;
 }
 
-
-void wxMaxima::Interrupt(wxCommandEvent &event)
+wxString wxMaxima::SocketParameters(wxString command, int port)
 {
-  if (m_pid < 0)
-  {
-    GetMenuBar()->Enable(menu_interrupt_id, false);
-    return;
-  }
-#if defined (__WXMSW__)
-  wxString path, maxima = GetCommand(false);
-  wxArrayString out;
-  maxima = maxima.SubString(2, maxima.Length() - 3);
-  wxFileName::SplitPath(maxima, &path, NULL, NULL);
-  wxString command = wxT("\"") + path + wxT("\\winkill.exe\"");
-  command += wxString::Format(wxT(" -INT %ld"), m_pid);
-  wxExecute(command, out);
-#else
-  wxProcess::Kill(m_pid, wxSIGINT);
+#if defined(__WXMSW__)
+  wxString clisp = command.SubString(1, command.Length() - 3);
+  clisp.Replace("\\bin\\maxima.bat", "\\clisp-*.*");
+  if (wxFindFirstFile(clisp, wxDIR).empty())
+    return wxString::Format(wxT(" -s %d "), port);
 #endif
+  return wxString::Format(wxT(" -r \":lisp (setup-client %d)\""), port);
 }
 
-void wxMaxima::KillMaxima()
+void wxMaxima::StartStandby()
 {
-  if (m_process)
-  {
-    m_process->Detach();
-    m_maximaStdout = NULL;
-    m_maximaStderr = NULL;
-    m_process = NULL;
-  }
+  if ((m_standbyProcess != NULL) || (m_server == NULL) || (!m_isConnected) ||
+      m_pipeTransport || (m_replayFile != wxEmptyString))
+    return;
 
-  if (m_pid <= 0)
-  {
-    if (m_inLispMode)
-      SendMaxima(wxT("($quit)"));
-    else
-      SendMaxima(wxT("quit();"));
+  bool warmStandby = false;
+  wxConfig::Get()->Read(wxT("warmStandby"), &warmStandby);
+  if (!warmStandby)
     return;
-  }
+
+  wxString command = GetCommand();
+  if (command.Length() == 0)
+    return;
+  command.Append(SocketParameters(command, m_port));
+
+  m_standbyProcess = new MaximaProcess(this, maxima_process_id);
+  m_standbyPid = -1;
+  m_standbyReady = false;
+  m_standbyOutput = wxEmptyString;
+  m_standbyProcessOutput = wxEmptyString;
+  if (wxExecute(command, wxEXEC_ASYNC, m_standbyProcess) < 0)
+    m_standbyProcess = NULL;
   else
-    wxProcess::Kill(m_pid, wxSIGKILL);
+    m_standbyProcess->StartReading(maxima_stdout_id, maxima_stderr_id);
+}
 
-  if (m_client)
-    m_client->Close();
-  m_client = NULL;
-  m_isConnected = false;
-  m_process = NULL;
-  m_maximaStdout = NULL;
-  m_maximaStderr = NULL;
-  m_currentOutput = wxEmptyString;
-  m_console->QuestionAnswered();
+void wxMaxima::SetupStandby()
+{
+  wxString command = CommandPreprocessor::UnicodeToMaxima(SetupPayload(GetSetupCommands())) + wxT("\n");
+#if wxUSE_UNICODE
+  m_standbyClient->Write(command.utf8_str(), strlen(command.utf8_str()));
+#else
+  m_standbyClient->Write(command.c_str(), command.Length());
+#endif
 }
 
-void wxMaxima::OnProcessEvent(wxProcessEvent &event)
+void wxMaxima::StandbyEvent(wxSocketEvent &event)
 {
-  m_statusBar->NetworkStatus(StatusBar::offline);
-  if (!m_closing)
+  switch (event.GetSocketEvent())
   {
-    SetStatusText(_("Maxima process terminated."), 1);
+    case wxSOCKET_INPUT:
+      if (m_standbyClient == NULL)
+        return;
 
-    // Let's see if maxima has told us why this did happen.
-    ReadStdErr();
+      m_standbyClient->Read(m_inputBuffer, SOCKET_SIZE);
+      if (m_standbyClient->Error())
+        return;
 
-    // if m_closing==true we might already have a new process
-    // and therefore the following lines would probably mark
-    // the wrong process as "deleted".
+      m_standbyOutput += DecodeMaximaOutput(m_inputBuffer, m_standbyClient->LastCount());
+      // The marker stays in the output: ReadSetupDone() will see it once the
+      // standby is swapped in.
+      if ((!m_standbyReady) && (m_standbyOutput.Find(m_setupDoneMarker) != wxNOT_FOUND))
+      {
+        // The process id of the lisp: The pid of the process we have started
+        // might be the one of the script that has started the lisp.
+        int s = m_standbyOutput.Find(wxT("pid="));
+        if (s != wxNOT_FOUND)
+        {
+          wxString pid = m_standbyOutput.Mid(s + 4).BeforeFirst(wxT('\n'));
+          pid.Trim().ToLong(&m_standbyPid);
+        }
+        m_standbyReady = true;
+      }
+      break;
+
+    case wxSOCKET_LOST:
+      KillStandby();
+      break;
+
+    default:
+      break;
+  }
+}
+
+bool wxMaxima::SwapInStandby()
+{
+  if ((!m_standbyReady) || m_pipeTransport)
+    return false;
+
+  // KillMaxima() doesn't close the connection to a maxima it has only asked to quit.
+  if (m_client != NULL)
+  {
+    m_client->Notify(false);
+    m_client->Destroy();
+  }
+
+  m_client = m_standbyClient;
+  m_client->SetEventHandler(*this, socket_client_id);
+  m_process = m_standbyProcess;
+  m_processOutput = m_standbyProcessOutput;
+  m_standbyProcessOutput = wxEmptyString;
+  m_maximaStdin = NULL;
+  m_standbyClient = NULL;
+  m_standbyProcess = NULL;
+  m_standbyPid = -1;
+  m_standbyReady = false;
+  wxString output = m_standbyOutput;
+  m_standbyOutput = wxEmptyString;
+
+  m_isConnected = true;
+  m_variablesOK = true;
+  m_first = true;
+  m_startupStopWatch.Start();
+  m_startupTime = -1;
+  m_pid = -1;
+  m_currentOutput = wxEmptyString;
+  m_lastPrompt = wxT("(%i1) ");
+  m_statusBar->NetworkStatus(StatusBar::idle);
+  StatusMaximaBusy(wait_for_start);
+#ifndef __WXMSW__
+  ReadProcessOutput();
+#endif
+  SetupDocument();
+
+  // The standby has already sent its greeting and the answer to our setup
+  // commands: Let them take the same way the output of a fresh maxima takes.
+  // This also starts the next standby.
+  m_sessionRecording.Add(SessionRecording::fromMaxima, output.utf8_str(), strlen(output.utf8_str()));
+  InterpretMaximaOutput(output);
+  return true;
+}
+
+void wxMaxima::KillStandby()
+{
+  if (m_standbyProcess != NULL)
+  {
+    m_standbyProcess->Detach();
+    if (m_standbyPid > 0)
+      wxProcess::Kill(m_standbyPid, wxSIGKILL);
+    else if (m_standbyProcess->GetPid() > 0)
+      wxProcess::Kill(m_standbyProcess->GetPid(), wxSIGKILL);
+  }
+  m_standbyProcess = NULL;
+
+  if (m_standbyClient != NULL)
+  {
+    m_standbyClient->Notify(false);
+    m_standbyClient->Destroy();
+  }
+  m_standbyClient = NULL;
+  m_standbyPid = -1;
+  m_standbyReady = false;
+  m_standbyOutput = wxEmptyString;
+  m_standbyProcessOutput = wxEmptyString;
+}
+
+void wxMaxima::EvaluateSectionsInParallel()
+{
+  m_console->m_evaluationQueue.Clear();
+  m_console->ResetInputPrompts();
+  EvaluationQueueLength(0);
+  if (m_console->m_configuration->RestartOnReEvaluation())
+    StartMaxima();
+
+  std::list<std::list<GroupCell *> > sections;
+  sections.push_back(std::list<GroupCell *>());
+  CollectSections(m_console->GetTree(), sections);
+
+  // Everything in front of the first section is evaluated by our maxima.
+  // The sections might depend on its definitions so every additional maxima
+  // evaluates it, too, before its first section.
+  std::list<GroupCell *> preamble = sections.front();
+  for (std::list<GroupCell *>::iterator cell = preamble.begin(); cell != preamble.end(); ++cell)
+    m_console->AddToEvaluationQueue(*cell);
+  sections.pop_front();
+
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+  {
+    (*it)->m_preamble.Clear();
+    (*it)->m_evaluationQueue.Clear();
+  }
+
+  // A recorded session cannot answer the additional maximas.
+  if (m_replayFile == wxEmptyString)
+  {
+    while ((m_kernels.size() < sections.size()) &&
+           ((long) m_kernels.size() < m_console->m_configuration->SectionKernels()))
+    {
+      if (StartKernel() == NULL)
+        break;
+    }
+  }
+
+  for (std::list<std::list<GroupCell *> >::iterator section = sections.begin(); section != sections.end(); ++section)
+  {
+    // Each section goes to the maxima that has the least cells to evaluate.
+    EvaluationQueue *queue = &m_console->m_evaluationQueue;
+    if (!m_kernels.empty())
+    {
+      MaximaKernel *kernel = m_kernels.front();
+      for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+        if ((*it)->m_evaluationQueue.Size() < kernel->m_evaluationQueue.Size())
+          kernel = *it;
+      queue = &kernel->m_evaluationQueue;
+
+      if (queue->Empty())
+      {
+        for (std::list<GroupCell *>::iterator cell = preamble.begin(); cell != preamble.end(); ++cell)
+          kernel->m_preamble.AddToQueue(*cell);
+      }
+    }
+
+    for (std::list<GroupCell *>::iterator cell = section->begin(); cell != section->end(); ++cell)
+    {
+      if ((*cell)->GetInput() == NULL)
+        continue;
+      // Gray out the output of the cell in order to mark it as "not current".
+      (*cell)->GetInput()->ContainsChanges(true);
+      queue->AddToQueue(*cell);
+    }
+  }
+
+  // The sections are evaluated in parallel: There is no single place to follow.
+  m_console->FollowEvaluation(false);
+  EvaluationQueueLength(m_console->m_evaluationQueue.Size(), m_console->m_evaluationQueue.CommandsLeftInCell());
+  TryEvaluateNextInQueue();
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+    KernelEvaluateNext(*it);
+  KernelStatus();
+  m_console->RequestRedraw();
+}
+
+void wxMaxima::EvaluateChangedCells()
+{
+  m_console->m_evaluationQueue.Clear();
+  EvaluationQueueLength(0);
+
+  std::list<std::list<GroupCell *> > sections;
+  sections.push_back(std::list<GroupCell *>());
+  CollectSections(m_console->GetTree(), sections);
+
+  // The symbols whose definitions have changed. Cells that use one of them
+  // are affected by the change, as well - and so are the symbols they define.
+  // Cells that define one of them again have to be re-evaluated, too, so
+  // their definition still overrides the earlier one.
+  wxSortedArrayString changedSymbols;
+  for (std::list<std::list<GroupCell *> >::iterator section = sections.begin(); section != sections.end(); ++section)
+  {
+    for (std::list<GroupCell *>::iterator it = section->begin(); it != section->end(); ++it)
+    {
+      GroupCell *cell = *it;
+      if (cell->GetEditable() == NULL)
+        continue;
+
+      wxString input = cell->GetEditable()->GetValue();
+      bool affected = cell->ChangedSinceEvaluation(m_maximaSession, input);
+      wxArrayString used = cell->GetUsedSymbols();
+      for (size_t i = 0; (i < used.GetCount()) && (!affected); i++)
+        affected = (changedSymbols.Index(used[i]) != wxNOT_FOUND);
+
+      // Both what the cell used to define and what it defines now changes.
+      wxArrayString defined = cell->GetDefinedSymbols();
+      FindDefinitions(input, defined);
+      for (size_t i = 0; (i < defined.GetCount()) && (!affected); i++)
+        affected = (changedSymbols.Index(defined[i]) != wxNOT_FOUND);
+      if (!affected)
+        continue;
+
+      for (size_t i = 0; i < defined.GetCount(); i++)
+        if (changedSymbols.Index(defined[i]) == wxNOT_FOUND)
+          changedSymbols.Add(defined[i]);
+
+      m_console->AddToEvaluationQueue(cell);
+    }
+  }
+
+  if (m_console->m_evaluationQueue.Empty())
+  {
+    SetStatusText(_("No cell has changed since it has been evaluated."), 1);
+    return;
+  }
+
+  m_console->FollowEvaluation(true);
+  EvaluationQueueLength(m_console->m_evaluationQueue.Size(), m_console->m_evaluationQueue.CommandsLeftInCell());
+  TryEvaluateNextInQueue();
+}
+
+void wxMaxima::FindDefinitions(wxString commands, wxArrayString &defined)
+{
+  CommandPreprocessor command;
+  command.Process(commands, m_inLispMode);
+
+  // The definitions are the ones SendMaxima() offers for autocompletion.
+  WX_APPEND_ARRAY(defined, command.GetVariables());
+  WX_APPEND_ARRAY(defined, command.GetFunctions());
+}
+
+void wxMaxima::CollectSections(GroupCell *tree, std::list<std::list<GroupCell *> > &sections)
+{
+  while (tree != NULL)
+  {
+    if ((tree->GetGroupType() == GC_TYPE_TITLE) || (tree->GetGroupType() == GC_TYPE_SECTION))
+      sections.push_back(std::list<GroupCell *>());
+
+    if (tree->GetGroupType() == GC_TYPE_CODE)
+      sections.back().push_back(tree);
+
+    // Like AddDocumentToEvaluationQueue() we don't evaluate the cells folded away.
+    tree = dynamic_cast<GroupCell *>(tree->m_next);
+  }
+}
+
+MaximaKernel *wxMaxima::StartKernel()
+{
+  wxString command = GetCommand();
+  if (command.Length() == 0)
+    return NULL;
+
+  int number = 1;
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+    if ((*it)->GetNumber() >= number)
+      number = (*it)->GetNumber() + 1;
+
+  MaximaKernel *kernel = new MaximaKernel(number, ++m_maximaSessions);
+  int port = kernel->StartServer(this, socket_kernel_server_id, m_port + 1);
+  if ((port < 0) ||
+      (!kernel->StartProcess(this, kernel_process_id, kernel_stdout_id, kernel_stderr_id,
+                             command + SocketParameters(command, port))))
+  {
+    delete kernel;
+    return NULL;
+  }
+  kernel->SetMarkers(m_promptPrefix, m_promptSuffix, m_symbolsPrefix, m_symbolsSuffix, m_framePrefix);
+
+  m_kernels.push_back(kernel);
+  m_console->m_sectionQueues.push_back(&kernel->m_preamble);
+  m_console->m_sectionQueues.push_back(&kernel->m_evaluationQueue);
+  return kernel;
+}
+
+MaximaKernel *wxMaxima::FindKernel(wxSocketBase *socket)
+{
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+    if ((*it)->Owns(socket))
+      return *it;
+  return NULL;
+}
+
+void wxMaxima::KernelServerEvent(wxSocketEvent &event)
+{
+  MaximaKernel *kernel = FindKernel(event.GetSocket());
+  if ((kernel == NULL) || (event.GetSocketEvent() != wxSOCKET_CONNECTION))
+    return;
+
+  wxArrayString commands = GetSetupCommands();
+  if (m_console->m_currentFile != wxEmptyString)
+    WX_APPEND_ARRAY(commands, GetCWDCommands(m_console->m_currentFile));
+  if (!kernel->Connect(this, socket_kernel_client_id,
+                       CommandPreprocessor::UnicodeToMaxima(SetupPayload(commands)) + wxT("\n")))
+    KernelLost(kernel, _("Could not connect to an additional maxima."));
+}
+
+void wxMaxima::KernelEvent(wxSocketEvent &event)
+{
+  MaximaKernel *kernel = FindKernel(event.GetSocket());
+  if (kernel == NULL)
+    return;
+
+  switch (event.GetSocketEvent())
+  {
+    case wxSOCKET_INPUT:
+    {
+      kernel->GetClient()->Read(m_inputBuffer, SOCKET_SIZE);
+      if (kernel->GetClient()->Error())
+        return;
+      kernel->AddOutput(DecodeMaximaOutput(m_inputBuffer, kernel->GetClient()->LastCount()));
+
+      if (!kernel->ReadSetupDone(m_setupDoneMarker))
+        return;
+
+      std::list<MaximaKernel::Output> output;
+      kernel->ReadOutput(output);
+      m_console->BeginOutputBatch();
+      for (std::list<MaximaKernel::Output>::iterator it = output.begin(); it != output.end(); ++it)
+      {
+        GroupCell *cell = kernel->GetCell();
+        if (it->m_type != MaximaKernel::Output::prompt)
+        {
+          KernelOutput(kernel, cell, *it);
+          continue;
+        }
+
+        wxString prompt = it->m_text;
+        if (!IsInputPrompt(prompt))
+        {
+          // Nobody would see the question, let alone answer it.
+          m_console->EndOutputBatch();
+          KernelLost(kernel, _("Maxima has asked a question while evaluating a section in parallel. Please evaluate this section using \"Evaluate Cell(s)\"."));
+          return;
+        }
+
+        prompt.Trim(true);
+        prompt.Trim(false);
+        kernel->SetLastPrompt(prompt);
+        if (cell != NULL)
+        {
+          EvaluationQueue &queue = kernel->InPreamble() ? kernel->m_preamble : kernel->m_evaluationQueue;
+          kernel->CommandFinished();
+          // The cell might have been deleted in the meantime.
+          if (queue.GetCell() == cell)
+            queue.RemoveFirst();
+        }
+        m_console->FlushOutputBatch();
+        KernelEvaluateNext(kernel);
+      }
+      m_console->EndOutputBatch();
+      KernelStatus();
+      m_console->RequestRedraw();
+      break;
+    }
+
+    case wxSOCKET_LOST:
+      KernelLost(kernel, _("Lost the connection to the maxima process this section was evaluated in."));
+      break;
+
+    default:
+      break;
+  }
+}
+
+void wxMaxima::KernelOutput(MaximaKernel *kernel, GroupCell *cell, const MaximaKernel::Output &output)
+{
+  if ((cell == NULL) || (m_console->GetTree() == NULL) || (!m_console->GetTree()->Contains(cell)))
+    return;
+
+  int type = MC_TYPE_DEFAULT;
+  switch (output.m_type)
+  {
+    case MaximaKernel::Output::symbols:
+      AddSymbols(output.m_text);
+      return;
+    case MaximaKernel::Output::statusBar:
+      // The status bar tells what our maxima does. KernelStatus() tells
+      // what the additional maximas do.
+      return;
+    case MaximaKernel::Output::warning:
+      type = MC_TYPE_WARNING;
+      break;
+    case MaximaKernel::Output::error:
+      type = MC_TYPE_ERROR;
+      break;
+    default:
+      break;
+  }
+
+  // Clearing the queue below forgets which command has failed.
+  int index = kernel->m_evaluationQueue.GetIndex();
+  if (type == MC_TYPE_ERROR)
+  {
+    bool abortOnError = false;
+    wxConfig::Get()->Read(wxT("abortOnError"), &abortOnError);
+    if (abortOnError || m_batchmode)
+    {
+      kernel->m_preamble.Clear();
+      kernel->m_evaluationQueue.Clear();
+    }
+  }
+
+  // Our maxima displays the output of the cells in front of the first section.
+  if (kernel->InPreamble())
+    return;
+
+  // Like our maxima's output the output that exceeds the maximum number of
+  // output cells per command is kept collapsed, see ConsoleAppend().
+  if ((m_maxOutputCellsPerCommand > 0) && (kernel->CountOutput() >= m_maxOutputCellsPerCommand))
+  {
+    wxString userLabel;
+    if (m_console->m_configuration->UseUserLabels())
+      userLabel = kernel->m_evaluationQueue.GetUserLabel();
+    m_console->AppendCollapsedOutput(CollapsibleXML(output.m_text, type), userLabel, cell);
+    return;
+  }
+
+  if (output.m_type == MaximaKernel::Output::math)
+  {
+    wxString math = output.m_text;
+    math.Replace(wxT("\n"), wxT(" "), true);
+    MathParser mParser(&m_console->m_configuration, &m_console->m_cellPointers);
+    if (m_console->m_configuration->UseUserLabels())
+      mParser.SetUserLabel(kernel->m_evaluationQueue.GetUserLabel());
+    MathCell *line = mParser.ParseLine(wxT("<span>") + math + wxT("</span>"), MC_TYPE_DEFAULT);
+    if (line == NULL)
+      return;
+    line->SetSkip(true);
+    m_console->InsertLine(line, line->BreakLineHere(), cell);
+    return;
+  }
+
+  m_console->InsertLine(TextLines(output.m_text, type), true, cell);
+  if (type == MC_TYPE_ERROR)
+  {
+    m_console->m_cellPointers.m_errorList.Add(cell);
+    cell->GetEditable()->SetErrorIndex(index - 1);
+  }
+}
+
+void wxMaxima::KernelError(GroupCell *cell, wxString message)
+{
+  if ((m_console->GetTree() == NULL) || (!m_console->GetTree()->Contains(cell)))
+    return;
+
+  m_console->InsertLine(TextLines(message, MC_TYPE_ERROR), true, cell);
+  m_console->m_cellPointers.m_errorList.Add(cell);
+}
+
+void wxMaxima::KernelEvaluateNext(MaximaKernel *kernel)
+{
+  if ((!kernel->IsReady()) || (kernel->GetCell() != NULL))
+    return;
+
+  while (true)
+  {
+    // The cells in front of the first section come first: They contain the
+    // definitions the sections rely on.
+    bool preamble = !kernel->m_preamble.Empty();
+    EvaluationQueue &queue = preamble ? kernel->m_preamble : kernel->m_evaluationQueue;
+    if (queue.Empty())
+      return;
+
+    GroupCell *cell = queue.GetCell();
+    if (queue.m_workingGroupChanged && (!preamble))
+    {
+      cell->RemoveOutput();
+      m_console->SetSaved(false);
+      m_console->Recalculate(cell);
+
+      // The whole cell needs to be checked only once, not once per command.
+      // Like in TryEvaluateNextInQueue() we remember what it defines and uses.
+      CommandPreprocessor check;
+      check.Process(cell->GetEditable()->ToString(true), false, true);
+      wxArrayString defined;
+      wxArrayString used;
+      WX_APPEND_ARRAY(defined, check.GetVariables());
+      WX_APPEND_ARRAY(defined, check.GetFunctions());
+      WX_APPEND_ARRAY(used, check.GetSymbols());
+      cell->Evaluated(kernel->GetSession(), cell->GetEditable()->GetValue(), defined, used);
+      if (check.GetError() != wxEmptyString)
+      {
+        KernelError(cell, _("Refusing to send cell to maxima: ") + check.GetError());
+        queue.Clear();
+        return;
+      }
+    }
+
+    wxString text = queue.GetCommand();
+    if ((text == wxEmptyString) || (text == wxT(";")) || (text == wxT("$")))
+    {
+      queue.RemoveFirst();
+      continue;
+    }
+
+    CommandPreprocessor command;
+    if (!command.Process(text))
+    {
+      // Our maxima tells about the errors in the cells in front of the first section.
+      if (preamble)
+      {
+        queue.RemoveFirst();
+        continue;
+      }
+      KernelError(cell, _("Refusing to send cell to maxima: ") + command.GetError());
+      queue.Clear();
+      return;
+    }
+
+    if (!preamble)
+    {
+      cell->GetPrompt()->SetValue(kernel->GetLastPrompt());
+      AddToAutocompletion(command);
+    }
+    kernel->Send(cell, command.GetCommand(), preamble);
+    return;
+  }
+}
+
+void wxMaxima::KernelLost(MaximaKernel *kernel, wxString message)
+{
+  if ((kernel->GetCell() != NULL) && (!kernel->InPreamble()))
+    KernelError(kernel->GetCell(), message);
+  else
+    SetStatusText(message, 1);
+
+  m_console->m_sectionQueues.remove(&kernel->m_preamble);
+  m_console->m_sectionQueues.remove(&kernel->m_evaluationQueue);
+  m_kernels.remove(kernel);
+  delete kernel;
+  KernelStatus();
+  m_console->RequestRedraw();
+}
+
+void wxMaxima::KernelProcessEvent(wxProcessEvent &event)
+{
+  // By handling the event we take over the responsibility to delete the process.
+  MaximaProcess *process = dynamic_cast<MaximaProcess *>(event.GetEventObject());
+  if (process == NULL)
+    return;
+  process->DeleteWhenDone();
+
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+  {
+    if ((*it)->OwnsProcess(process))
+    {
+      (*it)->ProcessTerminated();
+      KernelLost(*it, _("The maxima process this section was evaluated in has terminated."));
+      return;
+    }
+  }
+}
+
+void wxMaxima::KernelProcessOutput(wxThreadEvent &event)
+{
+  // The output arrives via the kernel's network connection: Of the streams
+  // of the process only the error messages are of interest.
+  if ((event.GetId() != kernel_stderr_id) || event.GetString().IsEmpty())
+    return;
+
+  MaximaProcess *process = dynamic_cast<MaximaProcess *>(event.GetEventObject());
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+  {
+    if (!(*it)->OwnsProcess(process))
+      continue;
+
+    wxString message = wxT("Message from maxima's stderr stream: ") +
+                       DecodeProcessOutput(event.GetString());
+    if (((*it)->GetCell() != NULL) && (!(*it)->InPreamble()))
+      KernelError((*it)->GetCell(), message);
+    else
+      SetStatusText(message, 1);
+    return;
+  }
+}
+
+void wxMaxima::KillKernels()
+{
+  m_console->m_sectionQueues.clear();
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+    delete *it;
+  m_kernels.clear();
+}
+
+void wxMaxima::KernelStatus()
+{
+  if (m_kernels.empty())
+    return;
+
+  wxString status;
+  for (std::list<MaximaKernel *>::iterator it = m_kernels.begin(); it != m_kernels.end(); ++it)
+  {
+    if (status != wxEmptyString)
+      status += wxT(", ");
+    if (!(*it)->IsReady())
+      status += wxString::Format(_("#%i starting"), (*it)->GetNumber());
+    else if ((*it)->GetCell() != NULL)
+      status += wxString::Format(_("#%i busy (%i cells)"), (*it)->GetNumber(),
+                                 (*it)->m_evaluationQueue.Size());
+    else
+      status += wxString::Format(_("#%i idle"), (*it)->GetNumber());
+  }
+  SetStatusText(_("Section maximas: ") + status, 1);
+}
+
+void wxMaxima::Interrupt(wxCommandEvent &event)
+{
+  // The maximas that evaluate sections cannot be asked if they want to continue.
+  std::list<MaximaKernel *> kernels = m_kernels;
+  for (std::list<MaximaKernel *>::iterator it = kernels.begin(); it != kernels.end(); ++it)
+  {
+    if ((*it)->GetCell() != NULL)
+      KernelLost(*it, _("Maxima has been interrupted."));
+  }
+
+  if (m_pid < 0)
+  {
+    GetMenuBar()->Enable(menu_interrupt_id, false);
+    return;
+  }
+#if defined (__WXMSW__)
+  wxString path, maxima = GetCommand(false);
+  wxArrayString out;
+  maxima = maxima.SubString(2, maxima.Length() - 3);
+  wxFileName::SplitPath(maxima, &path, NULL, NULL);
+  wxString command = wxT("\"") + path + wxT("\\winkill.exe\"");
+  command += wxString::Format(wxT(" -INT %ld"), m_pid);
+  wxExecute(command, out);
+#else
+  wxProcess::Kill(m_pid, wxSIGINT);
+#endif
+}
+
+void wxMaxima::KillMaxima()
+{
+  if (m_process)
+  {
+    m_process->Detach();
+    m_maximaStdin = NULL;
     m_process = NULL;
-    m_maximaStdout = NULL;
-    m_maximaStderr = NULL;
+  }
+
+  if (m_pid <= 0)
+  {
+    if (m_inLispMode)
+      SendMaxima(wxT("($quit)"));
+    else
+      SendMaxima(wxT("quit();"));
+    return;
+  }
+  else
+    wxProcess::Kill(m_pid, wxSIGKILL);
+
+  if (m_client)
+    m_client->Close();
+  m_client = NULL;
+  m_isConnected = false;
+  m_process = NULL;
+  m_maximaStdin = NULL;
+  m_currentOutput = wxEmptyString;
+  m_console->QuestionAnswered();
+}
+
+void wxMaxima::OnProcessEvent(wxProcessEvent &event)
+{
+  // By handling the event we take over the responsibility to delete the process.
+  MaximaProcess *process = dynamic_cast<MaximaProcess *>(event.GetEventObject());
+  bool currentProcess = (process == NULL) || (process == m_process);
+  if (process != NULL)
+  {
+    process->DeleteWhenDone();
+    if (process == m_process)
+    {
+      m_process = NULL;
+      m_maximaStdin = NULL;
+    }
+  }
+
+  if ((m_standbyProcess != NULL) && (process == m_standbyProcess))
+  {
+    m_standbyProcess = NULL;
+    KillStandby();
+    return;
+  }
+
+  // A maxima we have replaced (for example by the standby maxima on a restart)
+  // has finished terminating: The connection we have now isn't affected.
+  // The maximas sections are evaluated in are handled by KernelProcessEvent().
+  if (!currentProcess)
+    return;
+
+  m_statusBar->NetworkStatus(StatusBar::offline);
+  if (!m_closing)
+  {
+    SetStatusText(_("Maxima process terminated."), 1);
+    FinishHeadless(wxT("maxima terminated"));
+
+    // Anything maxima has told us about why this did happen has already been
+    // displayed: MaximaProcess sends us the process' output first.
+
+    // If we talked to maxima via its stdin and stdout this was our connection.
+    if (m_pipeTransport)
+    {
+      m_isConnected = false;
+      m_pid = -1;
+    }
+
+    // if m_closing==true we might already have a new process
+    // and therefore the following lines would probably mark
+    // the wrong process as "deleted".
+    m_process = NULL;
+    m_maximaStdin = NULL;
   }
 
   m_maximaVersion = wxEmptyString;
@@ -1098,6 +2033,8 @@ void wxMaxima::OnProcessEvent(wxProcessEvent &event)
 
 void wxMaxima::CleanUp()
 {
+  KillStandby();
+  KillKernels();
   m_console->QuestionAnswered();
   m_currentOutput = wxEmptyString;
   if (m_isConnected)
@@ -1130,15 +2067,26 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
     return;
   
 #if defined(__WXMSW__)
-  int start = 0;
-  start = data.Find(wxT("Maxima "));
-  if (start == wxNOT_FOUND)
-    start = 0;
-  FirstOutput(wxT("wxMaxima ")
-              wxT(GITVERSION)
-              wxT(" http://andrejv.github.io/wxmaxima/\n") +
-              data.SubString(start, data.Length() - 1));
-#endif // __WXMSW__
+  bool showGreeting = true;
+#else
+  // If maxima's greeting was sent to its stdout ReadProcessOutput() has already
+  // displayed it. Unless we talk to maxima via stdout.
+  bool showGreeting = m_pipeTransport;
+#endif
+  if (showGreeting)
+  {
+    int start = 0;
+    start = data.Find(wxT("Maxima "));
+    if (start == wxNOT_FOUND)
+      start = 0;
+    int pidStart = data.Find(wxT("pid="));
+    if (pidStart == wxNOT_FOUND)
+      pidStart = data.Length();
+    FirstOutput(wxT("wxMaxima ")
+                wxT(GITVERSION)
+                wxT(" http://andrejv.github.io/wxmaxima/\n") +
+                data.SubString(start, pidStart - 1));
+  }
 
   // Wait for a line maxima informs us about it's process id in.
   int s = data.Find(wxT("pid=")) + 4;
@@ -1148,16 +2096,29 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
   if (s < t)
     data.SubString(s, t).ToLong(&m_pid);
 
+  // A recorded session contains the pid of a process that isn't ours.
+  if (m_replayFile != wxEmptyString)
+    m_pid = -1;
+
   if (m_pid > 0)
     GetMenuBar()->Enable(menu_interrupt_id, true);
 
   m_first = false;
+  m_startupTime = m_startupStopWatch.Time();
   m_inLispMode = false;
   StatusMaximaBusy(waiting);
   m_closing = false; // when restarting maxima this is temporarily true
 
   data = data.Right(data.Length() - end - m_firstPrompt.Length());
 
+  // Prepare the maxima the next restart will use. A headless window never restarts maxima.
+  if (!m_headless)
+    StartStandby();
+
+  // The file might have been opened only after the setup commands had been sent.
+  if (m_openFile == wxEmptyString)
+    StartHeadless();
+
   if (m_console->m_evaluationQueue.Empty())
   {
     // Inform the user that the evaluation queue is empty.
@@ -1185,12 +2146,18 @@ int wxMaxima::GetMiscTextEnd(const wxString &data)
     return 0;
   if(data.StartsWith(m_symbolsPrefix))
     return 0;
+  if(data.StartsWith(m_framePrefix))
+    return 0;
+  if(data.StartsWith(m_setupDoneMarker))
+    return 0;
   
   int mthpos = data.Find("<mth>");
   int lblpos = data.Find("<lbl>");
   int statpos = data.Find("<statusbar>");
   int prmptpos = data.Find(m_promptPrefix);
   int symbolspos = data.Find(m_symbolsPrefix);
+  int framepos = data.Find(m_framePrefix);
+  int setupdonepos = data.Find(m_setupDoneMarker);
 
   int tagPos = data.Length();
   if ((mthpos != wxNOT_FOUND) && (mthpos < tagPos))
@@ -1205,6 +2172,10 @@ int wxMaxima::GetMiscTextEnd(const wxString &data)
     tagPos = prmptpos;
   if ((tagPos == wxNOT_FOUND) || ((symbolspos != wxNOT_FOUND) && (symbolspos < tagPos)))
     tagPos = symbolspos;
+  if ((tagPos == wxNOT_FOUND) || ((framepos != wxNOT_FOUND) && (framepos < tagPos)))
+    tagPos = framepos;
+  if ((tagPos == wxNOT_FOUND) || ((setupdonepos != wxNOT_FOUND) && (setupdonepos < tagPos)))
+    tagPos = setupdonepos;
   return tagPos;
 }
 
@@ -1218,89 +2189,51 @@ void wxMaxima::ReadMiscText(wxString &data)
   if(miscTextLen <= 0)
     return;
 
-  wxString miscText = data.Left(miscTextLen);
+  // Classify the text and split it into lines without copying it first.
+  wxArrayString lines;
+  OutputClassifier::Type textType =
+    m_outputClassifier.Classify(data.begin(), data.begin() + miscTextLen, lines);
   data = data.Right(data.Length() - miscTextLen);
 
-  // Stupid DOS and MAC line endings. The first of these commands won't work
-  // if the "\r" is the last char of a packet containing a part of a very long
-  // string. But running a search-and-replace
-  miscText.Replace("\r\n","\n");
-  miscText.Replace("\r","\n");
+  if (lines.IsEmpty())
+    return;
 
-  // A version of the text where each line begins with non-whitespace and whitespace
-  // characters are merged.
-  wxString mergedWhitespace = wxT("\n");
-  bool whitespace = true;
-  for ( wxString::iterator it=miscText.begin(); it!=miscText.end(); ++it)
+  int type = MC_TYPE_DEFAULT;
+  if (textType == OutputClassifier::error)
+    type = MC_TYPE_ERROR;
+  if (textType == OutputClassifier::warning)
+    type = MC_TYPE_WARNING;
+
+  // Add all text lines to the console at once. Every line still counts as an
+  // output cell of its own: The lines that exceed the maximum number of output
+  // cells per command are appended in a second, collapsed, batch.
+  size_t visibleLines = lines.GetCount();
+  if (m_maxOutputCellsPerCommand > 0)
   {
-    if((*it == wxT(' ')) || (*it == wxT('\t')))
-    {
-      // Merge non-newline whitespace to a space.
-      if(!whitespace)
-        mergedWhitespace += wxT(' ');
-    }
-    else
-      mergedWhitespace += *it;
-        
-    if((*it == wxT(' ')) || (*it == wxT('\t')) || (*it == wxT('\n')))
-      whitespace = true;
+    if (m_outputCellsFromCurrentCommand >= m_maxOutputCellsPerCommand)
+      visibleLines = 0;
     else
-      whitespace = false;
+      visibleLines = wxMin(visibleLines,
+                           (size_t) (m_maxOutputCellsPerCommand - m_outputCellsFromCurrentCommand));
   }
-  
-  bool error   = false;
-  bool warning = false;
-  if (
-    (mergedWhitespace.Contains(wxT("\n-- an error."))) ||
-    (mergedWhitespace.Contains(wxT(":incorrect syntax:"))) ||
-    (mergedWhitespace.Contains(wxT("\nincorrect syntax"))) ||
-    (mergedWhitespace.Contains(wxT("\nMaxima encountered a Lisp error"))) ||
-    (mergedWhitespace.Contains(wxT("\nkillcontext: no such context"))) ||
-    (mergedWhitespace.Contains(wxT("\ndbl:MAXIMA>>"))) ||  // a gcl error message
-    (mergedWhitespace.Contains(wxT("\nTo enable the Lisp debugger set *debugger-hook* to nil."))) || // a scbl error message
-    (m_gnuplotErrorRegex.Matches(mergedWhitespace))
-    )
-    error = true;
-
-  if ((mergedWhitespace.StartsWith(wxT("Warning:"))) ||
-      (mergedWhitespace.StartsWith(wxT("warning:"))) ||
-      (mergedWhitespace.StartsWith(wxT("WARNING:"))) ||
-      (mergedWhitespace.Contains(wxT("\nWarning:"))) ||
-      (mergedWhitespace.Contains(wxT("\nWARNING:"))) ||
-      (mergedWhitespace.Contains(wxT("\nwarning:"))) ||
-      (mergedWhitespace.Contains(wxT(": Warning:"))) ||
-      (mergedWhitespace.Contains(wxT(": warning:")))
-    )
-    warning = true;
-  
-  // Add all text lines to the console
-  wxStringTokenizer lines(miscText, wxT("\n"));
-  while (lines.HasMoreTokens())
-  {
-    // extract a string from the Data lines
-    wxString textline = lines.GetNextToken();
 
-    wxString trimmedLine = textline;
-
-    trimmedLine.Trim(true);
-    trimmedLine.Trim(false);
+  size_t line = 0;
+  while (line < lines.GetCount())
+  {
+    size_t batchEnd = (line < visibleLines) ? visibleLines : lines.GetCount();
+    wxString text = lines[line];
+    for (size_t i = line + 1; i < batchEnd; i++)
+      text += wxT("\n") + lines[i];
 
-    if((textline != wxEmptyString)&&(textline != wxT("\n")))
-    {
-      if(error)
-      {
-        ConsoleAppend(textline, MC_TYPE_ERROR);
-        AbortOnError();
-      }
-      else
-      {
-        if(warning)
-          ConsoleAppend(textline, MC_TYPE_WARNING);
-        else
-          ConsoleAppend(textline, MC_TYPE_DEFAULT);
-      }
-    }
+    // ConsoleAppend() counts the batch as one output cell.
+    ConsoleAppend(text, type);
+    if (m_maxOutputCellsPerCommand > 0)
+      m_outputCellsFromCurrentCommand += (int) (batchEnd - line - 1);
+    line = batchEnd;
   }
+
+  if (type == MC_TYPE_ERROR)
+    AbortOnError();
 }
 
 int wxMaxima::FindTagEnd(wxString &data, const wxString &tag)
@@ -1327,6 +2260,22 @@ void wxMaxima::ReadStatusBar(wxString &data)
   }
 }
 
+void wxMaxima::ReadSetupDone(wxString &data)
+{
+  if (!data.StartsWith(m_setupDoneMarker))
+    return;
+
+  data = data.Right(data.Length() - m_setupDoneMarker.Length());
+
+  // A recorded session hasn't been started by us.
+  if (m_replayFile != wxEmptyString)
+    return;
+
+  SetStatusText(wxString::Format(_("Maxima started in %li ms and was set up in %li ms"),
+                                 m_startupTime,
+                                 m_startupStopWatch.Time() - m_startupTime), 1);
+}
+
 /***
  * Checks if maxima displayed a new chunk of math
  */
@@ -1344,19 +2293,24 @@ void wxMaxima::ReadMath(wxString &data)
   {
     wxString o = data.Left(end + mthend.Length());
     data = data.Right(data.Length()-end-mthend.Length());
-    o.Trim(true);
-    o.Trim(false);
+    MathOutput(o);
+  }
+}
+
+void wxMaxima::MathOutput(wxString math)
+{
+  math.Trim(true);
+  math.Trim(false);
 
-    if (o.Length() > 0)
+  if (math.Length() > 0)
+  {
+    if (m_console->m_configuration->UseUserLabels())
     {
-      if (m_console->m_configuration->UseUserLabels())
-      {
-        ConsoleAppend(o, MC_TYPE_DEFAULT,m_console->m_evaluationQueue.GetUserLabel());
-      }
-      else
-      {
-        ConsoleAppend(o, MC_TYPE_DEFAULT);
-      }
+      ConsoleAppend(math, MC_TYPE_DEFAULT,m_console->m_evaluationQueue.GetUserLabel());
+    }
+    else
+    {
+      ConsoleAppend(math, MC_TYPE_DEFAULT);
     }
   }
 }
@@ -1373,16 +2327,91 @@ void wxMaxima::ReadLoadSymbols(wxString &data)
     // Put the symbols into a separate string
     wxString symbols = data.SubString(m_symbolsPrefix.Length(), end - 1);
 
-    // Send each symbol to the console
-    wxStringTokenizer templates(symbols, wxT("$"));
-    while (templates.HasMoreTokens())
-      m_console->AddSymbol(templates.GetNextToken());
+    AddSymbols(symbols);
     
     // Remove the symbols from the data string
     data = data.Right(data.Length()-end-m_symbolsSuffix.Length());
   }
 }
 
+void wxMaxima::AddSymbols(wxString symbols)
+{
+  // Send each symbol to the console
+  wxStringTokenizer templates(symbols, wxT("$"));
+  while (templates.HasMoreTokens())
+    m_console->AddSymbol(templates.GetNextToken());
+}
+
+void wxMaxima::ReadFrame(wxString &data)
+{
+  if (!data.StartsWith(m_framePrefix))
+    return;
+
+  // The header: <FRAME-type:length/>
+  size_t pos = m_framePrefix.Length();
+  if (data.Length() < pos + 2)
+    return;
+  wxChar type = data[pos];
+  pos += 2;
+  size_t length = 0;
+  while ((pos < data.Length()) && (data[pos] >= wxT('0')) && (data[pos] <= wxT('9')))
+  {
+    length = length * 10 + (data[pos] - wxT('0'));
+    pos++;
+  }
+  if (pos + 2 > data.Length())
+    return;
+  pos += 2;
+
+  // Wait until the whole message has arrived.
+  if (data.Length() < pos + length)
+    return;
+
+  wxString message = data.Mid(pos, length);
+
+  // The length is the number of characters the lisp sees. If the lisp counts
+  // bytes instead (which gcl does) and the message contains multibyte characters
+  // the message is sliced at the wrong place: In this case we discard the header
+  // only and let the tag-based parsers read the message.
+  wxString start, end;
+  switch (type)
+  {
+    case wxT('M'):
+      start = wxT("<mth>");
+      end = wxT("</mth>");
+      break;
+    case wxT('S'):
+      start = wxT("<statusbar>");
+      end = wxT("</statusbar>");
+      break;
+    case wxT('Y'):
+      start = m_symbolsPrefix;
+      end = m_symbolsSuffix;
+      break;
+  }
+  if ((start == wxEmptyString) || (!message.StartsWith(start)) || (!message.EndsWith(end)))
+  {
+    data = data.Mid(pos);
+    return;
+  }
+
+  data = data.Mid(pos + length);
+
+  wxString contents = message.Mid(start.Length(), message.Length() - start.Length() - end.Length());
+  switch (type)
+  {
+    case wxT('M'):
+      MathOutput(message);
+      break;
+    case wxT('S'):
+      SetStatusText(contents, 0);
+      break;
+    case wxT('Y'):
+      AddSymbols(contents);
+      break;
+  }
+}
+
 /***
  * Checks if maxima displayed a new prompt.
  */
@@ -1408,21 +2437,7 @@ void wxMaxima::ReadPrompt(wxString &data)
   if(data == wxT(" "))
     data = wxEmptyString;
   
-  // Input prompts have a length > 0 and end in a number followed by a ")".
-  // They also begin with a "(". Questions (hopefully)
-  // don't do that; Lisp prompts look like question prompts.
-  if (
-          (
-                  (o.Length() > 3) &&
-                  (o[o.Length() - 3] >= (wxT('0'))) &&
-                  (o[o.Length() - 3] <= (wxT('9'))) &&
-                  (o[o.Length() - 2] == (wxT(')'))) &&
-                  (o[0] == (wxT('(')))
-          ) ||
-          m_inLispMode ||
-          (o.StartsWith(wxT("MAXIMA>"))) ||
-          (o.StartsWith(wxT("\nMAXIMA>")))
-          )
+  if (IsInputPrompt(o) || m_inLispMode)
   {
     o.Trim(true);
     o.Trim(false);
@@ -1432,56 +2447,105 @@ void wxMaxima::ReadPrompt(wxString &data)
     //m_lastPrompt = o.Mid(1,o.Length()-1);
     //m_lastPrompt.Replace(wxT(")"), wxT(":"), false);
     m_lastPrompt = o;
-    // remove the event maxima has just processed from the evaluation queue
-    m_console->m_evaluationQueue.RemoveFirst();
-    // if we remove a command from the evaluation queue the next output line will be the
-    // first from the next command.
-    m_outputCellsFromCurrentCommand = 0;
-    if (m_console->m_evaluationQueue.Empty())
-    { // queue empty.
-      StatusMaximaBusy(waiting);
-      m_console->m_cellPointers.SetWorkingGroup(NULL);
 
-      // If we have selected a cell in order to show we are evaluating it
-      // we should now remove this marker.
-      if (m_console->FollowEvaluation())
-      {
-        if (m_console->GetActiveCell())
-          m_console->GetActiveCell()->SelectNone();
-        m_console->SetSelection(NULL, NULL);
-      }
-      m_console->FollowEvaluation(false);
-      if (m_batchmode)
-      {
-        SaveFile(false);
-        wxCloseEvent *closeEvent;
-        closeEvent = new wxCloseEvent();
-        GetEventHandler()->QueueEvent(closeEvent);
+    GroupCell *finishedCell = NULL;
+    if (!m_console->m_cellPointers.m_commandsInFlight.empty())
+      finishedCell = dynamic_cast<GroupCell *>(m_console->m_cellPointers.m_commandsInFlight.front().m_cell);
+    bool queuedCommandFinished = CommandFinished();
+    if ((!m_console->m_cellPointers.m_commandsInFlight.empty()) &&
+        (m_console->m_cellPointers.m_commandsInFlight.front().m_generation != m_console->m_evaluationQueue.Generation()))
+    {
+      // The evaluation queue has been cleared (for example because of an error)
+      // after more commands had been sent to maxima. Maxima evaluates them
+      // nonetheless => their output still has to go to the right cells.
+      GroupCell *cell = dynamic_cast<GroupCell *>(m_console->m_cellPointers.m_commandsInFlight.front().m_cell);
+      if ((m_console->GetTree() == NULL) || (!m_console->GetTree()->Contains(cell)))
+        cell = NULL;
+      if (cell != NULL)
+      {
+        // The queue never made this cell the current one => its old output
+        // hasn't been removed yet.
+        if (cell != finishedCell)
+        {
+          if ((m_console->GetSelectionStart() && (m_console->GetSelectionStart()->GetParent() == cell)) ||
+              (m_console->GetSelectionEnd() && (m_console->GetSelectionEnd()->GetParent() == cell)))
+            m_console->SetSelection(NULL, NULL);
+          cell->RemoveOutput();
+          m_console->SetSaved(false);
+          m_console->Recalculate(cell);
+        }
+        cell->GetPrompt()->SetValue(m_lastPrompt);
       }
-      // Inform the user that the evaluation queue is empty.
-      EvaluationQueueLength(0);
-      m_console->m_cellPointers.SetWorkingGroup(NULL);
-      m_console->RequestRedraw();
-    }
-    else
-    { // we don't have an empty queue
+      m_console->m_cellPointers.SetWorkingGroup(cell);
+      m_outputCellsFromCurrentCommand = 0;
       m_ready = false;
-      m_console->RequestRedraw();
       StatusMaximaBusy(calculating);
-      m_console->m_cellPointers.SetWorkingGroup(NULL);
-      TryEvaluateNextInQueue();
+      m_console->RequestRedraw();
     }
-
-    if (m_console->m_evaluationQueue.Empty())
+    else
     {
-      if ((m_console->m_configuration->GetOpenHCaret()) && (m_console->GetActiveCell() == NULL))
-        m_console->OpenNextOrCreateCell();
+      // remove the event maxima has just processed from the evaluation queue
+      if (queuedCommandFinished)
+        m_console->m_evaluationQueue.RemoveFirst();
+      // if we remove a command from the evaluation queue the next output line will be the
+      // first from the next command.
+      m_outputCellsFromCurrentCommand = 0;
+      if (m_console->m_evaluationQueue.Empty())
+      { // queue empty.
+        StatusMaximaBusy(waiting);
+        m_console->m_cellPointers.SetWorkingGroup(NULL);
+
+        // If we have selected a cell in order to show we are evaluating it
+        // we should now remove this marker.
+        if (m_console->FollowEvaluation())
+        {
+          if (m_console->GetActiveCell())
+            m_console->GetActiveCell()->SelectNone();
+          m_console->SetSelection(NULL, NULL);
+        }
+        m_console->FollowEvaluation(false);
+        if (m_headless)
+          FinishHeadless(wxT("ok"));
+        else if (m_batchmode)
+        {
+          SaveFile(false);
+          wxCloseEvent *closeEvent;
+          closeEvent = new wxCloseEvent();
+          GetEventHandler()->QueueEvent(closeEvent);
+        }
+        // Inform the user that the evaluation queue is empty.
+        EvaluationQueueLength(0);
+        m_console->m_cellPointers.SetWorkingGroup(NULL);
+        m_console->RequestRedraw();
+      }
+      else
+      { // we don't have an empty queue
+        m_ready = false;
+        m_console->RequestRedraw();
+        StatusMaximaBusy(calculating);
+        m_console->m_cellPointers.SetWorkingGroup(NULL);
+        TryEvaluateNextInQueue();
+      }
+
+      if (m_console->m_evaluationQueue.Empty())
+      {
+        if ((m_console->m_configuration->GetOpenHCaret()) && (m_console->GetActiveCell() == NULL))
+          m_console->OpenNextOrCreateCell();
+      }
     }
   }
   else
   {  // We have a question
     m_console->QuestionAnswered();
     m_console->QuestionPending(true);
+    // Nobody is there to answer it.
+    FinishHeadless(wxT("question"));
+    // No more commands are sent ahead until the question is answered, see
+    // FillPipeline(). The answer is stored in the cell => from now on this cell
+    // is evaluated in lock-step.
+    if (m_console->m_cellPointers.m_commandsInFlight.size() > 1)
+      DoRawConsoleAppend(_("Maxima has asked a question while more commands had already been sent to it. It might read them as the answer."),
+                         MC_TYPE_WARNING);
     // If the user answers a question additional output might be required even
     // if the question has been preceded by many lines.
     m_outputCellsFromCurrentCommand = 0;
@@ -1513,26 +2577,30 @@ void wxMaxima::ReadPrompt(wxString &data)
     m_inLispMode = true;
   else
     m_inLispMode = false;
+}
 
+void wxMaxima::SetCWD(wxString file)
+{
+  wxArrayString commands = GetCWDCommands(file);
+  if (commands.IsEmpty())
+    return;
 
-  // If maxima isn't running we stop polling its stderr for messages.
-  // Always reduce the number of CPU wakeups if you can.
+  for (size_t i = 0; i < commands.GetCount(); i++)
+    SendMaxima(commands[i]);
   if (m_ready)
   {
-    if (!m_console->QuestionPending())
-    {
-      if (m_console->m_evaluationQueue.Empty())
-        m_maximaStdoutPollTimer.Stop();
-    }
+    if (m_console->m_evaluationQueue.Empty())
+      StatusMaximaBusy(waiting);
   }
 }
 
-void wxMaxima::SetCWD(wxString file)
+wxArrayString wxMaxima::GetCWDCommands(wxString file)
 {
-  // If maxima isn't connected we cannot do anything
-  if (!m_client)
-    return;
+  wxArrayString commands;
 
+  // If maxima isn't connected we cannot do anything
+  if (!m_isConnected)
+    return commands;
   // Tell the math parser where to search for local files.
   MathParser mParser(&m_console->m_configuration, &m_console->m_cellPointers);
   m_console->m_configuration->SetWorkingDirectory(wxFileName(file).GetPath());
@@ -1563,21 +2631,17 @@ void wxMaxima::SetCWD(wxString file)
   if (wxcd && (workingDirectory != GetCWD()))
   {
 
-    SendMaxima(wxT(":lisp-quiet (setf $wxfilename \"") +
-               filenamestring +
-               wxT("\")"));
-    SendMaxima(wxT(":lisp-quiet (setf $wxdirname \"") +
-               filename.GetPath() +
-               wxT("\")"));
+    commands.Add(wxT(":lisp-quiet (setf $wxfilename \"") +
+                 filenamestring +
+                 wxT("\")"));
+    commands.Add(wxT(":lisp-quiet (setf $wxdirname \"") +
+                 filename.GetPath() +
+                 wxT("\")"));
 
-    SendMaxima(wxT(":lisp-quiet (wx-cd \"") + filenamestring + wxT("\")"));
-    if (m_ready)
-    {
-      if (m_console->m_evaluationQueue.Empty())
-        StatusMaximaBusy(waiting);
-    }
+    commands.Add(wxT(":lisp-quiet (wx-cd \"") + filenamestring + wxT("\")"));
     m_CWD = workingDirectory;
   }
+  return commands;
 }
 
 wxString wxMaxima::ReadMacContents(wxString file)
@@ -2312,14 +3376,9 @@ void wxMaxima::ReadProcessOutput()
   if (m_process == NULL)
     return;
 
-  // If there is no stdin from maxima we can return from this function, too.
-  if (m_maximaStdout == NULL)
-    return;
-
-  wxString o;
-
-  while (m_process->IsInputAvailable())
-    o += m_maximaStdout->GetC();
+  // OnMaximaOutput() has collected what maxima has sent to its stdout until now.
+  wxString o = m_processOutput;
+  m_processOutput = wxEmptyString;
 
   int st = o.Find(wxT("Maxima"));
   if (st == -1)
@@ -2333,16 +3392,17 @@ void wxMaxima::ReadProcessOutput()
 
 #endif
 
-void wxMaxima::SetupVariables()
+wxArrayString wxMaxima::GetSetupCommands()
 {
-  SendMaxima(wxT(":lisp-quiet (setf *prompt-suffix* \"") +
-             m_promptSuffix +
-             wxT("\")"));
-  SendMaxima(wxT(":lisp-quiet (setf *prompt-prefix* \"") +
-             m_promptPrefix +
-             wxT("\")"));
-  SendMaxima(wxT(":lisp-quiet (setf $in_netmath nil)"));
-  SendMaxima(wxT(":lisp-quiet (setf $show_openplot t)"));
+  wxArrayString commands;
+  commands.Add(wxT(":lisp-quiet (setf *prompt-suffix* \"") +
+               m_promptSuffix +
+               wxT("\")"));
+  commands.Add(wxT(":lisp-quiet (setf *prompt-prefix* \"") +
+               m_promptPrefix +
+               wxT("\")"));
+  commands.Add(wxT(":lisp-quiet (setf $in_netmath nil)"));
+  commands.Add(wxT(":lisp-quiet (setf $show_openplot t)"));
 
   wxConfigBase *config = wxConfig::Get();
 
@@ -2354,11 +3414,11 @@ void wxMaxima::SetupVariables()
 
   if (wxcd)
   {
-    SendMaxima(wxT(":lisp-quiet (defparameter $wxchangedir t)"));
+    commands.Add(wxT(":lisp-quiet (defparameter $wxchangedir t)"));
   }
   else
   {
-    SendMaxima(wxT(":lisp-quiet (defparameter $wxchangedir nil)"));
+    commands.Add(wxT(":lisp-quiet (defparameter $wxchangedir nil)"));
   }
 
 #if defined (__WXMAC__)
@@ -2368,9 +3428,9 @@ void wxMaxima::SetupVariables()
 #endif
   config->Read(wxT("usepngCairo"), &usepngCairo);
   if (usepngCairo)
-    SendMaxima(wxT(":lisp-quiet (defparameter $wxplot_pngcairo t)"));
+    commands.Add(wxT(":lisp-quiet (defparameter $wxplot_pngcairo t)"));
   else
-    SendMaxima(wxT(":lisp-quiet (defparameter $wxplot_pngcairo nil)"));
+    commands.Add(wxT(":lisp-quiet (defparameter $wxplot_pngcairo nil)"));
 
   int autosubscript = 1;
   config->Read(wxT("autosubscript"), &autosubscript);
@@ -2387,33 +3447,139 @@ void wxMaxima::SetupVariables()
       subscriptval = "'all";
       break;
   }
-  SendMaxima(wxT(":lisp-quiet (defparameter $wxsubscripts ") + subscriptval + wxT(")"));
+  commands.Add(wxT(":lisp-quiet (defparameter $wxsubscripts ") + subscriptval + wxT(")"));
 
   int defaultPlotWidth = 600;
   config->Read(wxT("defaultPlotWidth"), &defaultPlotWidth);
   int defaultPlotHeight = 400;
   config->Read(wxT("defaultPlotHeight"), &defaultPlotHeight);
-  SendMaxima(wxString::Format(wxT(":lisp-quiet (defparameter $wxplot_size '((mlist simp) %i %i))"), defaultPlotWidth,
-                              defaultPlotHeight));
+  commands.Add(wxString::Format(wxT(":lisp-quiet (defparameter $wxplot_size '((mlist simp) %i %i))"), defaultPlotWidth,
+                                defaultPlotHeight));
 
 #if defined (__WXMSW__)
   wxString cwd = wxGetCwd();
   cwd.Replace(wxT("\\"), wxT("/"));
-  SendMaxima(wxT(":lisp-quiet ($load \"") + cwd + wxT("/data/wxmathml\")"));
+  commands.Add(LoadWxmathmlCommand(cwd + wxT("/data/wxmathml")));
 #elif defined (__WXMAC__)
   wxString cwd = wxGetCwd();
   cwd = cwd + wxT("/") + wxT(MACPREFIX);
-  SendMaxima(wxT(":lisp-quiet ($load \"") + cwd + wxT("wxmathml\")"));
+  commands.Add(LoadWxmathmlCommand(cwd + wxT("wxmathml")));
   // check for Gnuplot.app - use it if it exists
   wxString gnuplotbin(wxT("/Applications/Gnuplot.app/Contents/Resources/bin/gnuplot"));
   if (wxFileExists(gnuplotbin))
-    SendMaxima(wxT(":lisp-quiet (setf $gnuplot_command \"") + gnuplotbin + wxT("\")"));
+    commands.Add(wxT(":lisp-quiet (setf $gnuplot_command \"") + gnuplotbin + wxT("\")"));
 #else
   wxString prefix = wxT(PREFIX);
-  SendMaxima(wxT(":lisp-quiet ($load \"") + prefix +
-             wxT("/share/wxMaxima/wxmathml\")"));
+  commands.Add(LoadWxmathmlCommand(prefix + wxT("/share/wxMaxima/wxmathml")));
 #endif
 
+  // Make the lisp send everything it outputs to the stream we read from.
+  if (m_pipeTransport)
+    commands.Add(wxT(":lisp-quiet (wx-setup-pipe-transport)"));
+
+  // Ask the lisp to tell us the length of every message so we don't need to
+  // search for its end. See ReadFrame().
+  bool framedOutput = true;
+  config->Read(wxT("framedOutput"), &framedOutput);
+  if (framedOutput)
+    commands.Add(wxT(":lisp-quiet (wx-enable-framing)"));
+
+  return commands;
+}
+
+wxString wxMaxima::LoadWxmathmlCommand(wxString wxmathml)
+{
+  wxString loadSource = wxT(":lisp-quiet ($load \"") + wxmathml + wxT("\")");
+
+  // The compiled file is named after the source it was compiled from: A new
+  // version of wxmathml.lisp therefore never finds an outdated compiled file.
+  wxFile source(wxmathml + wxT(".lisp"));
+  if (!source.IsOpened())
+    return loadSource;
+  wxFileOffset length = source.Length();
+  if (length <= 0)
+    return loadSource;
+  wxCharBuffer contents(length);
+  if (source.Read(contents.data(), length) != length)
+    return loadSource;
+  wxUint32 hash = 2166136261u;
+  for (wxFileOffset i = 0; i < length; i++)
+  {
+    hash ^= (unsigned char) contents.data()[i];
+    hash *= 16777619u;
+  }
+
+  wxString cacheDir = Dirstructure().LispCacheDir();
+  if (!wxFileName::Mkdir(cacheDir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL))
+    return loadSource;
+  cacheDir.Replace(wxT("\\"), wxT("/"));
+
+  // Every lisp (and every version of it) gets a compiled file of its own for
+  // every maxima version. The file is compiled under a temporary name and
+  // renamed when it is complete so a wxMaxima that starts at the same time
+  // never loads a half-written one. If compiling fails we leave a .failed file
+  // so we don't try again on every start; If loading the compiled file fails we
+  // load the source instead.
+  return wxString::Format(
+    wxT(":lisp-quiet (unless (ignore-errors "
+        "(let* ((src \"%s.lisp\") "
+        "(fasl (compile-file-pathname (format nil \"%s/wxmathml-%08x-~a\" "
+        "(remove-if-not #'alphanumericp (concatenate 'string "
+        "(if (boundp '*autoconf-version*) (symbol-value '*autoconf-version*) \"\") "
+        "(lisp-implementation-type) (lisp-implementation-version)))))) "
+        "(failed (make-pathname :type \"failed\" :defaults fasl))) "
+        "(unless (or (probe-file fasl) (probe-file failed)) "
+        "(let ((*standard-output* (make-broadcast-stream)) (*error-output* (make-broadcast-stream)) "
+        "(tmp (make-pathname :name (format nil \"~a-~36r\" (pathname-name fasl) "
+        "(random 2000000000 (make-random-state t))) :defaults fasl))) "
+        "(if (ignore-errors (compile-file src :output-file tmp)) "
+        "(unless (and (not (probe-file fasl)) (ignore-errors (rename-file tmp fasl))) "
+        "(ignore-errors (delete-file tmp))) "
+        "(progn (ignore-errors (delete-file tmp)) "
+        "(with-open-file (s failed :direction :output :if-exists :supersede) s))))) "
+        "(and (probe-file fasl) (load fasl) t))) "
+        "($load \"%s\"))"),
+    wxmathml, cacheDir, hash, wxmathml);
+}
+
+wxString wxMaxima::SetupPayload(wxArrayString commands)
+{
+  // Let maxima tell us when it has processed all of the setup commands.
+  commands.Add(wxT(":lisp-quiet (progn (princ \"") + m_setupDoneMarker +
+               wxT("\") (finish-output))"));
+
+  // Each form is guarded so a failing one doesn't keep the others from being
+  // executed.
+  wxString payload = wxT(":lisp-quiet (progn");
+  wxString lispQuiet = wxT(":lisp-quiet ");
+  for (size_t i = 0; i < commands.GetCount(); i++)
+  {
+    wxString form = commands[i];
+    if (form.StartsWith(lispQuiet))
+      form = form.Mid(lispQuiet.Length());
+    payload += wxT(" (handler-case ") + form +
+               wxT(" (error (err) (format t \"~&~a~%\" err)))");
+  }
+  payload += wxT(")");
+  return payload;
+}
+
+void wxMaxima::SetupVariables()
+{
+  // SendMaxima() would call us again if this flag wasn't set.
+  m_variablesOK = true;
+
+  wxArrayString commands = GetSetupCommands();
+  if (m_console->m_currentFile != wxEmptyString)
+    WX_APPEND_ARRAY(commands, GetCWDCommands(m_console->m_currentFile));
+  SendMaxima(SetupPayload(commands));
+
+  if (m_batchmode)
+    m_console->AddDocumentToEvaluationQueue();
+}
+
+void wxMaxima::SetupDocument()
+{
   if (m_console->m_currentFile != wxEmptyString)
   {
     wxString filename(m_console->m_currentFile);
@@ -2714,6 +3880,10 @@ void wxMaxima::OnIdle(wxIdleEvent &event)
     m_openFile = wxEmptyString;
     OpenFile(file);
 
+    // If maxima is already waiting for input the document hasn't been queued for evaluation, yet.
+    if (m_isConnected && !m_first && StartHeadless())
+      TryEvaluateNextInQueue();
+
     // After doing such big a thing we should end our idle event and request
     // a new one to be issued once the computer has time for doing real
     // background stuff.
@@ -2905,6 +4075,8 @@ void wxMaxima::UpdateMenus(wxUpdateUIEvent &event)
   );
 
   menubar->Enable(menu_evaluate_all_visible, m_console->GetTree() != NULL);
+  menubar->Enable(menu_evaluate_sections_parallel, m_console->GetTree() != NULL);
+  menubar->Enable(menu_evaluate_changed, m_console->GetTree() != NULL);
   menubar->Enable(ToolBar::tb_evaltillhere,
                   (m_console->GetTree() != NULL) &&
                   (m_console->CanPaste()) &&
@@ -2969,7 +4141,7 @@ void wxMaxima::UpdateToolBar(wxUpdateUIEvent &event)
           (m_console->GetTree() != NULL) &&
           (m_console->CanPaste()) &&
           (m_console->GetHCaret() != NULL) &&
-          (m_client != NULL)
+          (m_isConnected)
   );
 
   // On MSW it seems we cannot change an icon without side-effects that somehow
@@ -3066,7 +4238,9 @@ void wxMaxima::OpenFile(wxString file, wxString cmd)
 {
   if (file.Length() && wxFileExists(file))
   {
-    AddRecentDocument(file);
+    // The files a batch run evaluates aren't ones the user has opened.
+    if (!m_headless)
+      AddRecentDocument(file);
 
     m_lastPath = wxPathOnly(file);
     wxString unixFilename(file);
@@ -3238,28 +4412,53 @@ bool wxMaxima::SaveFile(bool forceSave)
   return false;
 }
 
-void wxMaxima::ReadStdErr()
+void wxMaxima::OnMaximaOutput(wxThreadEvent &event)
 {
-  // Maxima will never send us any data via stderr after it has finished
-  // starting up and will send data via stdout only in rare cases:
-  // It rather sends us the data over the network.
-  //
-  // If something is severely broken this might not be true, though, and we want
-  // to inform the user about it.
+  // The output of a standby maxima only matters if it is maxima's greeting.
+  MaximaProcess *process = dynamic_cast<MaximaProcess *>(event.GetEventObject());
+  if ((process != NULL) && (process == m_standbyProcess))
+  {
+    if (event.GetId() == maxima_stdout_id)
+      m_standbyProcessOutput += DecodeProcessOutput(event.GetString());
+    return;
+  }
+
+  if ((process == NULL) || (process != m_process))
+    return;
 
-  if (m_process == NULL) return;
+  // An empty chunk tells that maxima has closed the pipe.
+  if (event.GetString().IsEmpty())
+  {
+    // The end of the process normally is reported by wxWidgets. But it sometimes
+    // doesn't do so if it dies due to an out of memory => Check if it really lives.
+    if ((event.GetId() == maxima_stdout_id) && (!wxProcess::Exists(m_process->GetPid())))
+    {
+      wxProcessEvent *processEvent;
+      processEvent = new wxProcessEvent();
+      GetEventHandler()->QueueEvent(processEvent);
+    }
+    return;
+  }
 
-  if (m_process->IsInputAvailable())
+  if (event.GetId() == maxima_stdout_id)
   {
-    wxASSERT_MSG(m_maximaStdout != NULL, wxT("Bug: Trying to read from maxima but don't have a input stream"));
-    wxTextInputStream istrm(*m_maximaStdout);
-    wxString o = _("Message from the stdout of Maxima: ");
-    wxChar ch;
-    int len = 0;
-    while (((ch = istrm.GetChar()) != wxT('\0')) && (m_maximaStdout->CanRead()) && (len < 65535))
+    // If we talk to maxima via its stdout the data from it is no message but output.
+    if (m_pipeTransport)
+    {
+      wxCharBuffer data(event.GetString().To8BitData());
+      size_t length = event.GetString().Length();
+      m_statusBar->NetworkStatus(StatusBar::receive);
+      m_sessionRecording.Add(SessionRecording::fromMaxima, data.data(), length);
+      InterpretMaximaOutput(DecodeMaximaOutput(data.data(), length));
+      return;
+    }
+
+    // Maxima will send us data via stdout only in rare cases: It rather sends
+    // us the data over the network. Before it has connected to us it is its greeting.
+    if (!m_isConnected)
     {
-      o += ch;
-      len++;
+      m_processOutput += DecodeProcessOutput(event.GetString());
+      return;
     }
 
     bool pollStdOut = false;
@@ -3267,34 +4466,54 @@ void wxMaxima::ReadStdErr()
     config->Read(wxT("pollStdOut"), &pollStdOut);
 
     if (pollStdOut)
-      DoRawConsoleAppend(o, MC_TYPE_DEFAULT);
+      DoRawConsoleAppend(_("Message from the stdout of Maxima: ") +
+                         DecodeProcessOutput(event.GetString()), MC_TYPE_DEFAULT);
   }
-  if (m_process->IsErrorAvailable())
+  else
   {
-    wxASSERT_MSG(m_maximaStderr != NULL, wxT("Bug: Trying to read from maxima but don't have a error input stream"));
-    wxTextInputStream istrm(*m_maximaStderr);
-    wxString o = wxT("Message from maxima's stderr stream: ");
-    wxChar ch;
-    int len = 0;
-    while (((ch = istrm.GetChar()) != wxT('\0')) && (m_maximaStderr->CanRead()) && (len < 65535))
-    {
-      o += ch;
-      len++;
-    }
-
-    DoRawConsoleAppend(o, MC_TYPE_ERROR);
+    // Maxima will never send us any data via stderr after it has finished
+    // starting up. If something is severely broken this might not be true,
+    // though, and we want to inform the user about it.
+    DoRawConsoleAppend(wxT("Message from maxima's stderr stream: ") +
+                       DecodeProcessOutput(event.GetString()), MC_TYPE_ERROR);
 
     if(!AbortOnError())
       TryEvaluateNextInQueue();
   }
 }
 
+wxString wxMaxima::DecodeProcessOutput(const wxString &chunk)
+{
+  wxCharBuffer data(chunk.To8BitData());
+  return DecodeMaximaOutput(data.data(), chunk.Length());
+}
+
+bool wxMaxima::IsInputPrompt(wxString prompt)
+{
+  // Input prompts have a length > 0 and end in a number followed by a ")".
+  // They also begin with a "(". Questions (hopefully)
+  // don't do that; Lisp prompts look like question prompts.
+  return (
+          (
+                  (prompt.Length() > 3) &&
+                  (prompt[prompt.Length() - 3] >= (wxT('0'))) &&
+                  (prompt[prompt.Length() - 3] <= (wxT('9'))) &&
+                  (prompt[prompt.Length() - 2] == (wxT(')'))) &&
+                  (prompt[0] == (wxT('(')))
+          ) ||
+          (prompt.StartsWith(wxT("MAXIMA>"))) ||
+          (prompt.StartsWith(wxT("\nMAXIMA>")))
+  );
+}
+
 bool wxMaxima::AbortOnError()
 {
   // If maxima did output something it defintively has stopped.
   // The question is now if we want to try to send it something new to evaluate.
   bool abortOnError = false;
   wxConfig::Get()->Read(wxT("abortOnError"), &abortOnError);
+  // A headless evaluation continues with the next cell unless abortOnError is set and
+  // reports the errors once the evaluation queue has run empty.
   SetBatchMode(false);
 
   if (m_console->m_notificationMessage != NULL)
@@ -3321,20 +4540,8 @@ void wxMaxima::OnTimerEvent(wxTimerEvent &event)
 {
   switch (event.GetId())
   {
-    case MAXIMA_STDOUT_POLL_ID:
-      ReadStdErr();
-
-      if (m_process != NULL)
-      {
-        // The atexit() of maxima informs us if the process dies. But it sometimes doesn't do
-        // so if it dies due to an out of memory => Periodically check if it really lives.
-        if (!wxProcess::Exists(m_process->GetPid()))
-        {
-          wxProcessEvent *processEvent;
-          processEvent = new wxProcessEvent();
-          GetEventHandler()->QueueEvent(processEvent);
-        }
-      }
+    case REPLAY_TIMER_ID:
+      ReplayNextRecord();
       break;
     case KEYBOARD_INACTIVITY_TIMER_ID:
     case AUTO_SAVE_TIMER_ID:
@@ -3446,19 +4653,26 @@ void wxMaxima::FileMenu(wxCommandEvent &event)
       wxString fileExt = "html";
       wxConfig::Get()->Read(wxT("defaultExportExt"), &fileExt);
 
+      wxString wildcard = _("HTML file (*.html)|*.html|"
+                                    "maxima batch file (*.mac)|*.mac|"
+                                    "pdfLaTeX file (*.tex)|*.tex");
+#if wxUSE_POSTSCRIPT
+      wildcard += _("|PostScript file (*.ps)|*.ps");
+#endif
       wxFileDialog fileDialog(this,
                               _("Export"), m_lastPath,
                               file + wxT(".") + fileExt,
-                              _("HTML file (*.html)|*.html|"
-                                        "maxima batch file (*.mac)|*.mac|"
-                                        "pdfLaTeX file (*.tex)|*.tex"
-                              ),
+                              wildcard,
                               wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
 
       if (fileExt == wxT("html"))
         fileDialog.SetFilterIndex(0);
       else if (fileExt == wxT("mac"))
         fileDialog.SetFilterIndex(1);
+#if wxUSE_POSTSCRIPT
+      else if (fileExt == wxT("ps"))
+        fileDialog.SetFilterIndex(3);
+#endif
       else
         fileDialog.SetFilterIndex(2);
 
@@ -3470,7 +4684,8 @@ void wxMaxima::FileMenu(wxCommandEvent &event)
           int ext = fileDialog.GetFilterIndex();
           if ((file.Right(5) != wxT(".html")) &&
               (file.Right(4) != wxT(".mac")) &&
-              (file.Right(4) != wxT(".tex"))
+              (file.Right(4) != wxT(".tex")) &&
+              (file.Right(3) != wxT(".ps"))
                   )
           {
             switch (ext)
@@ -3484,6 +4699,9 @@ void wxMaxima::FileMenu(wxCommandEvent &event)
               case 2:
                 file += wxT(".tex");
                 break;
+              case 3:
+                file += wxT(".ps");
+                break;
               default:
                 file += wxT(".html");
             }
@@ -3503,6 +4721,38 @@ void wxMaxima::FileMenu(wxCommandEvent &event)
             else
               StatusExportFinished();
           }
+#if wxUSE_POSTSCRIPT
+          else if (file.Right(3) == wxT(".ps"))
+          {
+            StatusExportStart();
+
+            fileExt = wxT("ps");
+            bool success;
+            {
+              // Don't let redraws of the worksheet interfere with the layout at the
+              // printer's scale.
+              m_console->Freeze();
+              wxEventBlocker blocker(m_console);
+              wxBusyCursor crs;
+              wxString title;
+              wxFileName::SplitPath(file, NULL, NULL, &title, NULL);
+              MathPrintout printout(title, &m_console->m_configuration);
+              printout.SetData(m_console->CopyTree());
+              success = printout.ExportToPostScript(file);
+              m_console->Thaw();
+            }
+            m_console->RecalculateForce();
+            m_console->RequestRedraw();
+            if (!success)
+            {
+              wxMessageBox(_("Exporting to PostScript failed!"), _("Error!"),
+                           wxOK);
+              StatusExportFailed();
+            }
+            else
+              StatusExportFinished();
+          }
+#endif
           else if (file.Right(4) == wxT(".mac"))
           {
             StatusExportStart();
@@ -4040,6 +5290,12 @@ void wxMaxima::MaximaMenu(wxCommandEvent &event)
       TryEvaluateNextInQueue();
     }
       break;
+    case menu_evaluate_sections_parallel:
+      EvaluateSectionsInParallel();
+      break;
+    case menu_evaluate_changed:
+      EvaluateChangedCells();
+      break;
     case ToolBar::tb_evaltillhere:
     {
       m_console->m_evaluationQueue.Clear();
@@ -5649,7 +6905,7 @@ void wxMaxima::StatsMenu(wxCommandEvent &ev)
 
 void wxMaxima::OnClose(wxCloseEvent &event)
 {
-  if (SaveNecessary())
+  if (SaveNecessary() && !m_headless)
   {
     int close = SaveDocumentP();
 
@@ -5671,24 +6927,27 @@ void wxMaxima::OnClose(wxCloseEvent &event)
   // We have saved the file now => No need to have the timer around any longer.
   m_autoSaveTimer.Stop();
 
-  wxConfig *config = (wxConfig *) wxConfig::Get();
-  wxSize size = GetSize();
-  wxPoint pos = GetPosition();
-  bool maximized = IsMaximized();
-  config->Write(wxT("pos-x"), pos.x);
-  config->Write(wxT("pos-y"), pos.y);
-  config->Write(wxT("pos-w"), size.GetWidth());
-  config->Write(wxT("pos-h"), size.GetHeight());
-  if (maximized)
-    config->Write(wxT("pos-max"), 1);
-  else
-    config->Write(wxT("pos-max"), 0);
-  if (m_lastPath.Length() > 0)
-    config->Write(wxT("lastPath"), m_lastPath);
+  // A window that has never been shown has no position worth remembering.
+  if (!m_headless)
+  {
+    wxConfig *config = (wxConfig *) wxConfig::Get();
+    wxSize size = GetSize();
+    wxPoint pos = GetPosition();
+    bool maximized = IsMaximized();
+    config->Write(wxT("pos-x"), pos.x);
+    config->Write(wxT("pos-y"), pos.y);
+    config->Write(wxT("pos-w"), size.GetWidth());
+    config->Write(wxT("pos-h"), size.GetHeight());
+    if (maximized)
+      config->Write(wxT("pos-max"), 1);
+    else
+      config->Write(wxT("pos-max"), 0);
+    if (m_lastPath.Length() > 0)
+      config->Write(wxT("lastPath"), m_lastPath);
+  }
   m_closing = true;
   CleanUp();
-  m_maximaStdout = NULL;
-  m_maximaStderr = NULL;
+  m_maximaStdin = NULL;
 #if defined __WXMAC__
   wxGetApp().topLevelWindows.Erase(wxGetApp().topLevelWindows.Find(this));
 #endif
@@ -6211,207 +7470,63 @@ void wxMaxima::EvaluateEvent(wxCommandEvent &event)
 
 wxString wxMaxima::GetUnmatchedParenthesisState(wxString text,int &index)
 {
-  index = 0;
-  
-  std::list<wxChar> delimiters;
-
-  if (text.Right(1) == wxT("\\"))
-  {
-    index = text.Length() - 1;
-    return (_("Cell ends in a backslash"));
-  }
-
-  bool lisp = m_inLispMode;
-
-  wxChar lastC = wxT(';');
-  wxChar lastnonWhitespace = wxT(',');
-
-  wxString::const_iterator it = text.begin();
-  while (it != text.end())
-  {
-    wxChar c = *it;
-
-    switch (c)
-    {
-      // Opening parenthesis
-    case wxT('('):
-      delimiters.push_back(wxT(')'));
-      lastC = c;
-      break;
-    case wxT('['):
-      delimiters.push_back(wxT(']'));
-      lastC = c;
-      break;
-    case wxT('{'):
-      delimiters.push_back(wxT('}'));
-      lastC = c;
-      break;
-        
-      // Closing parenthesis
-    case wxT(')'):
-    case wxT(']'):
-    case wxT('}'):
-      if (delimiters.empty()) return (_("Mismatched parenthesis"));
-    if (c != delimiters.back()) return (_("Mismatched parenthesis"));
-    delimiters.pop_back();
-    lastC = c;
-    if (lastnonWhitespace == wxT(','))
-      return (_("Comma directly followed by a closing parenthesis"));
-    break;
-
-    // Escaped characters
-    case wxT('\\'):
-      ++it;++index;
-      lastC = c;
-      break;
-
-      // Strings
-    case wxT('\"'):
-      ++it;++index;
-      while ((it != text.end()) && (c = *it) != wxT('\"'))
-      {
-        if (c == wxT('\\'))
-        {++it;++index;}
-          
-        if(it != text.end())
-        {++it;++index;}
-      }
-      if ((it != text.end()) && (*it != wxT('\"'))) return (_("Unterminated string."));
-      lastC = c;
-      break;
-        
-    // a to_lisp command
-    case wxT('t'):
-    {
-      // Extract 7 chars of the string.
-      wxString command;
-      wxString::const_iterator it2(it);
-      if(it2 != text.end())
-      {
-        command += wxString(*it2);          
-        ++it2;
-      }
-      while((it2 != text.end()) && (wxIsalpha(*it2)))
-      {
-        command += wxString(*it2);
-        ++it2;
-      }
-      if(command.StartsWith(wxT("to_lisp")))
-         lisp = true;
-      break;
-    }
+  CommandPreprocessor command;
+  command.Process(text, m_inLispMode);
+  index = command.GetErrorIndex();
+  return command.GetError();
+}
 
-    // An eventual :lisp command
-    case wxT(':'):
-    {
-      // Extract 5 chars of the string.
-      wxString command;
-      wxString::const_iterator it2(it);
-      if(it2 != text.end())
-      {
-        command += wxString(*it2);          
-        ++it2;
-      }
-      while((it2 != text.end()) && (wxIsalpha(*it2)))
-      {
-        command += wxString(*it2);
-        ++it2;
-      }
-      
-      // Let's see if this is a :lisp-quiet or a :lisp
-      if ((command == wxT(":lisp")) || (command == wxT(":lisp-quiet")))
-        lisp = true;
-      lastC = c;
-      break;
-    }
-    case wxT(';'):
-    case wxT('$'):
-      if ((!lisp) && (!delimiters.empty()))
-      {
-        return _("Un-closed parenthesis on encountering ; or $");
-      }
-        lastC = c;
-        break;
-        
-        // Comments
-    case wxT('/'):
-          if (it != text.end())
-          {
-            wxString::const_iterator it2(it);
-            ++it2;
-            if (*it2 == wxT('*'))
-            {
-              // Comment start. Let's search for the comment end.
+bool wxMaxima::CommandFinished()
+{
+  if (m_console->m_cellPointers.m_commandsInFlight.empty())
+    return true;
 
-              if (it != text.end())
-              {++it;++index;}
-              while(it != text.end())
-              {
-                char last;
-                last = *it;
-                ++it;++index;
+  bool queued = (m_console->m_cellPointers.m_commandsInFlight.front().m_generation == m_console->m_evaluationQueue.Generation());
+  m_console->m_cellPointers.m_commandsInFlight.pop_front();
+  return queued;
+}
 
-                // We reached the end of the string without finding a comment end.
-                if(it == text.end())
-                  return (_("Unterminated comment."));
+void wxMaxima::FillPipeline()
+{
+  std::list<CellPointers::CommandInFlight> &commandsInFlight = m_console->m_cellPointers.m_commandsInFlight;
+  long depth = m_console->m_configuration->PipelineDepth();
+  if ((depth <= 0) || m_console->QuestionPending() || commandsInFlight.empty())
+    return;
 
-                // A comment end.
-                if((last == wxT('*')) && (*it == wxT('/')))
-                  break;
-              }
-            }
-            else lastC = c;
-          }
-          else lastC = c;
-          break;
-        
-          default:
-            if ((c != wxT('\n')) && (c != wxT(' ')) && (c != wxT('\t')))
-              lastC = c;
-    }
+  // Maxima would evaluate the commands sent ahead even if the current one
+  // fails => If an error is to abort the evaluation we use lock-step.
+  bool abortOnError = false;
+  wxConfig::Get()->Read(wxT("abortOnError"), &abortOnError);
+  if (abortOnError || m_batchmode)
+    return;
 
-    if (
-      (c != wxT(' ')) &&
-      (c != wxT('\t')) &&
-      (c != wxT('\n')) &&
-      (c != wxT('\r'))
-      )
-      lastnonWhitespace = c;
+  // Maxima would read the commands sent ahead as the answer to a question.
+  // Cells that have asked questions before are likely to do so again =>
+  // they are evaluated in lock-step.
+  GroupCell *last = dynamic_cast<GroupCell *>(commandsInFlight.back().m_cell);
+  if ((last == NULL) || (!last->m_knownAnswers.empty()))
+    return;
 
-    ++it;++index;
-    }
-    if (!delimiters.empty())
-    {
-      return _("Un-closed parenthesis");
-    }
+  long generation = m_console->m_evaluationQueue.Generation();
 
-    if ((!lisp))
-    {
+  // The first command in flight is the one maxima is working on.
+  while ((long) commandsInFlight.size() <= depth)
+  {
+    GroupCell *cell;
+    wxString command;
+    if (!m_console->m_evaluationQueue.GetCommandAhead(commandsInFlight.size(), cell, command))
+      return;
+    if (!cell->m_knownAnswers.empty())
+      return;
 
-      bool endingNeeded = true;
-      text.Trim(true);
-      text.Trim(false);
-    
-      // Cells ending in ";" or in "$" don't require us to add an ending.
-      if (lastC == wxT(';'))
-        endingNeeded = false;
-      if (lastC == wxT('$'))
-        endingNeeded = false;
-    
-      // Cells ending in "(to-maxima)" (with optional spaces around the "to-maxima")
-      // don't require us to add an ending, neither.
-      if(text.EndsWith(wxT(")")))
-      {
-        text = text.SubString(0,text.Length()-2);
-        text.Trim();
-        if (text.EndsWith(wxT("to-maxima")))
-          endingNeeded = false;
-      }
+    // A cell with unmatched parenthesis is reported once it is the current one.
+    int index;
+    if (GetUnmatchedParenthesisState(cell->GetEditable()->ToString(true), index) != wxEmptyString)
+      return;
 
-      if(endingNeeded)
-        return _("No dollar ($) or semicolon (;) at the end of command");
-    }
-    return wxEmptyString;
+    SendMaxima(command, true);
+    commandsInFlight.push_back(CellPointers::CommandInFlight(cell, generation));
+  }
 }
 
 //! Tries to evaluate next group cell in queue
@@ -6441,15 +7556,18 @@ void wxMaxima::TryEvaluateNextInQueue()
     return;
   }
 
+  // Maxima still evaluates commands that were sent ahead before the queue was
+  // cleared. ReadPrompt() will call us again as soon as it has finished them.
+  if ((!m_console->m_cellPointers.m_commandsInFlight.empty()) &&
+      (m_console->m_cellPointers.m_commandsInFlight.front().m_generation != m_console->m_evaluationQueue.Generation()))
+    return;
+
   // Maxima is connected. Let's test if the evaluation queue is empty.
   GroupCell *tmp = dynamic_cast<GroupCell *>(m_console->m_evaluationQueue.GetCell());
   if (tmp == NULL)
   {
     // Maxima is no more busy.
     StatusMaximaBusy(waiting);
-    // If maxima isn't doing anything there is no need to poll for input from
-    // maxima's stdout.
-    m_maximaStdoutPollTimer.Stop();
     // Inform the user that the evaluation queue length now is 0.
     EvaluationQueueLength(0);
     // The cell from the last evaluation might still be shown in it's "evaluating" state
@@ -6474,12 +7592,6 @@ void wxMaxima::TryEvaluateNextInQueue()
 
   // Maxima is connected and the queue contains an item.
 
-  // From now on we look every second if we got some output from a crashing
-  // maxima: Is maxima is working correctly the stdout and stderr descriptors we
-  // poll don't offer any data.
-  ReadStdErr();
-  m_maximaStdoutPollTimer.Start(1000);
-
   if (m_console->m_evaluationQueue.m_workingGroupChanged)
   {
     // If the cell's output that we are about to remove contains the currently
@@ -6495,16 +7607,37 @@ void wxMaxima::TryEvaluateNextInQueue()
         m_console->SetSelection(NULL, NULL);
     }
     tmp->RemoveOutput();
+    m_console->SetSaved(false);
     m_console->Recalculate(tmp);
     m_console->RequestRedraw();
+
+    // Check the whole cell only once instead of once per command it contains
+    // and remember what it defines and uses, see EvaluateChangedCells().
+    CommandPreprocessor cell;
+    cell.Process(tmp->GetEditable()->ToString(true), m_inLispMode, true);
+    m_checkedCell = tmp;
+    m_checkedCellError = cell.GetError();
+    m_checkedCellErrorIndex = cell.GetErrorIndex();
+    wxArrayString defined;
+    wxArrayString used;
+    WX_APPEND_ARRAY(defined, cell.GetVariables());
+    WX_APPEND_ARRAY(defined, cell.GetFunctions());
+    WX_APPEND_ARRAY(used, cell.GetSymbols());
+    tmp->Evaluated(m_maximaSession, tmp->GetEditable()->GetValue(), defined, used);
   }
 
   wxString text = m_console->m_evaluationQueue.GetCommand();
   m_commandIndex = m_console->m_evaluationQueue.GetIndex();
   if ((text != wxEmptyString) && (text != wxT(";")) && (text != wxT("$")))
   {
-    int index;
-    wxString parenthesisError = GetUnmatchedParenthesisState(tmp->GetEditable()->ToString(true),index);
+    if (m_checkedCell != tmp)
+    {
+      m_checkedCell = tmp;
+      m_checkedCellError = GetUnmatchedParenthesisState(tmp->GetEditable()->ToString(true),
+                                                        m_checkedCellErrorIndex);
+    }
+    wxString parenthesisError = m_checkedCellError;
+    int index = m_checkedCellErrorIndex;
     if (parenthesisError == wxEmptyString)
     {
       if (m_console->FollowEvaluation())
@@ -6529,7 +7662,16 @@ void wxMaxima::TryEvaluateNextInQueue()
         m_xmlInspector->Add(wxT("\n\n\nMAXIMA RESPONSE:\n\n"));
       }
 
-      SendMaxima(text, true);
+      // In pipelined mode the command might have been sent before the previous
+      // one was finished.
+      if (m_console->m_cellPointers.m_commandsInFlight.empty())
+      {
+        SendMaxima(text, true);
+        if (m_console->m_configuration->PipelineDepth() > 0)
+          m_console->m_cellPointers.m_commandsInFlight.push_back(
+            CellPointers::CommandInFlight(tmp, m_console->m_evaluationQueue.Generation()));
+      }
+      FillPipeline();
       EvaluationQueueLength(m_console->m_evaluationQueue.Size(),
                             m_console->m_evaluationQueue.CommandsLeftInCell()
       );
@@ -7045,8 +8187,8 @@ BEGIN_EVENT_TABLE(wxMaxima, wxFrame)
                 EVT_MENU(mac_closeId, wxMaxima::FileMenu)
                 EVT_MENU(menu_check_updates, wxMaxima::HelpMenu)
                 EVT_TIMER(KEYBOARD_INACTIVITY_TIMER_ID, wxMaxima::OnTimerEvent)
-                EVT_TIMER(MAXIMA_STDOUT_POLL_ID, wxMaxima::OnTimerEvent)
                 EVT_TIMER(AUTO_SAVE_TIMER_ID, wxMaxima::OnTimerEvent)
+                EVT_TIMER(REPLAY_TIMER_ID, wxMaxima::OnTimerEvent)
                 EVT_TIMER(wxID_ANY, wxMaxima::OnTimerEvent)
                 EVT_COMMAND_SCROLL(ToolBar::plot_slider_id, wxMaxima::SliderEvent)
                 EVT_MENU(MathCtrl::popid_copy, wxMaxima::PopupMenu)
@@ -7257,6 +8399,9 @@ BEGIN_EVENT_TABLE(wxMaxima, wxFrame)
                 EVT_TOOL(ToolBar::tb_follow, wxMaxima::OnFollow)
                 EVT_SOCKET(socket_server_id, wxMaxima::ServerEvent)
                 EVT_SOCKET(socket_client_id, wxMaxima::ClientEvent)
+                EVT_SOCKET(socket_standby_id, wxMaxima::StandbyEvent)
+                EVT_SOCKET(socket_kernel_server_id, wxMaxima::KernelServerEvent)
+                EVT_SOCKET(socket_kernel_client_id, wxMaxima::KernelEvent)
 /* These commands somehow caused the menu to be updated six times on every
    keypress and the tool bar to be updated six times on every menu update
 
@@ -7302,6 +8447,11 @@ EVT_UPDATE_UI(menu_show_toolbar, wxMaxima::UpdateMenus)
 */
                 EVT_CLOSE(wxMaxima::OnClose)
                 EVT_END_PROCESS(maxima_process_id, wxMaxima::OnProcessEvent)
+                EVT_THREAD(maxima_stdout_id, wxMaxima::OnMaximaOutput)
+                EVT_THREAD(maxima_stderr_id, wxMaxima::OnMaximaOutput)
+                EVT_END_PROCESS(kernel_process_id, wxMaxima::KernelProcessEvent)
+                EVT_THREAD(kernel_stdout_id, wxMaxima::KernelProcessOutput)
+                EVT_THREAD(kernel_stderr_id, wxMaxima::KernelProcessOutput)
                 EVT_MENU(MathCtrl::popid_edit, wxMaxima::EditInputMenu)
                 EVT_MENU(menu_evaluate, wxMaxima::EvaluateEvent)
                 EVT_MENU(menu_add_comment, wxMaxima::InsertMenu)
@@ -7342,6 +8492,8 @@ EVT_UPDATE_UI(menu_show_toolbar, wxMaxima::UpdateMenus)
                 EVT_MENU(MathCtrl::popid_unfold, wxMaxima::PopupMenu)
                 EVT_MENU(menu_evaluate_all_visible, wxMaxima::MaximaMenu)
                 EVT_MENU(menu_evaluate_all, wxMaxima::MaximaMenu)
+                EVT_MENU(menu_evaluate_sections_parallel, wxMaxima::MaximaMenu)
+                EVT_MENU(menu_evaluate_changed, wxMaxima::MaximaMenu)
                 EVT_MENU(ToolBar::tb_evaltillhere, wxMaxima::MaximaMenu)
                 EVT_IDLE(wxMaxima::OnIdle)
                 EVT_MENU(menu_remove_output, wxMaxima::EditMenu)
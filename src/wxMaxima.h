@@ -32,6 +32,11 @@
 
 #include "wxMaximaFrame.h"
 #include "MathParser.h"
+#include "SessionRecording.h"
+#include "MaximaKernel.h"
+#include "CommandPreprocessor.h"
+#include "OutputClassifier.h"
+#include "MaximaProcess.h"
 
 #include <wx/socket.h>
 #include <wx/config.h>
@@ -39,6 +44,8 @@
 #include <wx/regex.h>
 #include <wx/html/htmlwin.h>
 #include <wx/dnd.h>
+#include <wx/stopwatch.h>
+#include <wx/dcmemory.h>
 
 #if defined (__WXMSW__)
 #include <wx/msw/helpchm.h>
@@ -102,8 +109,8 @@ public:
             KEYBOARD_INACTIVITY_TIMER_ID,
     //! The time between two auto-saves has elapsed.
             AUTO_SAVE_TIMER_ID,
-    //! We look if we got new data from maxima's stdout.
-            MAXIMA_STDOUT_POLL_ID
+    //! The next chunk of a recorded session is to be replayed.
+            REPLAY_TIMER_ID
   };
 
   /*! A timer that determines when to do the next autosave;
@@ -121,8 +128,8 @@ public:
   //! Is triggered when a timer this class is responsible for requires
   void OnTimerEvent(wxTimerEvent &event);
 
-  //! A timer that polls for output from the maxima process.
-  wxTimer m_maximaStdoutPollTimer;
+  //! A timer that feeds the next chunk of a recorded session to ReplayNextRecord()
+  wxTimer m_replayTimer;
 
   /*! The interval between auto-saves (in milliseconds). 
 
@@ -155,7 +162,29 @@ public:
     m_batchmode = batch;
   }
 
-  void StripComments(wxString &s);
+  /*! Evaluate and save the file without ever showing this window
+
+    Must be called after SetOpenFile() and before InitSession(). The outcome is reported to
+    MyApp::BatchFinished() and the window closes itself afterwards.
+
+    \param exportHTML true = additionally export the evaluated file as HTML
+   */
+  void SetHeadless(bool exportHTML = false);
+
+  /*! Record all data exchanged with maxima to a file
+
+    Must be called before InitSession(). See SessionRecording for the file format.
+   */
+  bool SetSessionRecording(wxString file)
+  { return m_sessionRecording.StartRecording(file); }
+
+  /*! Replay a recorded session instead of starting maxima
+
+    Must be called before InitSession(). The output the recording contains is fed
+    through the same code maxima's output is read, parsed and displayed by.
+   */
+  void SetSessionReplay(wxString file)
+  { m_replayFile = file; }
 
   void SendMaxima(wxString s, bool history = false);
 
@@ -168,10 +197,12 @@ public:
   { m_console->OpenHCaret(file, GC_TYPE_IMAGE); }
 
 private:
-  //! A RegEx that matches gnuplot errors.
-  wxRegEx m_gnuplotErrorRegex;
+  //! Tells errors and warnings from ordinary text in maxima's output
+  OutputClassifier m_outputClassifier;
   //! Clear the evaluation queue and return true if "Abort on Error" is set. 
   bool AbortOnError();
+  //! Does this prompt tell that maxima awaits the next command (as opposed to being a question)?
+  bool IsInputPrompt(wxString prompt);
   //! This string allows us to detect when the string we search for has changed.
   wxString m_oldFindString;
   //! This string allows us to detect when the string we search for has changed.
@@ -190,17 +221,49 @@ private:
   wxString m_CWD;
   //! Are we in batch mode?
   bool m_batchmode;
+  //! Are we evaluating a file without a window on the screen? See SetHeadless()
+  bool m_headless;
+  //! Has the result of the headless evaluation already been reported?
+  bool m_headlessDone;
+  //! The file the headless window has been asked to evaluate
+  wxString m_headlessFile;
+  //! Do we export the file as HTML once the headless evaluation has finished?
+  bool m_headlessExportHTML;
+  //! Measures how long the headless evaluation of the file takes
+  wxStopWatch m_headlessStopWatch;
+  //! The bitmap m_headlessDC draws to
+  wxBitmap m_headlessBitmap;
+  //! The draw context a window that is never painted uses for size calculations
+  wxMemoryDC m_headlessDC;
+  /*! Report the outcome of the headless evaluation and close the window
+
+    \param status "ok" if the file has been evaluated, else a short description
+           of what went wrong. Files that have been evaluated are saved even if
+           maxima has reported errors, in which case the status becomes "error".
+   */
+  void FinishHeadless(wxString status);
+  /*! Queue the file for evaluation in headless mode if this hasn't happened yet
+
+    \return true, if cells have been added to the evaluation queue.
+   */
+  bool StartHeadless();
   //! Can we display the "ready" prompt right now?
   bool m_ready;
 
   /*! A human-readable presentation of eventual unmatched-parenthesis type errors
 
-    If text doesn't contain any error this function returns wxEmptyString
-
-    \todo: Use iterators for traversing the string as they are *way* faster than
-    the current method.
+    If text doesn't contain any error this function returns wxEmptyString.
+    See CommandPreprocessor.
    */
   wxString GetUnmatchedParenthesisState(wxString text,int &index);
+  //! The cell TryEvaluateNextInQueue() has checked for unmatched parenthesis last
+  GroupCell *m_checkedCell;
+  //! The error GetUnmatchedParenthesisState() has found in m_checkedCell
+  wxString m_checkedCellError;
+  //! The position of m_checkedCellError in m_checkedCell
+  int m_checkedCellErrorIndex;
+  //! Offer the functions and variables a command defines for autocompletion
+  void AddToAutocompletion(CommandPreprocessor &command);
 
 protected:
   //! Is this window active?
@@ -299,12 +362,46 @@ protected:
    */
   void ClientEvent(wxSocketEvent &event);
 
+  //! Converts the bytes maxima has sent to a string
+  wxString DecodeMaximaOutput(char *buffer, int length);
+
+  //! Converts a chunk of bytes MaximaProcess has read from maxima's stdout or stderr to a string
+  wxString DecodeProcessOutput(const wxString &chunk);
+
+  /*! Interprets new data we got from maxima
+
+    Appends the data to m_currentOutput and then extracts and displays all tags 
+    m_currentOutput contains in full.
+   */
+  void InterpretMaximaOutput(wxString newChars);
+
+  //! Starts replaying the session recorded in m_replayFile
+  bool StartReplay();
+
+  //! Feeds the next chunk of output from the recorded session to InterpretMaximaOutput()
+  void ReplayNextRecord();
+
+  /*! Handles a chunk of data from maxima's stdout or stderr
+
+    The chunks are read by background threads, see MaximaProcess.
+   */
+  void OnMaximaOutput(wxThreadEvent &event);
+
   void ConsoleAppend(wxString s, int type, wxString userLabel = wxEmptyString);        //!< append maxima output to console
   void DoConsoleAppend(wxString s, int type,       //
                        bool newLine = true, bool bigSkip = true, wxString userLabel = wxEmptyString);
 
   void DoRawConsoleAppend(wxString s, int type);   //
 
+  //! Converts text into a list of TextCells, one per line
+  MathCell *TextLines(wxString s, int type);
+
+  /*! Converts maxima's output to a xml fragment MathParser::ParseLine() understands
+
+    Used for output that is kept collapsed instead of being displayed.
+   */
+  wxString CollapsibleXML(wxString s, int type);
+
   /*! Spawn the "configure" menu.
 
     \todo Inform maxima about the new default plot window size.
@@ -333,6 +430,26 @@ protected:
   //! Try to evaluate the next command for maxima that is in the evaluation queue
   void TryEvaluateNextInQueue();
 
+  /*! Sends commands from the evaluation queue ahead of time
+
+    Keeps up to Configuration::PipelineDepth() commands waiting in maxima's
+    input behind the one maxima is working on. Nothing is sent ahead of or
+    from a cell that has known answers (GroupCell::m_knownAnswers): maxima
+    would read the commands as the answer to the question the cell asks.
+    If a question arrives nonetheless no more commands are sent ahead until
+    it has been answered, see ReadPrompt(). Nothing is sent ahead if an error
+    is to abort the evaluation, either: maxima would evaluate the commands
+    sent ahead anyway.
+   */
+  void FillPipeline();
+
+  /*! Forgets the command maxima has just sent the main prompt for
+
+    \return false, if the evaluation queue has been cleared since the command
+            had been sent.
+   */
+  bool CommandFinished();
+
   void TryUpdateInspector();
 
   wxString ExtractFirstExpression(wxString entry);
@@ -350,13 +467,102 @@ protected:
    */
   bool StartMaxima(bool force = false);
 
+  //! The command line parameters that make maxima connect to the server on port
+  wxString SocketParameters(wxString command, int port);
+
+  /*! Starts a maxima in the background the next restart of maxima can use
+
+    Only done if the configuration asks for a warm standby and if we talk to
+    maxima via the network: The standby connects to the server our maxima is
+    connected to, too.
+   */
+  void StartStandby();
+
+  //! Sends the standby maxima the commands SetupVariables() would send.
+  void SetupStandby();
+
+  //! Is triggered on input from or disconnect of the standby maxima
+  void StandbyEvent(wxSocketEvent &event);
+
+  /*! Makes a fully set-up standby maxima the maxima we talk to
+
+    \return false, if there was no standby maxima that was ready to be used.
+   */
+  bool SwapInStandby();
+
+  //! Kills the standby maxima, if there is one
+  void KillStandby();
+
+  /*! Evaluates the sections of the worksheet using several maxima processes at once
+
+    Everything in front of the first section (or title) is evaluated by our
+    maxima. The sections are distributed to up to
+    Configuration::SectionKernels() additional maximas, see MaximaKernel.
+   */
+  void EvaluateSectionsInParallel();
+
+  /*! Re-evaluates the cells that have changed and the cells that depend on them
+
+    A cell is considered as changed if its contents differ from what has been
+    sent to the current maxima process. The cells that use symbols a changed
+    cell defines (or used to define) are re-evaluated, too, as are the cells
+    that use the symbols these cells define.
+   */
+  void EvaluateChangedCells();
+
+  //! Finds the symbols commands defines
+  void FindDefinitions(wxString commands, wxArrayString &defined);
+
+  //! Splits the visible cells of tree into sections, beginning with the last entry of sections
+  void CollectSections(GroupCell *tree, std::list<std::list<GroupCell *> > &sections);
+
+  //! Starts an additional maxima for evaluating sections in
+  MaximaKernel *StartKernel();
+
+  //! The additional maxima the socket or server belongs to, or NULL
+  MaximaKernel *FindKernel(wxSocketBase *socket);
+
+  //! Is triggered when an additional maxima connects to its server
+  void KernelServerEvent(wxSocketEvent &event);
+
+  //! Is triggered on input from or disconnect of an additional maxima
+  void KernelEvent(wxSocketEvent &event);
+
+  /*! Places a piece of the output of a command an additional maxima has evaluated in its cell
+
+    Doesn't touch the state of the output of our maxima: It might be in the middle
+    of sending a command's output.
+    \param kernel The additional maxima
+    \param cell The cell the command belongs to
+    \param output The piece of output, see MaximaKernel::ReadOutput()
+   */
+  void KernelOutput(MaximaKernel *kernel, GroupCell *cell, const MaximaKernel::Output &output);
+
+  //! Appends an error message of ours to a cell an additional maxima evaluates
+  void KernelError(GroupCell *cell, wxString message);
+
+  //! Sends an additional maxima the next command from its evaluation queue
+  void KernelEvaluateNext(MaximaKernel *kernel);
+
+  //! Informs the user why an additional maxima cannot be used any more and kills it
+  void KernelLost(MaximaKernel *kernel, wxString message);
+
+  //! Kills all additional maximas
+  void KillKernels();
+
+  //! Is triggered when the process of an additional maxima has terminated
+  void KernelProcessEvent(wxProcessEvent &event);
+
+  //! Is triggered when an additional maxima has written to its stdout or stderr
+  void KernelProcessOutput(wxThreadEvent &event);
+
+  //! Tells the user which of the additional maximas are busy
+  void KernelStatus();
+
   void OnClose(wxCloseEvent &event);               //!< close wxMaxima window
   wxString GetCommand(bool params = true);         //!< returns the command to start maxima
   //    (uses guessConfiguration)
 
-  //! Polls the stderr and stdout of maxima for input.
-  void ReadStdErr();
-
   /*! Determines the process id of maxima from its initial output
 
     This function does several things:
@@ -402,6 +608,12 @@ protected:
    */
   void ReadStatusBar(wxString &data);
 
+  /*! Reads the acknowledgement of the setup commands SetupVariables() sends
+
+    Displays how long starting and setting up maxima took.
+   */
+  void ReadSetupDone(wxString &data);
+
   /*! Reads the math cell's contents from Maxima.
      
      Math cells are enclosed between the tags \<mth\> and \</mth\>. 
@@ -418,6 +630,24 @@ protected:
    */
   void ReadLoadSymbols(wxString &data);
 
+  /*! Reads a message maxima has preceded by a frame header
+
+    If wxMaxima has asked for it in SetupVariables() wxmathml.lisp precedes math,
+    status bar messages and autocompletion templates by a header of the form
+    <code>\<FRAME-type:length/\></code>, which tells us where the message ends
+    without us having to search for its end tag. If the message isn't complete, 
+    yet, data is left untouched.
+
+    After processing the message it is removed from data.
+   */
+  void ReadFrame(wxString &data);
+
+  //! Appends a \<mth\> tag maxima has sent to the console
+  void MathOutput(wxString math);
+
+  //! Adds the autocompletion templates from a \<wxxml-symbols\> tag without its tags
+  void AddSymbols(wxString symbols);
+
 #ifndef __WXMSW__
 
   //!< reads the output the maxima command sends to stdout
@@ -437,6 +667,27 @@ protected:
  */
   void SetupVariables();
 
+  //! The commands SetupVariables() sends to maxima
+  wxArrayString GetSetupCommands();
+
+  /*! Combines setup commands into one command maxima acknowledges
+
+    Saves us one round-trip per setup command.
+   */
+  wxString SetupPayload(wxArrayString commands);
+
+  /*! The command that loads wxmathml
+
+    Makes maxima compile wxmathml.lisp once for each lisp and version of
+    wxmathml.lisp and load the compiled file instead of the source.
+
+    \param wxmathml The path to wxmathml.lisp without the extension
+   */
+  wxString LoadWxmathmlCommand(wxString wxmathml);
+
+  //! Tells a freshly set-up maxima about the current document
+  void SetupDocument();
+
   void KillMaxima();                 //!< kills the maxima process
   /*! Update the title
 
@@ -482,6 +733,12 @@ protected:
   //! Set the current working directory file I/O from maxima is relative to.
   void SetCWD(wxString file);
 
+  /*! The commands that tell maxima the working directory file I/O is relative to
+
+    Empty if maxima already uses this directory.
+   */
+  wxArrayString GetCWDCommands(wxString file);
+
   //! Get the current working directory file I/O from maxima is relative to.
   wxString GetCWD()
   {
@@ -494,11 +751,46 @@ protected:
   bool m_isConnected;
   //! Is maxima running?
   bool m_isRunning;
-  wxProcess *m_process;
-  //! The stdout of the maxima process
-  wxInputStream *m_maximaStdout;
-  //! The stderr of the maxima process
-  wxInputStream *m_maximaStderr;
+  MaximaProcess *m_process;
+
+  //! A maxima that is kept ready in the background, see StartStandby()
+  MaximaProcess *m_standbyProcess;
+  //! The connection to the standby maxima
+  wxSocketBase *m_standbyClient;
+  //! The process id of the lisp the standby maxima runs in
+  long m_standbyPid;
+  //! Has the standby maxima processed all of the setup commands?
+  bool m_standbyReady;
+  //! The output of the standby maxima that hasn't been interpreted yet
+  wxString m_standbyOutput;
+  //! What the standby maxima has sent to its stdout, see m_processOutput
+  wxString m_standbyProcessOutput;
+  //! The additional maximas sections are evaluated in, see EvaluateSectionsInParallel()
+  std::list<MaximaKernel *> m_kernels;
+  //! Identifies the current maxima process, see GroupCell::Evaluated()
+  long m_maximaSession;
+  //! Counts the maxima processes we have started, including the ones that evaluate sections
+  long m_maximaSessions;
+  //! The text maxima sends as soon as it has processed the setup commands
+  wxString m_setupDoneMarker;
+  //! Measures how long starting and setting up maxima takes
+  wxStopWatch m_startupStopWatch;
+  //! How many milliseconds it took maxima to show its first prompt. -1 = not known, yet.
+  long m_startupTime;
+  /*! What maxima has sent to its stdout before it connected to us
+
+    Contains maxima's greeting, see ReadProcessOutput().
+   */
+  wxString m_processOutput;
+  //! The stdin of the maxima process
+  wxOutputStream *m_maximaStdin;
+  //! Writes all of the data to m_maximaStdin, even if the pipe only accepts part of it at once
+  void WriteToMaximaStdin(const char *data, size_t length);
+  /*! Do we talk to maxima via its stdin and stdout instead of a network socket?
+
+    Read from the configuration each time maxima is started.
+   */
+  bool m_pipeTransport;
   int m_port;
   /*! The end of maxima's current uninterpreted output, see m_currentOutput.
    
@@ -519,6 +811,8 @@ protected:
   wxString m_symbolsPrefix;
   //! The marker for the end of a list of autocompletion templates
   wxString m_symbolsSuffix;
+  //! The marker for the start of a frame header, see ReadFrame()
+  wxString m_framePrefix;
   wxString m_firstPrompt;
   bool m_dispReadOut;               //!< what is displayed in statusbar
   bool m_inLispMode;                //!< don't add ; in lisp mode
@@ -527,6 +821,18 @@ protected:
   wxPrintData *m_printData;
   bool m_closing;
   char *m_inputBuffer;
+  //! Records the data exchanged with maxima, if requested
+  SessionRecording m_sessionRecording;
+  //! The recorded session to replay instead of starting maxima. Empty = none.
+  wxString m_replayFile;
+  //! The recorded session that is currently being replayed
+  SessionRecording m_sessionReplay;
+  //! The record of m_sessionReplay that is to be replayed next
+  size_t m_replayRecord;
+  //! The number of bytes of output from the recorded session that have been replayed
+  long m_replayedBytes;
+  //! Measures how long replaying the recorded session takes
+  wxStopWatch m_replayStopWatch;
   wxString m_openFile;
   bool m_fileSaved;
   bool m_variablesOK;
@@ -541,9 +847,6 @@ protected:
 #endif
   wxHtmlHelpController m_htmlhelpCtrl;
   wxFindReplaceData m_findData;
-  wxRegEx m_funRegEx;
-  wxRegEx m_varRegEx;
-  wxRegEx m_blankStatementRegEx;
 #if wxUSE_DRAG_AND_DROP
 
   friend class MyDropTarget;
@@ -587,8 +890,34 @@ public:
 
     \param file The file name
     \param batchmode Do we want to execute the file and save it, but halt on error?
+    \param headless Do we want to do so without showing the window? See StartBatch()
+   */
+  void NewWindow(wxString file = wxEmptyString, bool batchmode = false, bool headless = false);
+
+  /*! Evaluate and save a list of files without showing any window
+
+    Each file is evaluated in a hidden window with a maxima process of its own.
+    Up to jobs files are evaluated at the same time.
+
+    \param files The files to evaluate
+    \param jobs The number of files that are evaluated at once
+    \param summary The file the tab-separated summary is written to. Empty = stdout.
+    \param exportHTML true = additionally export each file as HTML
+    \return false, if not a single file could be evaluated
+   */
+  bool StartBatch(wxArrayString files, long jobs, wxString summary, bool exportHTML);
+
+  /*! Called by a headless window as soon as its file has been evaluated
+
+    \param file The file that has been evaluated
+    \param status "ok", or a short description of what went wrong
+    \param milliseconds How long the evaluation took
+    \param errors The number of cells maxima has complained about errors in
    */
-  void NewWindow(wxString file = wxEmptyString, bool batchmode = false);
+  void BatchFinished(wxString file, wxString status, long milliseconds, long errors);
+
+  //! Returns a non-zero exit code if a file in the batch has failed
+  virtual int OnRun();
 
   //! Is called by atExit and tries to close down the maxima process if wxMaxima has crashed.
   static void Cleanup_Static();
@@ -606,6 +935,26 @@ public:
 private:
   //! The name of the config file. Empty = Use the default one.
   wxString m_configFileName;
+  //! The file the next window records its session to. Empty = Don't record.
+  wxString m_recordFile;
+  //! The recorded session the next window replays. Empty = Start maxima instead.
+  wxString m_replayFile;
+  //! The files StartBatch() still has to open
+  wxArrayString m_batchFiles;
+  //! The number of files that are evaluated at once in batch mode
+  long m_batchJobs;
+  //! The number of files that are being evaluated right now
+  long m_batchRunning;
+  //! The file the batch summary is written to. Empty = stdout.
+  wxString m_batchSummary;
+  //! Do we export each file of the batch as HTML?
+  bool m_batchHtml;
+  //! The number of files in the batch that couldn't be evaluated without problems
+  long m_batchFailures;
+  //! Open the next files of the batch, if there are free slots
+  void StartBatchJobs();
+  //! Append a line to the batch summary
+  void WriteBatchSummary(wxString line);
   DECLARE_EVENT_TABLE()
 };
 
@@ -569,6 +569,12 @@ void wxMaximaFrame::SetupMenu()
                      _("Evaluate all visible cells in the document"), wxITEM_NORMAL);
   m_CellMenu->Append(menu_evaluate_all, _("Evaluate All Cells\tCtrl+Shift+R"),
                      _("Evaluate all cells in the document"), wxITEM_NORMAL);
+  m_CellMenu->Append(menu_evaluate_sections_parallel, _("Evaluate Sections in Parallel"),
+                     _("Evaluate each section of the document in one of several maxima processes"),
+                     wxITEM_NORMAL);
+  m_CellMenu->Append(menu_evaluate_changed, _("Evaluate Changed Cells and Dependents"),
+                     _("Re-evaluate the cells that have been edited and the cells that use what they define"),
+                     wxITEM_NORMAL);
   m_CellMenu->Append(ToolBar::tb_evaltillhere, _("Evaluate Cells Above\tCtrl+Shift+P"),
                      _("Re-evaluate all cells above the one the cursor is in"), wxITEM_NORMAL);
 
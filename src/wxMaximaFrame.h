@@ -111,6 +111,9 @@ public:
 
     socket_client_id,
     socket_server_id,
+    socket_standby_id,
+    socket_kernel_server_id,
+    socket_kernel_client_id,
     input_line_id,
     refresh_id,
     menu_new_id,
@@ -242,6 +245,8 @@ public:
     menu_add_path,
     menu_evaluate_all_visible,
     menu_evaluate_all,
+    menu_evaluate_sections_parallel,
+    menu_evaluate_changed,
     menu_show_tip,
     menu_copy_from_console,
     menu_copy_tex_from_console,
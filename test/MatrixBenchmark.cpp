@@ -0,0 +1,178 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  Measures how long it takes to lay out and to draw big matrices
+
+  For each matrix size this program lays out a square matrix of numbers and 
+  draws the part of it that fits on one screen twice: Once laying out every row 
+  as printouts and exports do and once with the lazy layout the worksheet uses
+  that lays out only the rows that are drawn.
+
+  Options:
+    - --max-size the number of rows and columns of the biggest matrix to test.
+    - --repeat how often to lay out and to draw each matrix.
+*/
+
+#include <wx/app.h>
+#include <wx/cmdline.h>
+#include <wx/bitmap.h>
+#include <wx/dcmemory.h>
+#include <wx/stopwatch.h>
+#include <wx/crt.h>
+
+#include "MatrCell.h"
+#include "TextCell.h"
+#include "CellPointers.h"
+#include "Configuration.h"
+
+//! The size of the screen the matrices are drawn on
+#define BENCHMARK_SCREEN_WIDTH 1024
+#define BENCHMARK_SCREEN_HEIGHT 768
+
+/*! The benchmark
+
+  The matrices are drawn on a wxMemoryDC which needs the GUI toolkit to be 
+  initialized, which is why this is a wxApp and not a console program.
+ */
+class MatrixBenchmark : public wxApp
+{
+public:
+  virtual void OnInitCmdLine(wxCmdLineParser &parser);
+
+  virtual bool OnCmdLineParsed(wxCmdLineParser &parser);
+
+  virtual int OnRun();
+
+private:
+  /*! Lays out and draws a matrix
+
+    \param dc          The device context to draw on
+    \param size        The number of rows and columns of the matrix
+    \param lazy        true = Lay out only the rows that are drawn
+    \param layoutTime  Receives the time the layout needed [ms]
+    \param drawTime    Receives the time drawing needed [ms]
+    \return The height of the matrix
+   */
+  int Measure(wxDC &dc, long size, bool lazy, long &layoutTime, long &drawTime);
+
+  //! The number of rows and columns of the biggest matrix to test
+  long m_maxSize;
+  //! How often to lay out and to draw each matrix
+  long m_repeat;
+};
+
+IMPLEMENT_APP(MatrixBenchmark)
+
+void MatrixBenchmark::OnInitCmdLine(wxCmdLineParser &parser)
+{
+  static const wxCmdLineEntryDesc cmdLineDesc[] =
+          {
+                  {wxCMD_LINE_SWITCH, "h", "help", "show this help message", wxCMD_LINE_VAL_NONE,
+                   wxCMD_LINE_OPTION_HELP},
+                  {wxCMD_LINE_OPTION, NULL, "max-size", "the number of rows and columns of the biggest matrix",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "repeat", "how often to lay out and draw each matrix",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_NONE}
+          };
+
+  parser.SetDesc(cmdLineDesc);
+}
+
+bool MatrixBenchmark::OnCmdLineParsed(wxCmdLineParser &parser)
+{
+  m_maxSize = 500;
+  parser.Found(wxT("max-size"), &m_maxSize);
+  m_repeat = 3;
+  parser.Found(wxT("repeat"), &m_repeat);
+  if (m_repeat < 1)
+    m_repeat = 1;
+  return true;
+}
+
+int MatrixBenchmark::Measure(wxDC &dc, long size, bool lazy, long &layoutTime, long &drawTime)
+{
+  Configuration *configuration = new Configuration(dc, lazy);
+  CellPointers cellPointers(NULL);
+  int fontsize = configuration->GetMathFontSize();
+  int height = 0;
+  layoutTime = drawTime = 0;
+
+  for (long i = 0; i < m_repeat; i++)
+  {
+    MatrCell *matrix = new MatrCell(NULL, &configuration, &cellPointers);
+    for (long row = 0; row < size; row++)
+    {
+      matrix->NewRow();
+      for (long column = 0; column < size; column++)
+      {
+        matrix->NewColumn();
+        matrix->AddNewCell(new TextCell(matrix, &configuration, &cellPointers,
+                                        wxString::Format(wxT("%li"), row * size + column)));
+      }
+    }
+    matrix->SetDimension();
+
+    wxStopWatch stopWatch;
+    matrix->RecalculateWidths(fontsize);
+    matrix->RecalculateHeight(fontsize);
+    layoutTime += stopWatch.Time();
+
+    // Draw what fits on the screen like the worksheet would.
+    configuration->SetBounds(0, BENCHMARK_SCREEN_HEIGHT);
+    MathCell::ClipToDrawRegion(true);
+    MathCell::SetUpdateRegion(wxRect(0, 0, BENCHMARK_SCREEN_WIDTH, BENCHMARK_SCREEN_HEIGHT));
+    stopWatch.Start();
+    matrix->Draw(wxPoint(0, matrix->GetMaxCenter()), fontsize);
+    drawTime += stopWatch.Time();
+
+    height = matrix->GetMaxHeight();
+    wxDELETE(matrix);
+  }
+  wxDELETE(configuration);
+  return height;
+}
+
+int MatrixBenchmark::OnRun()
+{
+  wxBitmap bitmap(BENCHMARK_SCREEN_WIDTH, BENCHMARK_SCREEN_HEIGHT);
+  wxMemoryDC dc(bitmap);
+
+  wxPrintf(wxT("%8s %14s %14s %14s %14s\n"), wxT("size"),
+           wxT("layout [ms]"), wxT("draw [ms]"),
+           wxT("lazy layout"), wxT("lazy draw"));
+  for (long size = 10; size <= m_maxSize; size *= 2)
+  {
+    long layoutTime, drawTime, lazyLayoutTime, lazyDrawTime;
+    int height = Measure(dc, size, false, layoutTime, drawTime);
+    int lazyHeight = Measure(dc, size, true, lazyLayoutTime, lazyDrawTime);
+    wxPrintf(wxT("%8li %14li %14li %14li %14li\n"), size,
+             layoutTime / m_repeat, drawTime / m_repeat,
+             lazyLayoutTime / m_repeat, lazyDrawTime / m_repeat);
+    // The lazy layout estimates the height of the rows it hasn't laid out, yet.
+    if ((height <= 0) || (lazyHeight <= 0))
+    {
+      wxFprintf(stderr, wxT("The %lix%li matrix has no height.\n"), size, size);
+      return 1;
+    }
+  }
+  return 0;
+}
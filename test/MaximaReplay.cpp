@@ -0,0 +1,387 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  A stand-in for maxima that plays back recorded or generated output
+
+  This program speaks the protocol maxima speaks with wxMaxima: It connects to
+  the port wxMaxima listens on, sends the banner ReadFirstPrompt() waits for and
+  then answers each command wxMaxima sends by playing back output. This allows to
+  benchmark how fast wxMaxima reads, parses and displays output deterministically
+  and on machines maxima isn't installed on.
+
+  In order to use it set the maxima program in wxMaxima's configuration dialogue
+  to this program and the additional parameters to the options that select what
+  it should play back:
+    - --replay=<file> plays back a recording SessionRecording has written.
+      --realtime keeps the delays between the chunks of output the recording contains.
+    - Without --replay each command is answered by synthetic output: --lines
+      <mth> tags per command each of which contains a list that is --size 
+      characters long, followed by a status bar message, a list of symbols and
+      a prompt.
+    - --packet-size splits the output into packets of this size and --delay waits 
+      the given number of milliseconds between two packets.
+    - --log=<file> writes the time wxMaxima needed to send the next command
+      after receiving each answer to a file.
+*/
+
+#include <wx/init.h>
+#include <wx/cmdline.h>
+#include <wx/socket.h>
+#include <wx/stopwatch.h>
+#include <wx/utils.h>
+#include <wx/ffile.h>
+#include <wx/regex.h>
+#include <wx/crt.h>
+
+#include "SessionRecording.h"
+
+//! The prompt maxima outputs before wxMaxima has set up the prompt prefix and suffix
+#define REPLAY_FIRST_PROMPT "(%i1) "
+
+/*! Plays back output to wxMaxima
+ */
+class ReplayServer
+{
+public:
+  ReplayServer(wxSocketClient *socket)
+  {
+    m_socket = socket;
+    m_packetSize = 0;
+    m_delay = 0;
+    m_lines = 1;
+    m_size = 1000;
+    m_commandNumber = 1;
+    m_bytesSent = 0;
+    m_bytesSinceCommand = 0;
+    m_stopWatch.Start();
+  }
+
+  ~ReplayServer()
+  {
+    if (m_log.IsOpened())
+    {
+      m_log.Write(wxString::Format(wxT("total: %li commands, %li bytes in %li ms\n"),
+                                   m_commandNumber - 1, m_bytesSent, m_stopWatch.Time()));
+      m_log.Close();
+    }
+  }
+
+  //! Split the output into packets of this size. 0 means: Don't split the output.
+  void PacketSize(long size)
+  { m_packetSize = size; }
+
+  //! The number of milliseconds to wait between two packets
+  void Delay(long delay)
+  { m_delay = delay; }
+
+  //! The number of lines the synthetic output for each command consists of
+  void Lines(long lines)
+  { m_lines = lines; }
+
+  //! The number of characters each line of synthetic output contains
+  void Size(long size)
+  { m_size = size; }
+
+  //! Log the response times to a file
+  bool Log(wxString file)
+  { return m_log.Open(file, wxT("w")); }
+
+  //! Sends the banner maxima sends on connecting to wxMaxima
+  bool SendBanner()
+  {
+    wxString banner = wxString::Format(wxT("pid=%lu\nMaxima replay server\n"),
+                                       wxGetProcessId()) +
+                      wxT(REPLAY_FIRST_PROMPT);
+    return Send(banner);
+  }
+
+  //! Answers all commands with synthetic output until wxMaxima closes the connection
+  void Synthetic()
+  {
+    while (WaitForCommand())
+      if (!Send(SyntheticOutput()))
+        return;
+  }
+
+  //! Plays back a recording, then answers all further commands with a prompt
+  void Replay(SessionRecording &recording, bool realtime)
+  {
+    // The recording starts with the banner of the maxima process that was
+    // recorded. It contains the pid of a process that doesn't belong to us.
+    wxMemoryBuffer banner;
+    bool bannerSent = false;
+    long lastTime = -1;
+
+    for (size_t i = 0; i < recording.GetRecordCount(); i++)
+    {
+      SessionRecording::Record &record = recording.GetRecord(i);
+      if (record.m_direction == SessionRecording::toMaxima)
+      {
+        // :lisp-quiet commands don't cause maxima to answer.
+        wxString command = wxString::FromUTF8((const char *) record.m_data.GetData(),
+                                              record.m_data.GetDataLen());
+        if (!command.StartsWith(wxT(":lisp-quiet")))
+        {
+          if (!WaitForCommand())
+            return;
+          lastTime = -1;
+        }
+        continue;
+      }
+
+      if (!bannerSent)
+      {
+        banner.AppendData(record.m_data.GetData(), record.m_data.GetDataLen());
+        wxString data = wxString::FromUTF8((const char *) banner.GetData(), banner.GetDataLen());
+        int end = data.Find(wxT(REPLAY_FIRST_PROMPT));
+        if (end == wxNOT_FOUND)
+          continue;
+        bannerSent = true;
+        if (!Send(data.Mid(end + wxString(wxT(REPLAY_FIRST_PROMPT)).Length())))
+          return;
+        continue;
+      }
+
+      if (realtime && (lastTime >= 0) && (record.m_time > lastTime))
+        wxMilliSleep(record.m_time - lastTime);
+      lastTime = record.m_time;
+
+      if (!Send((const char *) record.m_data.GetData(), record.m_data.GetDataLen()))
+        return;
+    }
+
+    while (WaitForCommand())
+      if (!Send(Prompt()))
+        return;
+  }
+
+private:
+  //! The prompt that tells wxMaxima that the current command is finished
+  wxString Prompt()
+  { return wxString::Format(wxT("<PROMPT-P/>(%%i%li) <PROMPT-S/>"), m_commandNumber + 1); }
+
+  //! Generates the output for the current command
+  wxString SyntheticOutput()
+  {
+    wxString output;
+    for (long line = 0; line < m_lines; line++)
+    {
+      wxString mth = wxString::Format(wxT("<mth><lbl>(%%o%li) </lbl><r><t>[</t>"), m_commandNumber);
+      long number = 0;
+      while ((long) mth.Length() < m_size)
+      {
+        if (number > 0)
+          mth += wxT("<t>,</t>");
+        mth += wxString::Format(wxT("<n>%li</n>"), number++);
+      }
+      mth += wxT("<t>]</t></r></mth>");
+      output += mth;
+    }
+    output += wxString::Format(wxT("<statusbar>Replayed command %li</statusbar>"), m_commandNumber);
+    output += wxString::Format(wxT("<wxxml-symbols>replay_%li(x)</wxxml-symbols>"), m_commandNumber);
+    return output + Prompt();
+  }
+
+  bool Send(wxString data)
+  {
+    wxCharBuffer utf8 = data.utf8_str();
+    return Send(utf8.data(), strlen(utf8.data()));
+  }
+
+  //! Sends data to wxMaxima, split into packets of m_packetSize bytes
+  bool Send(const char *data, size_t length)
+  {
+    size_t pos = 0;
+    while (pos < length)
+    {
+      size_t packet = length - pos;
+      if ((m_packetSize > 0) && (packet > (size_t) m_packetSize))
+        packet = m_packetSize;
+      m_socket->Write(data + pos, packet);
+      if (m_socket->Error())
+        return false;
+      pos += m_socket->LastCount();
+      if ((m_delay > 0) && (pos < length))
+        wxMilliSleep(m_delay);
+    }
+    m_bytesSent += length;
+    m_bytesSinceCommand += length;
+    m_answerSent = m_stopWatch.Time();
+    return true;
+  }
+
+  /*! Waits until wxMaxima has sent a command maxima would answer
+
+    \return false, if wxMaxima has closed the connection or has told maxima to quit.
+   */
+  bool WaitForCommand()
+  {
+    char buffer[65536];
+    while (true)
+    {
+      // Extract the next complete line from the data we have received.
+      const char *data = (const char *) m_input.GetData();
+      size_t length = m_input.GetDataLen();
+      size_t end = 0;
+      while ((end < length) && (data[end] != '\n'))
+        end++;
+      if (end < length)
+      {
+        wxString command = wxString::FromUTF8(data, end);
+        wxMemoryBuffer rest;
+        rest.AppendData(data + end + 1, length - end - 1);
+        m_input = rest;
+
+        command.Trim(false);
+        if (command.StartsWith(wxT(":lisp-quiet")) || command.IsEmpty())
+          continue;
+        if (command.StartsWith(wxT("quit();")) || command.StartsWith(wxT("($quit)")))
+          return false;
+
+        if (m_log.IsOpened())
+          m_log.Write(wxString::Format(wxT("command %li: %li bytes sent, next command after %li ms\n"),
+                                       m_commandNumber, m_bytesSinceCommand,
+                                       m_stopWatch.Time() - m_answerSent));
+        m_commandNumber++;
+        m_bytesSinceCommand = 0;
+        return true;
+      }
+
+      m_socket->Read(buffer, sizeof(buffer));
+      if (m_socket->LastCount() > 0)
+        m_input.AppendData(buffer, m_socket->LastCount());
+      else if (!m_socket->IsConnected() ||
+               (m_socket->Error() && (m_socket->LastError() != wxSOCKET_TIMEDOUT)))
+        return false;
+    }
+  }
+
+  wxSocketClient *m_socket;
+  //! Data we have received from wxMaxima that doesn't form a complete line yet
+  wxMemoryBuffer m_input;
+  wxFFile m_log;
+  wxStopWatch m_stopWatch;
+  long m_packetSize;
+  long m_delay;
+  long m_lines;
+  long m_size;
+  long m_commandNumber;
+  long m_bytesSent;
+  long m_bytesSinceCommand;
+  //! The time the last answer was sent at
+  long m_answerSent;
+};
+
+int main(int argc, char **argv)
+{
+  wxInitializer initializer(argc, argv);
+  if (!initializer.IsOk())
+    return 1;
+
+  wxCmdLineParser cmdLineParser(argc, argv);
+
+  static const wxCmdLineEntryDesc cmdLineDesc[] =
+          {
+                  {wxCMD_LINE_SWITCH, "h", "help", "show this help message", wxCMD_LINE_VAL_NONE},
+                  {wxCMD_LINE_OPTION, "r", "batch-string",
+                   "the \":lisp (setup-client <port>)\" command wxMaxima passes to maxima"},
+                  {wxCMD_LINE_OPTION, "s", "server", "the port to connect to", wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "replay", "play back a recording"},
+                  {wxCMD_LINE_SWITCH, NULL, "realtime", "keep the delays the recording contains"},
+                  {wxCMD_LINE_OPTION, NULL, "lines", "lines of synthetic output per command",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "size", "characters per line of synthetic output",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "packet-size", "the maximum number of bytes per packet",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "delay", "milliseconds to wait between two packets",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "log", "log the response times to a file"},
+                  {wxCMD_LINE_NONE}
+          };
+
+  cmdLineParser.SetDesc(cmdLineDesc);
+  if ((cmdLineParser.Parse() != 0) || cmdLineParser.Found(wxT("h")))
+  {
+    cmdLineParser.Usage();
+    return 1;
+  }
+
+  long port = -1;
+  wxString setupClient;
+  if (cmdLineParser.Found(wxT("r"), &setupClient))
+  {
+    wxRegEx setupClientRegEx(wxT("setup-client[[:space:]]+([0-9]+)"));
+    if (setupClientRegEx.Matches(setupClient))
+      setupClientRegEx.GetMatch(setupClient, 1).ToLong(&port);
+  }
+  cmdLineParser.Found(wxT("s"), &port);
+  if (port <= 0)
+  {
+    wxFprintf(stderr, wxT("No port to connect to was given.\n"));
+    return 1;
+  }
+
+  SessionRecording recording;
+  wxString replayFile;
+  bool replay = cmdLineParser.Found(wxT("replay"), &replayFile);
+  if (replay && !recording.Load(replayFile))
+  {
+    wxFprintf(stderr, wxT("Cannot read the recording %s.\n"), replayFile);
+    return 1;
+  }
+
+  wxIPV4address addr;
+  addr.LocalHost();
+  addr.Service(port);
+  wxSocketClient socket(wxSOCKET_BLOCK);
+  socket.SetTimeout(3600);
+  if (!socket.Connect(addr, true))
+  {
+    wxFprintf(stderr, wxT("Cannot connect to port %li.\n"), port);
+    return 1;
+  }
+
+  ReplayServer server(&socket);
+  long value;
+  if (cmdLineParser.Found(wxT("lines"), &value))
+    server.Lines(value);
+  if (cmdLineParser.Found(wxT("size"), &value))
+    server.Size(value);
+  if (cmdLineParser.Found(wxT("packet-size"), &value))
+    server.PacketSize(value);
+  if (cmdLineParser.Found(wxT("delay"), &value))
+    server.Delay(value);
+  wxString logFile;
+  if (cmdLineParser.Found(wxT("log"), &logFile))
+    server.Log(logFile);
+
+  if (server.SendBanner())
+  {
+    if (replay)
+      server.Replay(recording, cmdLineParser.Found(wxT("realtime")));
+    else
+      server.Synthetic();
+  }
+
+  socket.Close();
+  return 0;
+}
@@ -0,0 +1,217 @@
+﻿// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2017 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+  Measures how fast CommandPreprocessor prepares commands for maxima
+
+  Sends a big synthetic command or the contents of a file through
+  CommandPreprocessor repeatedly and prints the throughput. For comparison
+  it does the same with the sequence of Replace() and regex passes
+  wxMaxima::SendMaxima() used before: The unicode translation, the removal of
+  empty statements and the search for definitions in each statement. The old
+  parenthesis check isn't part of that sequence, so the comparison is in favour
+  of the old code.
+
+  Options:
+    - --file=<file> preprocesses the contents of this file, for example a .mac file.
+    - Without --file --statements statements of synthetic code are generated
+      that contain definitions, comments, strings and unicode characters.
+    - --repeat preprocesses the command this many times.
+*/
+
+#include <wx/init.h>
+#include <wx/cmdline.h>
+#include <wx/stopwatch.h>
+#include <wx/ffile.h>
+#include <wx/regex.h>
+#include <wx/tokenzr.h>
+#include <wx/crt.h>
+
+#include "CommandPreprocessor.h"
+
+//! Generate a command that contains a bit of everything CommandPreprocessor handles
+wxString SyntheticCommand(long statements)
+{
+  wxString command;
+  for (long i = 0; i < statements; i++)
+  {
+    switch (i % 6)
+    {
+      case 0:
+        command << wxString::Format(wxT("f%li(x,[y]):=x^2+apply(\"+\",y)$\n"), i);
+        break;
+      case 1:
+        command << wxString::Format(wxT("a%li: sqrt(x%li)+%%pi/2;\n"), i, i);
+        break;
+      case 2:
+        command << wxString::Format(wxT("/* A comment with a ; and a \"quote\" */ b%li: [1,2,{3,4}]$\n"), i);
+        break;
+      case 3:
+        command << wxString::Format(wxT("print(\"Result; number %li\")$\n"), i);
+        break;
+#if wxUSE_UNICODE
+      case 4:
+        command << wxString::Format(wxT("is(x%li\x00B2 \x2264 2\x03C0 \x22C0 y \x2260 \x221E);\n"), i);
+        break;
+#endif
+      default:
+        command << wxT(" ;\n");
+    }
+  }
+  return command;
+}
+
+//! The passes wxMaxima::SendMaxima() used to do, without the parenthesis check
+wxString LegacyPasses(wxString s, wxRegEx &blankStatementRegEx, wxRegEx &varRegEx, wxRegEx &funRegEx,
+                      long &definitions)
+{
+#if wxUSE_UNICODE
+  s.Replace(wxT("\x00B2"), wxT("^2"));
+  s.Replace(wxT("\x00B3"), wxT("^3"));
+  s.Replace(wxT("\x00BD"), wxT("(1/2)"));
+  s.Replace(wxT("\x221A"), wxT("sqrt"));
+  s.Replace(wxT("\x221E"), wxT("inf"));
+  s.Replace(wxT("\x22C0"), wxT(" and "));
+  s.Replace(wxT("\x22C1"), wxT(" or "));
+  s.Replace(wxT("\x22BB"), wxT(" xor "));
+  s.Replace(wxT("\x22BC"), wxT(" nand "));
+  s.Replace(wxT("\x22BD"), wxT(" nor "));
+  s.Replace(wxT("\x21D2"), wxT(" implies "));
+  s.Replace(wxT("\x21D4"), wxT(" equiv "));
+  s.Replace(wxT("\x00AC"), wxT(" not "));
+  s.Replace(wxT("\x2260"), wxT(" # "));
+  s.Replace(wxT("\x2264"), wxT(" <= "));
+  s.Replace(wxT("\x2265"), wxT(" >= "));
+  s.Replace(wxT("\x2212"), wxT("-"));
+  s.Replace(wxT("\xDCB6"), wxT(" "));
+#endif
+  wxString retval;
+  for (size_t i = 0; i < s.Length(); i++)
+  {
+    if ((wxChar(s[i]) == wxT('\x03C0')) &&
+        ((i == 0) || (!wxIsalnum(s[i - 1]))) &&
+        ((i == s.Length() - 1) || (!wxIsalnum(s[i + 1]))))
+      retval += wxT("%pi");
+    else
+      retval += s[i];
+  }
+  s = retval;
+
+  blankStatementRegEx.Replace(&s, wxT(";"));
+  s.Trim(true);
+  s.Append(wxT("\n"));
+
+  wxStringTokenizer commands(s, wxT(";$"));
+  while (commands.HasMoreTokens())
+  {
+    wxString line = commands.GetNextToken();
+    if (varRegEx.Matches(line))
+      definitions++;
+    if (funRegEx.Matches(line))
+      definitions++;
+  }
+  return s;
+}
+
+int main(int argc, char **argv)
+{
+  wxInitializer initializer(argc, argv);
+  if (!initializer.IsOk())
+    return 1;
+
+  wxCmdLineParser cmdLineParser(argc, argv);
+
+  static const wxCmdLineEntryDesc cmdLineDesc[] =
+          {
+                  {wxCMD_LINE_SWITCH, "h", "help", "show this help message", wxCMD_LINE_VAL_NONE},
+                  {wxCMD_LINE_OPTION, NULL, "file", "preprocess the contents of this file"},
+                  {wxCMD_LINE_OPTION, NULL, "statements", "the number of statements to generate",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_OPTION, NULL, "repeat", "how often to preprocess the command",
+                   wxCMD_LINE_VAL_NUMBER},
+                  {wxCMD_LINE_NONE}
+          };
+
+  cmdLineParser.SetDesc(cmdLineDesc);
+  if ((cmdLineParser.Parse() != 0) || cmdLineParser.Found(wxT("h")))
+  {
+    cmdLineParser.Usage();
+    return 1;
+  }
+
+  wxString command;
+  wxString file;
+  if (cmdLineParser.Found(wxT("file"), &file))
+  {
+    wxFFile input(file);
+    if ((!input.IsOpened()) || (!input.ReadAll(&command, wxConvUTF8)))
+    {
+      wxFprintf(stderr, wxT("Cannot read %s.\n"), file);
+      return 1;
+    }
+  }
+  else
+  {
+    long statements = 20000;
+    cmdLineParser.Found(wxT("statements"), &statements);
+    command = SyntheticCommand(statements);
+  }
+
+  long repeat = 10;
+  cmdLineParser.Found(wxT("repeat"), &repeat);
+  if (repeat < 1)
+    repeat = 1;
+
+  double mchars = command.Length() * repeat / 1e6;
+
+  CommandPreprocessor preprocessor;
+
+  // Regression: After to_lisp() maxima reads lisp, in which ";" starts a comment.
+  if (!preprocessor.Process(wxT("to_lisp();\n(defun f (x) ; the argument\n  x)\n(to-maxima)")))
+  {
+    wxFprintf(stderr, wxT("to_lisp(): %s\n"), preprocessor.GetError());
+    return 1;
+  }
+
+  long definitions = 0;
+  wxStopWatch stopWatch;
+  for (long i = 0; i < repeat; i++)
+  {
+    preprocessor.Process(command);
+    definitions += preprocessor.GetVariables().GetCount() + preprocessor.GetFunctions().GetCount();
+  }
+  long singlePass = stopWatch.Time();
+  if (preprocessor.GetError() != wxEmptyString)
+    wxPrintf(wxT("The command contains an error: %s\n"), preprocessor.GetError());
+  wxPrintf(wxT("CommandPreprocessor: %li definitions, %li ms, %.2f MChars/s\n"),
+           definitions / repeat, singlePass, mchars / wxMax(singlePass, 1) * 1000);
+
+  wxRegEx funRegEx(wxT("^ *([[:alnum:]%_]+) *\\(([[:alnum:]%_,[[.].] ]*)\\) *:="));
+  wxRegEx varRegEx(wxT("^ *([[:alnum:]%_]+) *:"));
+  wxRegEx blankStatementRegEx(wxT("(^;)|((^|;)(((\\/\\*.*\\*\\/)?([[:space:]]*))+;)+)"));
+  definitions = 0;
+  stopWatch.Start();
+  for (long i = 0; i < repeat; i++)
+    LegacyPasses(command, blankStatementRegEx, varRegEx, funRegEx, definitions);
+  long legacy = stopWatch.Time();
+  wxPrintf(wxT("Separate passes:     %li definitions, %li ms, %.2f MChars/s\n"),
+           definitions / repeat, legacy, mchars / wxMax(legacy, 1) * 1000);
+  return 0;
+}